@@ -63,6 +63,8 @@
 #include "video.h"
 #include "codec.h"
 #include "softhddev.h"
+#include "trace.h"
+#include "bench.h"
 
 
 //----------------------------------------------------------------------------
@@ -70,6 +72,9 @@
 //----------------------------------------------------------------------------
 
 #define MIN_AUDIO_BUFFER	450	///< minimal output buffer in ms
+#define ALSA_BUFFER_TIME	100000	///< alsa buffer in us
+#define ALSA_DEEP_BUFFER_TIME	500000	///< alsa buffer without video in us
+#define AUDIO_THREAD_TIMEOUT_MS	1000	///< max wait for the thread to stop
 
 //----------------------------------------------------------------------------
 //	Variables
@@ -80,13 +85,15 @@ static const char *AudioPassthroughDevice;	///< Passthrough device name
 static char AudioAppendAES;		///< flag automatic append AES
 static const char *AudioMixerDevice;	///< mixer device name
 static const char *AudioMixerChannel;	///< mixer channel name
-static volatile char AudioRunning;	///< thread running / stopped
+BENCH_STATIC volatile char AudioRunning;	///< thread running / stopped
 static volatile char AudioPaused;	///< audio paused
 static volatile char AudioVideoIsReady;	///< video ready start early
 static int AudioSkip;			///< skip audio to sync to video
 
 static const int AudioBytesProSample = 2;	///< number of bytes per sample
 static int AudioBufferTime;	///< audio buffer time in ms
+static int AudioDeepBuffer;	///< no video, large alsa buffer
+static int AlsaDeepBuffer;	///< alsa is setup with the large buffer
 
 static pthread_t AudioThread;		///< audio play thread
 static pthread_mutex_t AudioRbMutex;	///< audio condition mutex
@@ -122,6 +129,11 @@ static int AlsaUseMmap;			///< use mmap
 static snd_mixer_t *AlsaMixer;		///< alsa mixer handle
 static snd_mixer_elem_t *AlsaMixerElem;	///< alsa pcm mixer element
 static int AlsaRatio;			///< internal -> mixer ratio * 1000
+static unsigned AlsaXruns;		///< underruns recovered
+static int AlsaDelayMs;			///< last pcm delay in ms
+
+    /// virtual pcm delay in frames, replaces the alsa device if set
+BENCH_STATIC long (*AlsaVirtualDelay)(void);
 
 //	Filter variables
 static const int AudioNormSamples = 4096;	///< number of samples
@@ -172,7 +184,7 @@ static int AlsaSetup(int channels, int sample_rate, int passthrough);
 **	@param size		size of sample buffer in bytes
 **	@param channels		number of channels interleaved in sample buffer
 */
-static void AudioReorderAudioFrame(int16_t * buf, int size, int channels)
+BENCH_STATIC void AudioReorderAudioFrame(int16_t * buf, int size, int channels)
 {
 	int i;
 	int c;
@@ -229,7 +241,7 @@ static void AudioReorderAudioFrame(int16_t * buf, int size, int channels)
 **	@param samples	sample buffer
 **	@param count	number of bytes in sample buffer
 */
-static void AudioNormalizer(int16_t * samples, int count)
+BENCH_STATIC void AudioNormalizer(int16_t * samples, int count)
 {
     int i;
     int l;
@@ -308,7 +320,7 @@ static void AudioNormalizer(int16_t * samples, int count)
 /**
 **	Reset normalizer.
 */
-static void AudioResetNormalizer(void)
+BENCH_STATIC void AudioResetNormalizer(void)
 {
     int i;
 
@@ -326,7 +338,7 @@ static void AudioResetNormalizer(void)
 **	@param samples	sample buffer
 **	@param count	number of bytes in sample buffer
 */
-static void AudioCompressor(int16_t * samples, int count)
+BENCH_STATIC void AudioCompressor(int16_t * samples, int count)
 {
     int max_sample;
     int i;
@@ -379,7 +391,7 @@ static void AudioCompressor(int16_t * samples, int count)
 /**
 **	Reset compressor.
 */
-static void AudioResetCompressor(void)
+BENCH_STATIC void AudioResetCompressor(void)
 {
     AudioCompressionFactor = 2000;
     if (AudioCompressionFactor > AudioMaxCompression) {
@@ -395,7 +407,7 @@ static void AudioResetCompressor(void)
 **
 **	@todo FIXME: this does hard clipping
 */
-static void AudioSoftAmplifier(int16_t * samples, int count)
+BENCH_STATIC void AudioSoftAmplifier(int16_t * samples, int count)
 {
     int i;
 
@@ -514,7 +526,8 @@ static int AudioFilterInit(AVCodecContext *AudioCtx)
 	// Before filter init set HW parameter.
 	if (AudioCtx->sample_rate != (int)HwSampleRate ||
 		(AudioCtx->channels != (int)HwChannels && 
-		!(AudioDownMix && HwChannels == 2))) {
+		!(AudioDownMix && HwChannels == 2)) ||
+		AudioDeepBuffer != AlsaDeepBuffer) {
 
 		err = AlsaSetup(AudioCtx->channels, AudioCtx->sample_rate, 0);
 		if (err)
@@ -624,6 +637,9 @@ static void AudioRingInit(void)
 {
 	// ~2s 8ch 16bit
 	AudioRingBuffer = RingBufferNew(AudioRingBufferSize);
+	if (AudioRingBuffer) {
+		MemAccount(MEM_AUDIO, AudioRingBufferSize);
+	}
 }
 
 /**
@@ -634,6 +650,7 @@ static void AudioRingExit(void)
 	if (AudioRingBuffer) {
 		RingBufferDel(AudioRingBuffer);
 		AudioRingBuffer = NULL;
+		MemAccount(MEM_AUDIO, -(long)AudioRingBufferSize);
 	}
 	HwSampleRate = 0;	// checked for valid setup
 }
@@ -716,8 +733,13 @@ static int AlsaPlayer(void)
 		}
 
 		// wait for space in kernel buffers
-		if ((err = snd_pcm_wait(AlsaPCMHandle, 150)) < 0) {
+		err = snd_pcm_wait(AlsaPCMHandle, 150);
+		WakeCount();
+		if (err < 0) {
 //			Error("AlsaPlayer: snd_pcm_wait error? '%s'", snd_strerror(err));
+			if (err == -EPIPE) {
+				AlsaXruns++;
+			}
 			err = snd_pcm_recover(AlsaPCMHandle, err, 0);
 //			Error("AlsaPlayer: snd_pcm_wait error: snd_pcm_recover %s", snd_strerror(err));
 		}
@@ -733,6 +755,9 @@ static int AlsaPlayer(void)
 			if (n == -EAGAIN) {
 				continue;
 			}
+			if (n == -EPIPE) {
+				AlsaXruns++;
+			}
 			err = snd_pcm_recover(AlsaPCMHandle, n, 0);
 			if (err >= 0) {
 				continue;
@@ -769,14 +794,16 @@ static int AlsaPlayer(void)
 
 		frames = snd_pcm_bytes_to_frames(AlsaPCMHandle, avail);
 
-		pthread_mutex_lock(&AudioRbMutex);
+		TraceMutexLock(AudioRbMutex);
 		if (AlsaUseMmap) {
 			err = snd_pcm_mmap_writei(AlsaPCMHandle, p, frames);
 		} else {
 			err = snd_pcm_writei(AlsaPCMHandle, p, frames);
 		}
+		Trace(TRACE_AUDIO_WRITE, PTS);
 		RingBufferReadAdvance(AudioRingBuffer, avail);
-		pthread_mutex_unlock(&AudioRbMutex);
+		TraceMutexUnlock(AudioRbMutex);
+		SignalBufferSpace();
 		if (err != frames) {
 			if (err < 0) {
 				if (err == -EAGAIN) {
@@ -784,6 +811,9 @@ static int AlsaPlayer(void)
 				}
 				Warning("audio/alsa: writei underrun error? '%s'",
 					snd_strerror(err));
+				if (err == -EPIPE) {
+					AlsaXruns++;
+				}
 				err = snd_pcm_recover(AlsaPCMHandle, err, 0);
 				if (err >= 0) {
 					continue;
@@ -947,8 +977,11 @@ static int AlsaSetup(int channels, int sample_rate, __attribute__ ((unused)) int
 	snd_pcm_state_t state;
 	int err;
 	int delay;
-	unsigned buffer_time = 100000;	// 100ms
+	unsigned buffer_time;
 
+	// without video there is no lip sync, fewer wakeups with longer periods
+	AlsaDeepBuffer = AudioDeepBuffer;
+	buffer_time = AlsaDeepBuffer ? ALSA_DEEP_BUFFER_TIME : ALSA_BUFFER_TIME;
 	AudioDownMix = 0;
 
 	if (AudioRunning) {
@@ -1105,6 +1138,16 @@ static void AlsaExit(void)
 //	thread playback
 //----------------------------------------------------------------------------
 
+/**
+**	Unlock a mutex, cleanup handler of a canceled wait.
+**
+**	@param mutex	pthread_mutex_t to unlock
+*/
+static void MutexUnlockCleanup(void *mutex)
+{
+	pthread_mutex_unlock((pthread_mutex_t *)mutex);
+}
+
 /**
 **	Audio play thread.
 **
@@ -1112,6 +1155,7 @@ static void AlsaExit(void)
 */
 static void *AudioPlayHandlerThread(void *dummy)
 {
+	WakeRegister(WAKE_AUDIO);
 	for (;;) {
 		// check if we should stop the thread
 		if (AudioThreadStop) {
@@ -1128,10 +1172,16 @@ static void *AudioPlayHandlerThread(void *dummy)
 		}
 		AudioRunning = 0;
 		AlsaPlayerStop = 0;
-		pthread_mutex_lock(&AudioStartMutex);
+		TraceMutexLock(AudioStartMutex);
+		// a canceled thread doesn't keep the mutex locked
+		pthread_cleanup_push(MutexUnlockCleanup, &AudioStartMutex);
 		Debug2(L_SOUND, "audio: AudioPlayHandlerThread: pthread_cond_wait");
-		pthread_cond_wait(&AudioStartCond, &AudioStartMutex);
-		pthread_mutex_unlock(&AudioStartMutex);
+		if (!AudioThreadStop) {
+			TraceCondWait(AudioStartCond, AudioStartMutex);
+			WakeCount();
+		}
+		pthread_cleanup_pop(0);
+		TraceMutexUnlock(AudioStartMutex);
 
 		Debug2(L_SOUND, "audio: AudioPlayHandlerThread: nach pthread_cond_wait ----> %dms start", (AudioUsedBytes() * 1000)
 			/ (!HwSampleRate + !HwChannels +
@@ -1173,17 +1223,15 @@ static void AudioInitThread(void)
 */
 static void AudioExitThread(void)
 {
-    void *retval;
-
     Debug2(L_SOUND, "audio: %s", __FUNCTION__);
 
     if (AudioThread) {
 	AudioThreadStop = 1;
 	AudioRunning = 1;		// wakeup thread, if needed
+	TraceMutexLock(AudioStartMutex);
 	pthread_cond_signal(&AudioStartCond);
-	if (pthread_join(AudioThread, &retval) || retval != PTHREAD_CANCELED) {
-	    Error("audio: can't cancel play thread");
-	}
+	TraceMutexUnlock(AudioStartMutex);
+	ThreadJoin(AudioThread, "audio", AUDIO_THREAD_TIMEOUT_MS);
 	pthread_cond_destroy(&AudioStartCond);
 	pthread_mutex_destroy(&AudioRbMutex);
 	pthread_mutex_destroy(&AudioStartMutex);
@@ -1222,13 +1270,13 @@ void AudioEnqueue(AVFrame *frame)
 
 	AudioReorderAudioFrame(buffer, count, frame->channels);
 
-	pthread_mutex_lock(&AudioRbMutex);
+	TraceMutexLock(AudioRbMutex);
 	n = RingBufferWrite(AudioRingBuffer, buffer, count);
 	if (n != (size_t) count)
 		Error("audio: AudioEnqueue: can't place %d samples in ring buffer", count);
 	PTS = frame->pts + (frame->nb_samples * timebase->den /
 		timebase->num / frame->sample_rate);
-	pthread_mutex_unlock(&AudioRbMutex);
+	TraceMutexUnlock(AudioRbMutex);
 
 	if (!AudioRunning && !AudioPaused) {		// check, if we can start the thread
 		int skip;
@@ -1412,7 +1460,7 @@ void AudioFlushBuffers(void)
 		AlsaFlushBuffers();
 
 	while(AudioRunning) {
-		usleep(5000);
+		ClockSleep(5000);
 	}
 
 	Filterchanged = 1;
@@ -1447,24 +1495,45 @@ int AudioUsedBytes(void)
 	RingBufferUsedBytes(AudioRingBuffer) : 0;
 }
 
+/**
+**	Get audio statistics.
+**
+**	@param[out] xruns	alsa underruns recovered
+**	@param[out] delay	last alsa pcm delay in ms
+**	@param[out] buffered	audio in the ring buffer in ms
+*/
+void AudioGetStats(unsigned *xruns, int *delay, int *buffered)
+{
+	*xruns = AlsaXruns;
+	*delay = AlsaDelayMs;
+	*buffered = (AudioUsedBytes() * 1000)
+		/ (!HwSampleRate + !HwChannels +
+		HwSampleRate * HwChannels * AudioBytesProSample);
+}
+
 /**
 **	Get current audio clock.
 **
+**	The headless runner replaces the alsa device by a virtual pcm
+**	delay, the clock is calculated the same way.
+**
 **	@returns the audio clock in time stamps.
 */
 int64_t AudioGetClock(void)
 {
 	if (!AudioRunning || !HwSampleRate ||
-		!AlsaPCMHandle || PTS == AV_NOPTS_VALUE) {
+		!(AlsaPCMHandle || AlsaVirtualDelay) || PTS == AV_NOPTS_VALUE) {
 
 		return AV_NOPTS_VALUE;
 	}
 	snd_pcm_sframes_t delay;
 	int64_t pts;
 
-	pthread_mutex_lock(&AudioRbMutex);
+	TraceMutexLock(AudioRbMutex);
 	// delay in frames in alsa + kernel buffers
-	if (snd_pcm_delay(AlsaPCMHandle, &delay) < 0) {
+	if (AlsaVirtualDelay) {
+		delay = AlsaVirtualDelay();
+	} else if (snd_pcm_delay(AlsaPCMHandle, &delay) < 0) {
 		Debug2(L_SOUND, "AudioGetClock: no hw delay");
 		delay = 0L;
 	}
@@ -1475,10 +1544,11 @@ int64_t AudioGetClock(void)
 	}
 
 	pts = (int64_t)delay * 1000 / HwSampleRate;
+	AlsaDelayMs = pts;
 
 	pts += (int64_t)RingBufferUsedBytes(AudioRingBuffer) * 1000 /
 			HwSampleRate / HwChannels / AudioBytesProSample;
-	pthread_mutex_unlock(&AudioRbMutex);
+	TraceMutexUnlock(AudioRbMutex);
 
 	return PTS * 1000 * av_q2d(*timebase) - pts;
 }
@@ -1574,6 +1644,24 @@ void AudioSetBufferTime(int delay)
 	AudioBufferTime = MIN_AUDIO_BUFFER + delay;
 }
 
+/**
+**	Set deep audio buffering.
+**
+**	Used without video, alsa gets a 500ms instead of a 100ms buffer and
+**	needs fewer wakeups. A change rebuilds the filter graph with the
+**	next audio frame, which sets up alsa again. So it also takes effect
+**	when the codec is kept between playlist entries.
+**
+**	@param onoff	enable/disable deep buffer
+*/
+void AudioSetDeepBuffer(int onoff)
+{
+	if (AudioDeepBuffer != onoff) {
+		AudioDeepBuffer = onoff;
+		Filterchanged = 1;
+	}
+}
+
 /**
 **	Set audio downmix.
 **
@@ -32,6 +32,7 @@ extern void AudioFlushBuffers(void);	///< flush audio buffers
 extern void AudioPoller(void);		///< poll audio events/handling		not used!
 extern int AudioFreeBytes(void);	///< free bytes in audio output
 extern int AudioUsedBytes(void);	///< used bytes in audio output
+extern void AudioGetStats(unsigned *, int *, int *);	///< get audio statistics
 extern int64_t AudioGetClock();		///< get current audio clock
 extern int AudioVideoReady(int64_t);	///< tell audio video is ready
 
@@ -42,6 +43,7 @@ extern void AudioPlay(void);		///< play audio
 extern void AudioPause(void);		///< pause audio
 
 extern void AudioSetBufferTime(int);	///< set audio buffer time
+extern void AudioSetDeepBuffer(int);	///< set deep buffer without video
 extern void AudioSetSoftvol(int);	///< enable/disable softvol
 extern void AudioSetNormalize(int, int);	///< set normalize parameters
 extern void AudioSetCompression(int, int);	///< set compression parameters
@@ -0,0 +1,1815 @@
+///
+///	@file bench.c	@brief Headless pipeline runner
+///
+///	Copyright (c) 2020 by zille.  All Rights Reserved.
+///
+///	Contributor(s):
+///
+///	License: AGPLv3
+///
+///	This program is free software: you can redistribute it and/or modify
+///	it under the terms of the GNU Affero General Public License as
+///	published by the Free Software Foundation, either version 3 of the
+///	License.
+///
+///	This program is distributed in the hope that it will be useful,
+///	but WITHOUT ANY WARRANTY; without even the implied warranty of
+///	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+///	GNU Affero General Public License for more details.
+///
+///	$Id$
+//////////////////////////////////////////////////////////////////////////////
+
+///
+///	@defgroup Bench The headless pipeline runner.
+///
+///	Feeds a recorded transport stream or PES dump through PlayVideo()
+///	and PlayAudio() like VDR does during replay, without VDR. The
+///	audio goes to the alsa "null" device, the video to the first
+///	usable DRM device or with -n to the null display, which needs no
+///	device and no privileges. At the end
+///	throughput, dropped and duped frames, CPU time and the latency
+///	between the pipeline stages are printed as key=value lines.
+///
+///	With -m it runs micro benchmarks of the hot path primitives
+///	instead, with -u unit tests of the module internal helpers.
+///
+///	With -s it replays a/v sync scenarios in stepped time: a virtual
+///	alsa device plays the audio behind AudioGetClock(), the display
+///	path of the null display shows the frames and drops or dups them
+///	like on a device. The results are deterministic and count the
+///	glitches.
+///
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sched.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+
+#include <libavcodec/avcodec.h>
+
+#include "misc.h"
+#include "softhddev.h"
+#include "audio.h"
+#include "video.h"
+#include "trace.h"
+#include "ringbuffer.h"
+#include "bench.h"
+
+#define TS_PACKET_SIZE	188		///< transport stream packet size
+#define PES_MAX_SIZE	(4 * 1024 * 1024)	///< max collected pes packet
+
+#define BENCH_RB_SIZE	(64 * 1024)	///< micro benchmark ring buffer size
+#define BENCH_RB_PATTERN (1024 * 1024)	///< size of the test pattern
+#define BENCH_RB_BYTES	(1024LL * 1024 * 1024)	///< bytes through the ring
+
+#define BENCH_OSD_WIDTH	1920		///< indexed osd row width
+#define BENCH_OSD_ROWS	20000		///< indexed osd rows converted
+
+#define BENCH_OSD_HEIGHT 1080		///< composited osd height
+#define BENCH_OSD_FRAMES 10		///< composited osd frames per stack
+
+#define BENCH_AUDIO_CHANNELS 6		///< filtered audio channels
+#define BENCH_AUDIO_FRAME 1536		///< samples per channel of a frame
+#define BENCH_AUDIO_FRAMES 2000		///< filtered audio frames, 64s
+
+#define BENCH_NV12_FRAMES 200		///< copied 1080p frames
+
+#define BENCH_NORM_BLOCK 4096		///< normalizer test block
+#define BENCH_NORM_BLOCKS 200		///< blocks until the factor settles
+
+#define SYNC_DURATION_MS 60000		///< simulated time of a scenario
+#define SYNC_FRAME_MS	20		///< frame duration, 50p
+#define SYNC_FRAME_SIZE	64		///< width and height of the frames
+#define SYNC_SAMPLE_RATE 48000		///< virtual alsa sample rate
+#define SYNC_CHANNELS	2		///< virtual alsa channels
+#define SYNC_AUDIO_CHUNK 1152		///< frames of a decoded audio frame
+#define SYNC_ALSA_BUFFER_MS 100		///< virtual alsa buffer
+#define SYNC_AUDIO_BUFFER_MS 300	///< audio kept decoded
+
+//////////////////////////////////////////////////////////////////////////////
+//	VDR replacements
+//////////////////////////////////////////////////////////////////////////////
+
+int SysLogLevel = 1;			///< errors only
+int ConfigAudioBufferTime;		///< default audio buffer time
+int DisableOglOsd = 1;			///< no OpenGL OSD
+
+/**
+**	No jpeg support, grabbing isn't benchmarked.
+*/
+uint8_t *CreateJpeg( __attribute__ ((unused)) uint8_t * image,
+	__attribute__ ((unused)) int *size,
+	__attribute__ ((unused)) int quality,
+	__attribute__ ((unused)) int width,
+	__attribute__ ((unused)) int height)
+{
+	return NULL;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//	Runner
+//////////////////////////////////////////////////////////////////////////////
+
+    /// elementary stream collected from the transport stream
+struct bench_stream
+{
+	int Pid;			///< transport stream pid
+	int Id;				///< pes stream id
+	int Size;			///< collected pes bytes
+	int Packets;			///< played pes packets
+	uint8_t *Data;			///< collected pes packet
+};
+
+static volatile sig_atomic_t BenchInterrupted;	///< SIGINT received
+static int BenchRealTime;		///< feed in real time
+static int64_t BenchBasePts = AV_NOPTS_VALUE;	///< first video pts
+static uint64_t BenchBaseTime;		///< time of the first video pts
+static uint64_t BenchBytes;		///< played bytes
+
+/**
+**	Get monotonic time in us.
+*/
+static uint64_t BenchTime(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/**
+**	Stop feeding on SIGINT.
+*/
+static void BenchSignal( __attribute__ ((unused)) int sig)
+{
+	BenchInterrupted = 1;
+}
+
+/**
+**	Wait until a video pes packet is due in real time mode.
+**
+**	@param data	pes packet
+**	@param size	size of the pes packet
+*/
+static void BenchPace(const uint8_t * data, int size)
+{
+	int64_t pts;
+	uint64_t due;
+	uint64_t now;
+
+	if (size < 14 || !(data[7] & 0x80)) {
+		return;
+	}
+	pts = (int64_t) (data[9] & 0x0E) << 29 | data[10] << 22 | (data[11] &
+		0xFE) << 14 | data[12] << 7 | (data[13] & 0xFE) >> 1;
+
+	now = BenchTime();
+	if (BenchBasePts == (int64_t) AV_NOPTS_VALUE) {
+		BenchBasePts = pts;
+		BenchBaseTime = now;
+		return;
+	}
+	// 33 bit pts wraps
+	due = BenchBaseTime + ((pts - BenchBasePts) & 0x1FFFFFFFFLL) / 90 * 1000;
+	if (due > now && due - now < 10000000) {
+		usleep(due - now);
+	}
+}
+
+/**
+**	Play a complete pes packet, wait while the buffers are full.
+**
+**	@param data	pes packet
+**	@param size	size of the pes packet
+*/
+static void BenchPlay(const uint8_t * data, int size)
+{
+	int video;
+
+	if (size < 9) {
+		return;
+	}
+	video = (data[3] & 0xF0) == 0xE0;
+	if (video && BenchRealTime) {
+		BenchPace(data, size);
+	}
+
+	while (!BenchInterrupted) {
+		if (video ? PlayVideo(data, size) : PlayAudio(data, size, data[3])) {
+			BenchBytes += size;
+			return;
+		}
+		Poll(10);
+	}
+}
+
+/**
+**	Check for a pes stream id which is played.
+*/
+static int BenchPesId(int id)
+{
+	return (id & 0xF0) == 0xE0 || (id & 0xE0) == 0xC0 || id == 0xBD;
+}
+
+/**
+**	Play a transport stream.
+**
+**	The first video and the first audio pid are played.
+**
+**	@param data	transport stream
+**	@param size	size of the transport stream
+**	@param video	collected video pes
+**	@param audio	collected audio pes
+*/
+static void BenchPlayTs(const uint8_t * data, size_t size,
+	struct bench_stream *video, struct bench_stream *audio)
+{
+	const uint8_t *p;
+
+	for (p = data; p + TS_PACKET_SIZE <= data + size && !BenchInterrupted;
+		p += TS_PACKET_SIZE) {
+		struct bench_stream *stream;
+		int payload;
+		int pid;
+
+		if (p[0] != 0x47) {
+			// lost sync, search the next packet start
+			do {
+				p++;
+			} while (p + TS_PACKET_SIZE <= data + size && *p != 0x47);
+			p -= TS_PACKET_SIZE;
+			continue;
+		}
+		pid = (p[1] & 0x1F) << 8 | p[2];
+		payload = 4;
+		if (p[3] & 0x20) {	// adaptation field
+			payload += 1 + p[4];
+		}
+		if (!(p[3] & 0x10) || payload >= TS_PACKET_SIZE) {
+			continue;
+		}
+
+		// a new pes packet starts, take the first video and audio pid
+		if (p[1] & 0x40 && payload + 4 <= TS_PACKET_SIZE
+			&& !p[payload] && !p[payload + 1]
+			&& p[payload + 2] == 0x01 && BenchPesId(p[payload + 3])) {
+			int id = p[payload + 3];
+
+			if (video->Pid < 0 && (id & 0xF0) == 0xE0) {
+				video->Pid = pid;
+				video->Id = id;
+			} else if (audio->Pid < 0 && (id & 0xF0) != 0xE0) {
+				audio->Pid = pid;
+				audio->Id = id;
+			}
+		}
+		if (pid == video->Pid) {
+			stream = video;
+		} else if (pid == audio->Pid) {
+			stream = audio;
+		} else {
+			continue;
+		}
+
+		if (p[1] & 0x40) {
+			if (stream->Size) {
+				BenchPlay(stream->Data, stream->Size);
+				stream->Packets++;
+			}
+			stream->Size = 0;
+		}
+		if (stream->Size + TS_PACKET_SIZE - payload <= PES_MAX_SIZE) {
+			memcpy(stream->Data + stream->Size, p + payload,
+				TS_PACKET_SIZE - payload);
+			stream->Size += TS_PACKET_SIZE - payload;
+		}
+	}
+	if (video->Size) {
+		BenchPlay(video->Data, video->Size);
+		video->Packets++;
+	}
+	if (audio->Size) {
+		BenchPlay(audio->Data, audio->Size);
+		audio->Packets++;
+	}
+}
+
+/**
+**	Play a pes dump.
+**
+**	Video pes packets without length end at the next pes start code.
+**
+**	@param data	pes packets
+**	@param size	size of the pes packets
+**	@param video	video statistics
+**	@param audio	audio statistics
+*/
+static void BenchPlayPes(const uint8_t * data, size_t size,
+	struct bench_stream *video, struct bench_stream *audio)
+{
+	const uint8_t *p;
+	const uint8_t *end;
+
+	end = data + size;
+	for (p = data; p + 9 <= end && !BenchInterrupted;) {
+		const uint8_t *next;
+		int length;
+
+		if (p[0] || p[1] || p[2] != 0x01) {
+			p++;
+			continue;
+		}
+		length = p[4] << 8 | p[5];
+		if (length) {
+			next = p + 6 + length;
+		} else {
+			for (next = p + 9; next + 4 <= end; ++next) {
+				if (!next[0] && !next[1] && next[2] == 0x01
+					&& BenchPesId(next[3])) {
+					break;
+				}
+			}
+			if (next + 4 > end) {
+				next = end;
+			}
+		}
+		if (next > end) {
+			break;
+		}
+		if ((p[3] & 0xF0) == 0xE0) {
+			BenchPlay(p, next - p);
+			video->Packets++;
+		} else if (BenchPesId(p[3])) {
+			BenchPlay(p, next - p);
+			audio->Packets++;
+		}
+		p = next;
+	}
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//	Micro benchmarks
+//////////////////////////////////////////////////////////////////////////////
+
+    /// ring buffer benchmark state
+struct bench_ring
+{
+	RingBuffer *Rb;			///< ring buffer under test
+	uint8_t *Pattern;		///< expected byte stream
+	long long Errors;		///< bytes read back wrong
+};
+
+/**
+**	Write the next chunk of the pattern into the ring buffer.
+**
+**	@param ring	benchmark state
+**	@param pos	stream position
+**	@param cnt	wanted chunk size
+**
+**	@returns bytes written
+*/
+static size_t BenchRingWrite(struct bench_ring *ring, long long pos, size_t cnt)
+{
+	size_t off;
+
+	off = pos % BENCH_RB_PATTERN;
+	if (cnt > BENCH_RB_PATTERN - off) {
+		cnt = BENCH_RB_PATTERN - off;
+	}
+	return RingBufferWrite(ring->Rb, ring->Pattern + off, cnt);
+}
+
+/**
+**	Read from the ring buffer without copy, like the alsa thread.
+**
+**	@param ring	benchmark state
+**	@param pos	stream position
+**
+**	@returns bytes read
+*/
+static size_t BenchRingRead(struct bench_ring *ring, long long pos)
+{
+	const void *p;
+	size_t cnt;
+	size_t off;
+
+	if (!(cnt = RingBufferGetReadPointer(ring->Rb, &p))) {
+		return 0;
+	}
+	off = pos % BENCH_RB_PATTERN;
+	if (cnt > BENCH_RB_PATTERN - off) {
+		cnt = BENCH_RB_PATTERN - off;
+	}
+	if (memcmp(p, ring->Pattern + off, cnt)) {
+		ring->Errors += cnt;
+	}
+	return RingBufferReadAdvance(ring->Rb, cnt);
+}
+
+/**
+**	Ring buffer producer thread.
+*/
+static void *BenchRingProducer(void *arg)
+{
+	struct bench_ring *ring;
+	long long pos;
+
+	ring = arg;
+	for (pos = 0; pos < BENCH_RB_BYTES;) {
+		size_t n;
+
+		// odd chunk size, wraps at every position
+		if (!(n = BenchRingWrite(ring, pos, 4609))) {
+			sched_yield();
+		}
+		pos += n;
+	}
+	return NULL;
+}
+
+/**
+**	Benchmark the ring buffer.
+**
+**	Single threaded with alternating write and read, and concurrent
+**	with one producer and one consumer thread. The read data is
+**	compared with the written pattern.
+**
+**	@returns number of bytes read back wrong
+*/
+static long long BenchRingBuffer(void)
+{
+	struct bench_ring ring;
+	pthread_t producer;
+	uint64_t start;
+	uint64_t time;
+	long long pos;
+	int i;
+
+	ring.Rb = RingBufferNew(BENCH_RB_SIZE);
+	ring.Pattern = malloc(BENCH_RB_PATTERN);
+	ring.Errors = 0;
+	for (i = 0; i < BENCH_RB_PATTERN; ++i) {
+		ring.Pattern[i] = i ^ i >> 8 ^ i >> 16;
+	}
+
+	start = BenchTime();
+	for (pos = 0; pos < BENCH_RB_BYTES;) {
+		BenchRingWrite(&ring, pos + RingBufferUsedBytes(ring.Rb), 4609);
+		pos += BenchRingRead(&ring, pos);
+	}
+	time = BenchTime() - start;
+	printf("ringbuffer_single_mb_s=%.1f\n", BENCH_RB_BYTES / (double)time);
+
+	RingBufferReset(ring.Rb);
+	start = BenchTime();
+	pthread_create(&producer, NULL, BenchRingProducer, &ring);
+	for (pos = 0; pos < BENCH_RB_BYTES;) {
+		size_t n;
+
+		if (!(n = BenchRingRead(&ring, pos))) {
+			sched_yield();
+		}
+		pos += n;
+	}
+	pthread_join(producer, NULL);
+	time = BenchTime() - start;
+	printf("ringbuffer_spsc_mb_s=%.1f\n", BENCH_RB_BYTES / (double)time);
+	printf("ringbuffer_errors=%lld\n", ring.Errors);
+
+	RingBufferDel(ring.Rb);
+	free(ring.Pattern);
+	return ring.Errors;
+}
+
+/**
+**	Convert indexed osd rows and time it.
+**
+**	@param dst	ARGB row
+**	@param src	index row
+**	@param palette	ARGB palette
+**	@param planes	byte planes, NULL for the plain lookup
+**
+**	@returns million pixel per second
+*/
+static double BenchOsdIndexedRun(uint32_t * dst, const uint8_t * src,
+	const uint32_t * palette, const uint8_t planes[4][256])
+{
+	uint64_t start;
+	int i;
+
+	start = BenchTime();
+	for (i = 0; i < BENCH_OSD_ROWS; ++i) {
+		// odd offset and width, the tails are converted too
+		OsdIndexedRow(dst + (i & 7), src + (i & 7), palette, planes,
+			BENCH_OSD_WIDTH - 7 - (i & 7));
+	}
+	return (double)BENCH_OSD_ROWS * (BENCH_OSD_WIDTH - 7) / (BenchTime() - start + 1);
+}
+
+/**
+**	Benchmark the indexed osd conversion.
+**
+**	The vector table lookup is compared with the plain palette lookup
+**	for 2, 16 and 256 color bitmaps, and checked against it.
+**
+**	@returns number of wrong pixels
+*/
+static long long BenchOsdIndexed(void)
+{
+	static const int colors[] = { 2, 16, 256 };
+	uint32_t palette[256];
+	uint8_t planes[4][256];
+	uint8_t src[BENCH_OSD_WIDTH];
+	uint32_t dst[BENCH_OSD_WIDTH];
+	uint32_t ref[BENCH_OSD_WIDTH];
+	long long errors;
+	unsigned c;
+	int i;
+
+	errors = 0;
+	for (c = 0; c < sizeof(colors) / sizeof(*colors); ++c) {
+		int table;
+
+		for (i = 0; i < 256; ++i) {
+			palette[i] = i < colors[c] ? 0x80402010u * (i + 1) ^ (uint32_t)i << 24 : 0;
+			planes[0][i] = palette[i];
+			planes[1][i] = palette[i] >> 8;
+			planes[2][i] = palette[i] >> 16;
+			planes[3][i] = palette[i] >> 24;
+		}
+		for (i = 0; i < BENCH_OSD_WIDTH; ++i) {
+			src[i] = (i * 7 ^ i >> 3) % colors[c];
+		}
+		// out of range indexes must give transparent black
+		src[BENCH_OSD_WIDTH / 2] = 255;
+
+		table = OsdIndexedTable(colors[c]);
+		printf("osd_indexed_%d_table=%d\n", colors[c], table);
+		printf("osd_indexed_%d_plain_mpx_s=%.1f\n", colors[c],
+			BenchOsdIndexedRun(ref, src, palette, NULL));
+		if (table) {
+			printf("osd_indexed_%d_simd_mpx_s=%.1f\n", colors[c],
+				BenchOsdIndexedRun(dst, src, palette,
+					(const uint8_t (*)[256])planes));
+		}
+
+		for (i = 0; i < BENCH_OSD_WIDTH - 1; ++i) {
+			OsdIndexedRow(dst, src + i, palette,
+				table ? (const uint8_t (*)[256])planes : NULL,
+				BENCH_OSD_WIDTH - i);
+			for (int x = 0; x < BENCH_OSD_WIDTH - i; x += 1 + (x & 63)) {
+				if (dst[x] != palette[src[i + x]]) {
+					errors++;
+				}
+			}
+		}
+	}
+	printf("osd_indexed_errors=%lld\n", errors);
+
+	return errors;
+}
+
+    /// synthetic osd layer stack
+struct bench_osd_stack
+{
+	const char *Name;		///< stack name
+	int Layers;			///< number of full screen layers
+	int Alpha;			///< pixmap alpha of the upper layers
+	int Holes;			///< upper layers are transparent every n pixel, 0 none
+};
+
+    /// known layer stacks
+static const struct bench_osd_stack BenchOsdStacks[] = {
+	{"menu", 3, 255, 2},		// background, text and icons
+	{"fade", 3, 128, 2},		// the same, fading
+	{"deep", 6, 200, 3},		// skins with many layers
+	{NULL, 0, 0, 0}
+};
+
+/**
+**	Composite one row of a layer stack, like cSoftOsd::Composite.
+*/
+static void BenchOsdCompositeRow(uint32_t * dst, uint32_t * row,
+	uint32_t * const *layers, const struct bench_osd_stack *stack, int y)
+{
+	memset(row, 0, BENCH_OSD_WIDTH * sizeof(*row));
+	for (int l = 0; l < stack->Layers; ++l) {
+		// layer 0 is copied, not blended
+		VideoOsdBlendRow(row, layers[l] + y * BENCH_OSD_WIDTH,
+			BENCH_OSD_WIDTH, l ? stack->Alpha : 255);
+	}
+	VideoOsdUnpremultiplyRow(dst, row, BENCH_OSD_WIDTH);
+}
+
+/**
+**	Composite a pixel of a layer stack in floating point.
+*/
+static void BenchOsdReference(double *c, uint32_t * const *layers,
+	const struct bench_osd_stack *stack, int pos)
+{
+	memset(c, 0, 4 * sizeof(*c));
+	for (int l = 0; l < stack->Layers; ++l) {
+		uint32_t s = layers[l][pos];
+		double a = (s >> 24) / 255.0 * (l ? stack->Alpha : 255) / 255.0;
+
+		for (int i = 0; i < 3; ++i) {
+			c[i] = ((s >> i * 8) & 0xFF) * a + c[i] * (1 - a);
+		}
+		c[3] = a + c[3] * (1 - a);
+	}
+	for (int i = 0; i < 3; ++i) {
+		c[i] = c[3] > 0 ? c[i] / c[3] : 0;
+	}
+	c[3] *= 255;
+}
+
+/**
+**	Benchmark the software osd composite with synthetic layer stacks.
+**
+**	Full screen layers are blended row by row and unpremultiplied into
+**	an ARGB buffer. Every stack is checked against a floating point
+**	composite, a channel may be off by 3.
+**
+**	@returns number of wrong pixels
+*/
+static long long BenchOsdComposite(void)
+{
+	const struct bench_osd_stack *stack;
+	uint32_t *layers[8];
+	uint32_t *row;
+	uint32_t *dst;
+	long long errors;
+	int pixels;
+
+	pixels = BENCH_OSD_WIDTH * BENCH_OSD_HEIGHT;
+	row = malloc(BENCH_OSD_WIDTH * sizeof(*row));
+	dst = malloc(pixels * sizeof(*dst));
+	errors = 0;
+	for (stack = BenchOsdStacks; stack->Name; ++stack) {
+		uint64_t start;
+		uint32_t state;
+
+		state = 1;
+		for (int l = 0; l < stack->Layers; ++l) {
+			layers[l] = malloc(pixels * sizeof(*layers[l]));
+			for (int i = 0; i < pixels; ++i) {
+				state = state * 1103515245 + 12345;
+				layers[l][i] = state >> 8;
+				if (!l) {
+					layers[l][i] |= 0xFF000000;
+				} else if (stack->Holes && !(i % stack->Holes)) {
+					layers[l][i] &= 0x00FFFFFF;
+				} else {
+					layers[l][i] |= (uint32_t)(state & 0x01) * 0xFF000000;
+				}
+			}
+		}
+
+		start = BenchTime();
+		for (int f = 0; f < BENCH_OSD_FRAMES; ++f) {
+			for (int y = 0; y < BENCH_OSD_HEIGHT; ++y) {
+				BenchOsdCompositeRow(dst + y * BENCH_OSD_WIDTH, row,
+					layers, stack, y);
+			}
+		}
+		printf("osd_composite_%s_ms=%.2f\n", stack->Name,
+			(BenchTime() - start) / 1e3 / BENCH_OSD_FRAMES);
+
+		for (int i = 0; i < pixels; i += 97) {
+			double c[4];
+
+			BenchOsdReference(c, layers, stack, i);
+			for (int ch = 3; ch >= 0; --ch) {
+				double v = (dst[i] >> (ch * 8)) & 0xFF;
+
+				// colors of almost transparent pixels are coarse
+				if (v - c[ch] > 3 || c[ch] - v > 3) {
+					errors++;
+					break;
+				}
+				if (c[3] < 128) {
+					break;
+				}
+			}
+		}
+		for (int l = 0; l < stack->Layers; ++l) {
+			free(layers[l]);
+		}
+	}
+	printf("osd_composite_errors=%lld\n", errors);
+
+	free(row);
+	free(dst);
+	return errors;
+}
+
+/**
+**	Benchmark the software audio filters.
+**
+**	Normalizer, compressor and software volume over 5.1 audio, like
+**	the audio thread with all filters enabled.
+*/
+static void BenchAudioFilter(void)
+{
+	int16_t *samples;
+	uint64_t start;
+	uint64_t time;
+	uint32_t state;
+	int count;
+	int i;
+
+	count = BENCH_AUDIO_CHANNELS * BENCH_AUDIO_FRAME;
+	samples = malloc(count * sizeof(*samples));
+	AudioSetSoftvol(1);
+	AudioSetVolume(800);
+	AudioSetNormalize(1, 4000);
+	AudioSetCompression(1, 4000);
+	AudioResetNormalizer();
+	AudioResetCompressor();
+
+	state = 1;
+	start = BenchTime();
+	for (i = 0; i < BENCH_AUDIO_FRAMES; ++i) {
+		for (int j = 0; j < count; ++j) {
+			state = state * 1103515245 + 12345;
+			samples[j] = (int16_t)(state >> 16) / 4;
+		}
+		AudioReorderAudioFrame(samples, count * 2, BENCH_AUDIO_CHANNELS);
+		AudioCompressor(samples, count * 2);
+		AudioNormalizer(samples, count * 2);
+		AudioSoftAmplifier(samples, count * 2);
+	}
+	time = BenchTime() - start;
+	printf("audio_filter_msamples_s=%.1f\n",
+		(double)count * BENCH_AUDIO_FRAMES / time);
+
+	free(samples);
+}
+
+/**
+**	Benchmark the copy of decoded NV12 frames into the dumb buffers.
+*/
+static void BenchNV12Copy(void)
+{
+	struct drm_buf buf;
+	AVFrame *frame;
+	uint64_t start;
+	uint64_t time;
+	int size;
+	int i;
+
+	frame = av_frame_alloc();
+	frame->width = BENCH_OSD_WIDTH;
+	frame->height = BENCH_OSD_HEIGHT;
+	// the decoders align the lines
+	frame->linesize[0] = frame->linesize[1] = (frame->width + 255) & ~255;
+	frame->data[0] = calloc(frame->linesize[0] * frame->height * 3 / 2, 1);
+	frame->data[1] = frame->data[0] + frame->linesize[0] * frame->height;
+
+	size = frame->width * frame->height;
+	memset(&buf, 0, sizeof(buf));
+	buf.plane[0] = calloc(size * 3 / 2, 1);
+	buf.plane[1] = buf.plane[0] + size;
+
+	start = BenchTime();
+	for (i = 0; i < BENCH_NV12_FRAMES; ++i) {
+		VideoCopyNV12(&buf, frame);
+	}
+	time = BenchTime() - start;
+	printf("nv12_copy_mb_s=%.1f\n", size * 3 / 2.0 * BENCH_NV12_FRAMES / time);
+
+	free(buf.plane[0]);
+	free(frame->data[0]);
+	av_frame_free(&frame);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//	Unit tests
+//////////////////////////////////////////////////////////////////////////////
+
+static int BenchTestFailures;		///< failed checks
+
+/**
+**	Check a unit test condition.
+**
+**	@param ok	condition is true
+**	@param cond	condition as text
+**	@param line	source line of the check
+*/
+static void BenchCheck(int ok, const char *cond, int line)
+{
+	if (!ok) {
+		fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, line, cond);
+		BenchTestFailures++;
+	}
+}
+
+    /// check a unit test condition
+#define BENCH_CHECK(cond) BenchCheck(!!(cond), #cond, __LINE__)
+
+/**
+**	Test the ring buffer wrap and fill level.
+*/
+static void BenchTestRingBuffer(void)
+{
+	RingBuffer *rb;
+	uint8_t in[1500];
+	uint8_t out[1500];
+	size_t total;
+	size_t n;
+	size_t i;
+
+	for (i = 0; i < sizeof(in); ++i) {
+		in[i] = i * 7;
+	}
+	rb = RingBufferNew(1000);
+	total = RingBufferFreeBytes(rb);
+	BENCH_CHECK(total >= 990 && total <= 1000);
+	BENCH_CHECK(!RingBufferUsedBytes(rb));
+
+	// a write larger than the buffer is cut
+	n = RingBufferWrite(rb, in, sizeof(in));
+	BENCH_CHECK(n == total);
+	BENCH_CHECK(!RingBufferFreeBytes(rb));
+	BENCH_CHECK(RingBufferRead(rb, out, 700) == 700);
+	BENCH_CHECK(!memcmp(out, in, 700));
+
+	// this write wraps around the end
+	BENCH_CHECK(RingBufferWrite(rb, in + n, 500) == 500);
+	BENCH_CHECK(RingBufferUsedBytes(rb) == n - 700 + 500);
+	BENCH_CHECK(RingBufferRead(rb, out, sizeof(out)) == n - 700 + 500);
+	BENCH_CHECK(!memcmp(out, in + 700, n - 700 + 500));
+	BENCH_CHECK(RingBufferFreeBytes(rb) == total);
+
+	RingBufferDel(rb);
+}
+
+/**
+**	Test the mpeg audio sync check.
+*/
+static void BenchTestMpegCheck(void)
+{
+	// mpeg 1 layer II 192 kbit/s 48 kHz, 576 byte frames
+	static const uint8_t mp2[4] = { 0xFF, 0xFD, 0xA4, 0x00 };
+	// mpeg 1 layer I 384 kbit/s 48 kHz, 384 byte frames
+	static const uint8_t mp1[4] = { 0xFF, 0xFF, 0xC4, 0x00 };
+	uint8_t data[1024];
+
+	memset(data, 0, sizeof(data));
+	memcpy(data, mp2, sizeof(mp2));
+	memcpy(data + 576, mp2, sizeof(mp2));
+	BENCH_CHECK(MpegCheck(data, 580) == 576);
+	BENCH_CHECK(MpegCheck(data, 100) == -580);
+	data[2] |= 0x02;			// padding
+	BENCH_CHECK(MpegCheck(data, 581) == 577);
+	data[2] = 0x04;				// free format, unsupported
+	BENCH_CHECK(MpegCheck(data, 580) == 0);
+
+	memcpy(data, mp1, sizeof(mp1));
+	BENCH_CHECK(MpegCheck(data, 388) == 384);
+	data[2] |= 0x02;			// layer I pads a slot of 4 bytes
+	BENCH_CHECK(MpegCheck(data, 392) == 388);
+}
+
+/**
+**	Test the AAC LATM sync check.
+*/
+static void BenchTestLatmCheck(void)
+{
+	uint8_t data[256];
+
+	memset(data, 0, sizeof(data));
+	// 197 bytes after the 3 byte header
+	data[0] = data[200] = 0x56;
+	data[1] = data[201] = 0xE0;
+	data[2] = 0xC5;
+	BENCH_CHECK(LatmCheck(data, 202) == 200);
+	BENCH_CHECK(LatmCheck(data, 100) == -202);
+	data[201] = 0x00;			// no frame follows
+	BENCH_CHECK(LatmCheck(data, 202) == 0);
+}
+
+/**
+**	Test the AC-3 and E-AC-3 sync check.
+*/
+static void BenchTestAc3Check(void)
+{
+	uint8_t data[2048];
+
+	memset(data, 0, sizeof(data));
+	// AC-3 48 kHz frame size code 28, 768 words
+	data[0] = data[1536] = 0x0B;
+	data[1] = data[1537] = 0x77;
+	data[4] = 0x1C;
+	data[5] = 8 << 3;			// bsid 8
+	BENCH_CHECK(Ac3Check(data, 1541) == 1536);
+	BENCH_CHECK(Ac3Check(data, 1000) == -1541);
+	BENCH_CHECK(Ac3Check(data, 4) == -5);
+	data[1537] = 0x00;			// no frame follows
+	BENCH_CHECK(Ac3Check(data, 1541) == 0);
+	data[1537] = 0x77;
+	data[4] = 0xDC;				// reserved sample rate
+	BENCH_CHECK(Ac3Check(data, 1541) == 0);
+	data[4] = 0x26;				// frame size code 38
+	BENCH_CHECK(Ac3Check(data, 1541) == 0);
+
+	// E-AC-3, 767 + 1 words
+	data[2] = 0x02;
+	data[3] = 0xFF;
+	data[4] = 0x3F;
+	data[5] = 16 << 3;			// bsid 16
+	BENCH_CHECK(Ac3Check(data, 1541) == 1536);
+	data[4] = 0xF0;				// reserved fscod and fscod2
+	BENCH_CHECK(Ac3Check(data, 1541) == 0);
+}
+
+/**
+**	Test the ADTS sync check.
+*/
+static void BenchTestAdtsCheck(void)
+{
+	// mpeg 4 AAC LC 48 kHz stereo, 400 byte frames
+	static const uint8_t adts[7] = { 0xFF, 0xF1, 0x4C, 0x80, 0x32, 0x1F, 0xFC };
+	uint8_t data[512];
+
+	memset(data, 0, sizeof(data));
+	memcpy(data, adts, sizeof(adts));
+	memcpy(data + 400, adts, sizeof(adts));
+	BENCH_CHECK(AdtsCheck(data, 403) == 400);
+	BENCH_CHECK(AdtsCheck(data, 100) == -403);
+	BENCH_CHECK(AdtsCheck(data, 5) == -6);
+	data[402] = 0x7C;			// sampling frequency index 15
+	BENCH_CHECK(AdtsCheck(data, 403) == 0);
+}
+
+    /// bit writer for synthetic H.264 sequence parameter sets
+struct bench_bits
+{
+	uint8_t *Data;			///< zeroed output
+	int Bit;			///< next bit
+};
+
+/**
+**	Write bits, msb first.
+*/
+static void BenchPutBits(struct bench_bits *bits, unsigned value, int n)
+{
+	while (n--) {
+		if (value >> n & 1) {
+			bits->Data[bits->Bit / 8] |= 0x80 >> bits->Bit % 8;
+		}
+		bits->Bit++;
+	}
+}
+
+/**
+**	Write an unsigned exp-Golomb code.
+*/
+static void BenchPutUe(struct bench_bits *bits, unsigned value)
+{
+	int n;
+
+	for (n = 0; (value + 1) >> (n + 1); ++n) {
+	}
+	BenchPutBits(bits, 0, n);
+	BenchPutBits(bits, value + 1, n + 1);
+}
+
+/**
+**	Build an H.264 sequence parameter set NAL unit.
+**
+**	@param data		zeroed output, 64 bytes
+**	@param profile		profile idc, 100 writes the high profile fields
+**	@param width_mbs	width in macroblocks
+**	@param height_units	height in map units
+**	@param frame_mbs_only	progressive
+**	@param crop_bottom	frame crop bottom offset
+**
+**	@returns size of the NAL unit with start code
+*/
+static int BenchSps(uint8_t * data, int profile, int width_mbs,
+	int height_units, int frame_mbs_only, int crop_bottom)
+{
+	struct bench_bits bits;
+
+	data[3] = 0x01;
+	data[4] = 0x67;
+	bits.Data = data + 5;
+	bits.Bit = 0;
+	BenchPutBits(&bits, profile, 8);
+	BenchPutBits(&bits, 40, 16);		// constraint flags, level 4.0
+	BenchPutUe(&bits, 0);			// seq_parameter_set_id
+	if (profile == 100) {
+		BenchPutUe(&bits, 1);		// chroma_format_idc 4:2:0
+		BenchPutUe(&bits, 0);		// bit_depth_luma_minus8
+		BenchPutUe(&bits, 0);		// bit_depth_chroma_minus8
+		BenchPutBits(&bits, 0, 2);	// no bypass, no scaling matrix
+	}
+	BenchPutUe(&bits, 0);			// log2_max_frame_num_minus4
+	BenchPutUe(&bits, 0);			// pic_order_cnt_type
+	BenchPutUe(&bits, 2);			// log2_max_pic_order_cnt_lsb_minus4
+	BenchPutUe(&bits, 4);			// max_num_ref_frames
+	BenchPutBits(&bits, 0, 1);		// gaps_in_frame_num_allowed
+	BenchPutUe(&bits, width_mbs - 1);
+	BenchPutUe(&bits, height_units - 1);
+	BenchPutBits(&bits, frame_mbs_only, 1);
+	if (!frame_mbs_only) {
+		BenchPutBits(&bits, 1, 1);	// mb_adaptive_frame_field
+	}
+	BenchPutBits(&bits, 1, 1);		// direct_8x8_inference
+	BenchPutBits(&bits, crop_bottom != 0, 1);
+	if (crop_bottom) {
+		BenchPutUe(&bits, 0);
+		BenchPutUe(&bits, 0);
+		BenchPutUe(&bits, 0);
+		BenchPutUe(&bits, crop_bottom);
+	}
+	BenchPutBits(&bits, 0, 1);		// no vui
+	BenchPutBits(&bits, 1, 1);		// stop bit
+	return 5 + (bits.Bit + 7) / 8;
+}
+
+/**
+**	Test the resolution parser of the H.264 sequence parameter set.
+*/
+static void BenchTestParseSps(void)
+{
+	uint8_t data[64];
+	int width;
+	int height;
+	int size;
+
+	// 1080p high profile, 1088 lines cropped by 8
+	memset(data, 0, sizeof(data));
+	size = BenchSps(data, 100, 120, 68, 1, 4);
+	BENCH_CHECK(!ParseSpsH264(data, size, &width, &height));
+	BENCH_CHECK(width == 1920 && height == 1080);
+
+	// 1080i main profile, 2 fields of 34 map units cropped by 8
+	memset(data, 0, sizeof(data));
+	size = BenchSps(data, 77, 120, 34, 0, 2);
+	BENCH_CHECK(!ParseSpsH264(data, size, &width, &height));
+	BENCH_CHECK(width == 1920 && height == 1080);
+
+	// 576i baseline profile, uncropped
+	memset(data, 0, sizeof(data));
+	size = BenchSps(data, 66, 45, 18, 0, 0);
+	BENCH_CHECK(!ParseSpsH264(data, size, &width, &height));
+	BENCH_CHECK(width == 720 && height == 576);
+
+	// a picture parameter set only
+	data[4] = 0x68;
+	BENCH_CHECK(ParseSpsH264(data, size, &width, &height) == -1);
+}
+
+/**
+**	Test the channel reorder from ffmpeg to alsa.
+*/
+static void BenchTestReorder(void)
+{
+	static const int16_t ch5[10] = { 1, 2, 4, 5, 3, 11, 12, 14, 15, 13 };
+	static const int16_t ch6[6] = { 1, 2, 4, 3, 5, 6 };
+	static const int16_t ch8[8] = { 1, 2, 5, 6, 3, 4, 7, 8 };
+	int16_t buf[10];
+	int i;
+
+	// L R C Ls Rs -> L R Ls Rs C
+	for (i = 0; i < 10; ++i) {
+		buf[i] = i % 5 + 1 + i / 5 * 10;
+	}
+	AudioReorderAudioFrame(buf, sizeof(buf), 5);
+	BENCH_CHECK(!memcmp(buf, ch5, sizeof(ch5)));
+
+	// L R C LFE Ls Rs -> L R LFE C Ls Rs
+	for (i = 0; i < 6; ++i) {
+		buf[i] = i + 1;
+	}
+	AudioReorderAudioFrame(buf, 6 * 2, 6);
+	BENCH_CHECK(!memcmp(buf, ch6, sizeof(ch6)));
+
+	// L R C LFE Ls Rs Rl Rr -> L R Ls Rs C LFE Rl Rr
+	for (i = 0; i < 8; ++i) {
+		buf[i] = i + 1;
+	}
+	AudioReorderAudioFrame(buf, 8 * 2, 8);
+	BENCH_CHECK(!memcmp(buf, ch8, sizeof(ch8)));
+
+	// stereo is untouched
+	AudioReorderAudioFrame(buf, 8 * 2, 2);
+	BENCH_CHECK(!memcmp(buf, ch8, sizeof(ch8)));
+}
+
+/**
+**	Test the software volume.
+*/
+static void BenchTestSoftAmplifier(void)
+{
+	static const int16_t half[4] = { 500, -500, 16383, -16384 };
+	int16_t samples[4] = { 1000, -1000, INT16_MAX, INT16_MIN };
+
+	AudioSetSoftvol(1);
+	AudioSetVolume(500);
+	AudioSoftAmplifier(samples, sizeof(samples));
+	BENCH_CHECK(!memcmp(samples, half, sizeof(half)));
+
+	AudioSetVolume(0);			// mute
+	AudioSoftAmplifier(samples, sizeof(samples));
+	BENCH_CHECK(!samples[0] && !samples[1] && !samples[2] && !samples[3]);
+	AudioSetVolume(1000);
+}
+
+/**
+**	Test the volume compressor.
+*/
+static void BenchTestCompressor(void)
+{
+	static const int16_t quiet[4] = { 16000, -8000, 200, 0 };
+	static const int16_t loud[4] = { 32760, -32760, 16380, 0 };
+	int16_t samples[4];
+
+	AudioSetCompression(1, 2000);
+
+	// quiet audio is raised by the max. factor
+	AudioResetCompressor();
+	samples[0] = 8000;
+	samples[1] = -4000;
+	samples[2] = 100;
+	samples[3] = 0;
+	AudioCompressor(samples, sizeof(samples));
+	BENCH_CHECK(!memcmp(samples, quiet, sizeof(quiet)));
+
+	// loud audio is raised without clipping
+	AudioResetCompressor();
+	samples[0] = 30000;
+	samples[1] = -30000;
+	samples[2] = 15000;
+	samples[3] = 0;
+	AudioCompressor(samples, sizeof(samples));
+	BENCH_CHECK(!memcmp(samples, loud, sizeof(loud)));
+
+	// silence stays silent
+	memset(samples, 0, sizeof(samples));
+	AudioCompressor(samples, sizeof(samples));
+	BENCH_CHECK(!samples[0] && !samples[1] && !samples[2] && !samples[3]);
+}
+
+/**
+**	Normalize a square wave until the factor settles.
+**
+**	@param amplitude	input amplitude
+**
+**	@returns output amplitude
+*/
+static int BenchNormalize(int amplitude)
+{
+	int16_t samples[BENCH_NORM_BLOCK];
+
+	AudioResetNormalizer();
+	for (int b = 0; b < BENCH_NORM_BLOCKS; ++b) {
+		for (int i = 0; i < BENCH_NORM_BLOCK; ++i) {
+			samples[i] = i & 1 ? amplitude : -amplitude;
+		}
+		AudioNormalizer(samples, sizeof(samples));
+	}
+	return samples[1];
+}
+
+/**
+**	Test the volume normalizer.
+**
+**	The normalizer aims at a rms of 1/8 of the full scale.
+*/
+static void BenchTestNormalizer(void)
+{
+	int out;
+
+	AudioSetNormalize(1, 8000);
+	out = BenchNormalize(1000);
+	BENCH_CHECK(out > INT16_MAX / 8 * 98 / 100 && out < INT16_MAX / 8 * 102 / 100);
+	out = BenchNormalize(16000);
+	BENCH_CHECK(out > INT16_MAX / 8 * 98 / 100 && out < INT16_MAX / 8 * 102 / 100);
+
+	// limited by the max. factor
+	AudioSetNormalize(1, 2000);
+	out = BenchNormalize(1000);
+	BENCH_CHECK(out == 2000);
+}
+
+/**
+**	Test the NV12 copy from padded decoder lines.
+*/
+static void BenchTestNV12Copy(void)
+{
+	struct drm_buf buf;
+	AVFrame *frame;
+	int width;
+	int height;
+	int errors;
+
+	width = 66;
+	height = 34;
+	frame = av_frame_alloc();
+	frame->width = width;
+	frame->height = height;
+	frame->linesize[0] = 80;
+	frame->linesize[1] = 96;
+	frame->data[0] = malloc(frame->linesize[0] * height);
+	frame->data[1] = malloc(frame->linesize[1] * height / 2);
+	for (int i = 0; i < frame->linesize[0] * height; ++i) {
+		frame->data[0][i] = i % frame->linesize[0] < width ? i * 13 : 0xEE;
+	}
+	for (int i = 0; i < frame->linesize[1] * height / 2; ++i) {
+		frame->data[1][i] = i % frame->linesize[1] < width ? i * 17 : 0xEE;
+	}
+
+	memset(&buf, 0, sizeof(buf));
+	buf.plane[0] = malloc(width * height * 3 / 2);
+	buf.plane[1] = buf.plane[0] + width * height;
+	VideoCopyNV12(&buf, frame);
+
+	errors = 0;
+	for (int y = 0; y < height; ++y) {
+		for (int x = 0; x < width; ++x) {
+			errors += buf.plane[0][y * width + x]
+				!= frame->data[0][y * frame->linesize[0] + x];
+			if (y < height / 2) {
+				errors += buf.plane[1][y * width + x]
+					!= frame->data[1][y * frame->linesize[1] + x];
+			}
+		}
+	}
+	BENCH_CHECK(!errors);
+
+	free(buf.plane[0]);
+	free(frame->data[0]);
+	free(frame->data[1]);
+	av_frame_free(&frame);
+}
+
+    /// unit test
+struct bench_test
+{
+	const char *Name;		///< test name
+	void (*Test)(void);		///< test function
+};
+
+    /// all unit tests
+static const struct bench_test BenchTests[] = {
+	{"ringbuffer", BenchTestRingBuffer},
+	{"mpeg_check", BenchTestMpegCheck},
+	{"latm_check", BenchTestLatmCheck},
+	{"ac3_check", BenchTestAc3Check},
+	{"adts_check", BenchTestAdtsCheck},
+	{"parse_sps_h264", BenchTestParseSps},
+	{"audio_reorder", BenchTestReorder},
+	{"audio_soft_amplifier", BenchTestSoftAmplifier},
+	{"audio_compressor", BenchTestCompressor},
+	{"audio_normalizer", BenchTestNormalizer},
+	{"nv12_copy", BenchTestNV12Copy},
+	{NULL, NULL}
+};
+
+/**
+**	Run the unit tests.
+**
+**	@returns number of failed tests
+*/
+static int BenchUnitTests(void)
+{
+	const struct bench_test *test;
+	int failed;
+
+	failed = 0;
+	for (test = BenchTests; test->Name; ++test) {
+		int failures;
+
+		failures = BenchTestFailures;
+		test->Test();
+		printf("test_%s=%s\n", test->Name,
+			failures == BenchTestFailures ? "ok" : "failed");
+		failed += failures != BenchTestFailures;
+	}
+	printf("tests_failed=%d\n", failed);
+	return failed;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//	A/V sync scenarios
+//////////////////////////////////////////////////////////////////////////////
+
+    /// a/v sync scenario
+struct bench_sync
+{
+	const char *Name;		///< scenario name
+	int DriftPpm;			///< audio clock faster than video
+	int JitterMs;			///< max display thread wakeup latency
+	int ZapAtMs;			///< stream position of a pts jump, 0 none
+	int ZapMs;			///< size of the pts jump
+	int StallAtMs;			///< time the audio feed stalls, 0 none
+	int StallMs;			///< length of the stall
+	int AudioDelayMs;		///< audio/video delay, like the setup
+};
+
+    /// known scenarios
+static const struct bench_sync BenchSyncScenarios[] = {
+	{"steady", 0, 0, 0, 0, 0, 0, 0},
+	{"drift", 2000, 0, 0, 0, 0, 0, 0},
+	{"jitter", 0, 8, 0, 0, 0, 0, 0},
+	{"zap", 0, 0, 20000, 6000, 0, 0, 0},
+	{"underrun", 0, 0, 0, 0, 20000, 500, 0},
+	{"delay", 0, 0, 0, 0, 0, 0, 200},
+	{NULL, 0, 0, 0, 0, 0, 0, 0}
+};
+
+    /// virtual alsa device and audio feed of a scenario
+struct bench_sync_audio
+{
+	const struct bench_sync *Sync;	///< running scenario
+	uint64_t Start;			///< simulated start time in us
+	uint64_t Last;			///< time of the last update in us
+	double Phase;			///< part of a frame played
+	long Delay;			///< frames in the virtual alsa buffer
+	int64_t Written;		///< frames decoded, stream position
+	int Underrun;			///< alsa buffer ran empty
+	int Underruns;			///< underruns counted
+};
+
+    /// video decoder of a scenario
+struct bench_sync_video
+{
+	const struct bench_sync *Sync;	///< running scenario
+	VideoRender *Render;		///< null display render
+	AVFrame *Image;			///< decoded picture of all frames
+	int Frames;			///< frames decoded, stream position
+};
+
+static struct bench_sync_audio BenchSyncAudio;	///< virtual alsa
+static AVRational BenchSyncTimebase = { 1, 90000 };	///< mpeg ts time base
+
+/**
+**	Deterministic pseudo random numbers for the scenarios.
+**
+**	@param state	generator state
+**	@param max	result is in -max .. max
+*/
+static int BenchSyncRandom(uint32_t * state, int max)
+{
+	*state = *state * 1664525 + 1013904223;
+	return max ? (int)(*state >> 8) % (2 * max + 1) - max : 0;
+}
+
+/**
+**	Get the pts of a stream position, with the pts jump of the scenario.
+**
+**	@param sync	scenario
+**	@param ms	stream position in ms
+*/
+static int64_t BenchSyncPts(const struct bench_sync *sync, int64_t ms)
+{
+	if (sync->ZapAtMs && ms >= sync->ZapAtMs) {
+		ms += sync->ZapMs;
+	}
+	return ms * 90;
+}
+
+/**
+**	Run the virtual alsa device and the audio feed up to now.
+**
+**	Once the audio is started, the device plays with the drift of the
+**	scenario and is refilled from the audio ring buffer, like the alsa
+**	play thread does. The feed keeps SYNC_AUDIO_BUFFER_MS decoded,
+**	except during a stall, and sets the audio pts like the decoder.
+*/
+static void BenchSyncAudioUpdate(void)
+{
+	static const uint8_t silence[SYNC_AUDIO_CHUNK * SYNC_CHANNELS * 2];
+	struct bench_sync_audio *audio;
+	const struct bench_sync *sync;
+	uint64_t now;
+	long frames;
+	long buffered;
+	int ms;
+
+	audio = &BenchSyncAudio;
+	sync = audio->Sync;
+	now = ClockGetTime();
+	ms = (now - audio->Start) / 1000;
+
+	// alsa consumer
+	if (AudioRunning) {
+		audio->Phase += (now - audio->Last) * SYNC_SAMPLE_RATE / 1e6 *
+			(1e6 + sync->DriftPpm) / 1e6;
+		frames = audio->Phase;
+		audio->Phase -= frames;
+		if (frames > audio->Delay) {
+			if (!audio->Underrun) {
+				audio->Underruns++;
+			}
+			audio->Underrun = 1;
+			frames = audio->Delay;
+		}
+		audio->Delay -= frames;
+
+		// alsa play thread
+		buffered = RingBufferUsedBytes(AudioRingBuffer) / SYNC_CHANNELS / 2;
+		frames = SYNC_ALSA_BUFFER_MS * SYNC_SAMPLE_RATE / 1000 - audio->Delay;
+		if (frames > buffered) {
+			frames = buffered;
+		}
+		if (frames > 0) {
+			RingBufferReadAdvance(AudioRingBuffer, frames * SYNC_CHANNELS * 2);
+			audio->Delay += frames;
+			audio->Underrun = 0;
+		}
+	}
+	audio->Last = now;
+
+	// audio decoder
+	if (sync->StallAtMs && ms >= sync->StallAtMs
+		&& ms < sync->StallAtMs + sync->StallMs) {
+		return;
+	}
+	while (RingBufferUsedBytes(AudioRingBuffer) / SYNC_CHANNELS / 2 +
+		audio->Delay < SYNC_AUDIO_BUFFER_MS * SYNC_SAMPLE_RATE / 1000) {
+		RingBufferWrite(AudioRingBuffer, silence, sizeof(silence));
+		audio->Written += SYNC_AUDIO_CHUNK;
+		PTS = BenchSyncPts(sync, audio->Written * 1000 / SYNC_SAMPLE_RATE);
+	}
+}
+
+/**
+**	Get the delay of the virtual alsa device.
+**
+**	Called by AudioGetClock() instead of snd_pcm_delay().
+**
+**	@returns delay in frames
+*/
+static long BenchSyncDelay(void)
+{
+	BenchSyncAudioUpdate();
+	return BenchSyncAudio.Delay;
+}
+
+/**
+**	Video decoder thread of a scenario.
+**
+**	Keeps the display queue filled, until the render is closed.
+**
+**	@param arg	struct bench_sync_video
+*/
+static void *BenchSyncDecoder(void *arg)
+{
+	struct bench_sync_video *video;
+	AVFrame *frame;
+
+	video = arg;
+	while (!video->Render->Closing) {
+		frame = av_frame_clone(video->Image);
+		frame->pts = BenchSyncPts(video->Sync, video->Frames++ *
+			SYNC_FRAME_MS);
+		EnqueueFB(video->Render, frame);
+	}
+	return NULL;
+}
+
+/**
+**	Replay an a/v sync scenario in stepped time.
+**
+**	The display is driven through the real display path, Frame2Display()
+**	decides with the audio clock of the virtual alsa device. A frame
+**	dup sleeps and reads the clock again, like on a device. The clock
+**	only moves with the sleeps of the display path, the decoder thread
+**	just refills the display queue. So the results are deterministic.
+**
+**	@param render	null display render
+**	@param image	decoded picture of all frames
+**	@param sync	scenario
+*/
+static void BenchSyncRun(VideoRender * render, AVFrame * image,
+	const struct bench_sync *sync)
+{
+	struct bench_sync_video video;
+	pthread_t decoder;
+	uint32_t random;
+	uint64_t start;
+	int64_t offset_sum;
+	int max_offset;
+	int shown;
+	int diff;
+
+	random = 0x5eed;
+	offset_sum = 0;
+	max_offset = 0;
+	shown = 0;
+
+	// stream start, like after a channel switch
+	VideoAudioDelay = sync->AudioDelayMs;
+	render->timebase = &BenchSyncTimebase;
+	render->StartCounter = 0;
+	render->FramesDropped = 0;
+	render->FramesDuped = 0;
+	AudioRunning = 0;
+	PTS = AV_NOPTS_VALUE;
+	RingBufferReset(AudioRingBuffer);
+
+	// start on a vblank, independent of the real clock
+	ClockSimulate(CLOCK_STEPPED);
+	ClockAdvance(1000000 - ClockGetTime() % 1000000);
+	start = ClockGetTime();
+	memset(&BenchSyncAudio, 0, sizeof(BenchSyncAudio));
+	BenchSyncAudio.Sync = sync;
+	BenchSyncAudio.Start = start;
+	BenchSyncAudio.Last = start;
+	BenchSyncAudioUpdate();
+
+	video.Sync = sync;
+	video.Render = render;
+	video.Image = image;
+	video.Frames = 0;
+	pthread_create(&decoder, NULL, BenchSyncDecoder, &video);
+	while (atomic_read(&render->FramesFilled) < VIDEO_SURFACES_MAX) {
+		sched_yield();
+	}
+
+	while (ClockGetTime() - start < SYNC_DURATION_MS * 1000ULL) {
+		// display thread wakes up late
+		ClockAdvance(abs(BenchSyncRandom(&random, sync->JitterMs)) * 1000);
+		BenchSyncAudioUpdate();
+
+		VideoDisplayVblank(render);
+		shown++;
+
+		diff = abs(render->AvOffset);
+		if (diff <= VIDEO_SYNC_JUMP_MS) {
+			offset_sum += diff;
+			if (diff > max_offset) {
+				max_offset = diff;
+			}
+		}
+	}
+
+	// stop the decoder and drop the queued frames
+	render->Closing = 1;
+	VideoIdleWakeup();
+	pthread_join(decoder, NULL);
+	render->Closing = 0;
+	while (atomic_read(&render->FramesFilled)) {
+		av_frame_free(&render->FramesRb[render->FramesRead]);
+		render->FramesRead = (render->FramesRead + 1) % VIDEO_SURFACES_MAX;
+		atomic_dec(&render->FramesFilled);
+	}
+	ClockSimulate(CLOCK_REAL);
+
+	printf("sync_%s_shown=%d\n", sync->Name, shown);
+	printf("sync_%s_dropped=%d\n", sync->Name, render->FramesDropped);
+	printf("sync_%s_duped=%d\n", sync->Name, render->FramesDuped);
+	printf("sync_%s_underruns=%d\n", sync->Name, BenchSyncAudio.Underruns);
+	printf("sync_%s_glitches=%d\n", sync->Name, render->FramesDropped +
+		render->FramesDuped + BenchSyncAudio.Underruns);
+	printf("sync_%s_max_offset_ms=%d\n", sync->Name, max_offset);
+	printf("sync_%s_mean_offset_ms=%.1f\n", sync->Name,
+		shown ? offset_sum / (double)shown : 0.0);
+}
+
+/**
+**	Replay one or all a/v sync scenarios.
+**
+**	The display is the null display, the alsa device is virtual.
+**
+**	@param name	scenario name or "all"
+**
+**	@returns 0 ok, -1 unknown scenario
+*/
+static int BenchSync(const char *name)
+{
+	const struct bench_sync *sync;
+	VideoRender *render;
+	AVFrame *image;
+	int found;
+
+	VideoSetNullDisplay(1);
+	render = VideoNewRender(NULL);
+	VideoSetupDisplay(render);
+
+	image = av_frame_alloc();
+	image->format = AV_PIX_FMT_NV12;
+	image->width = SYNC_FRAME_SIZE;
+	image->height = SYNC_FRAME_SIZE;
+	av_frame_get_buffer(image, 0);
+	memset(image->data[0], 0x10, image->linesize[0] * SYNC_FRAME_SIZE);
+	memset(image->data[1], 0x80, image->linesize[1] * SYNC_FRAME_SIZE / 2);
+
+	HwSampleRate = SYNC_SAMPLE_RATE;
+	HwChannels = SYNC_CHANNELS;
+	timebase = &BenchSyncTimebase;
+	AudioRingBuffer = RingBufferNew(SYNC_SAMPLE_RATE * SYNC_CHANNELS * 2);
+	AlsaVirtualDelay = BenchSyncDelay;
+
+	found = 0;
+	for (sync = BenchSyncScenarios; sync->Name; ++sync) {
+		if (!strcmp(name, "all") || !strcmp(name, sync->Name)) {
+			BenchSyncRun(render, image, sync);
+			found = 1;
+		}
+	}
+
+	AlsaVirtualDelay = NULL;
+	RingBufferDel(AudioRingBuffer);
+	AudioRingBuffer = NULL;
+	av_frame_free(&image);
+	return found ? 0 : -1;
+}
+
+/**
+**	Print the usage.
+*/
+static void BenchUsage(const char *name)
+{
+	fprintf(stderr, "Usage: %s [-r] [-n] [-a device] [-d display]"
+		" [-t trace.json] [-v] [-l categories] file.ts|file.pes\n"
+		"       %s -m\n"
+		"       %s -u\n"
+		"       %s -s steady|drift|jitter|zap|underrun|delay|all\n"
+		"\t-r\tfeed in real time instead of as fast as the buffers allow\n"
+		"\t-n\tnull display, no DRM device needed\n"
+		"\t-a\talsa pcm device (default: null)\n"
+		"\t-d\tdisplay resolution, like the plugin -d option\n"
+		"\t-t\twrite the pipeline trace as chrome trace json\n"
+		"\t-v\tmore log messages, repeat for more\n"
+		"\t-l\tenable debug log categories, like SVDRP LOG\n"
+		"\t-m\trun the micro benchmarks\n"
+		"\t-u\trun the unit tests\n"
+		"\t-s\treplay a/v sync scenarios in stepped time\n",
+		name, name, name, name);
+}
+
+/**
+**	Headless pipeline runner.
+*/
+int main(int argc, char *argv[])
+{
+	struct bench_stream video = { -1, 0, 0, 0, NULL };
+	struct bench_stream audio = { -1, 0, 0, 0, NULL };
+	const char *device;
+	const char *trace;
+	const uint8_t *data;
+	struct rusage usage_start;
+	struct rusage usage;
+	struct stat st;
+	uint64_t start;
+	uint64_t wall;
+	double user;
+	double sys;
+	int duped;
+	int dropped;
+	int frames;
+	int fd;
+	int i;
+
+	device = "null";
+	trace = NULL;
+	while ((i = getopt(argc, argv, "rna:d:t:vl:mus:")) != -1) {
+		switch (i) {
+		case 'm':
+			i = BenchRingBuffer() != 0;
+			i |= BenchOsdIndexed() != 0;
+			i |= BenchOsdComposite() != 0;
+			BenchAudioFilter();
+			BenchNV12Copy();
+			return i;
+		case 'u':
+			return BenchUnitTests() != 0;
+		case 's':
+			if (BenchSync(optarg)) {
+				fprintf(stderr, "unknown sync scenario '%s'\n", optarg);
+				return 1;
+			}
+			return 0;
+		case 'r':
+			BenchRealTime = 1;
+			break;
+		case 'n':
+			VideoSetNullDisplay(1);
+			break;
+		case 'a':
+			device = optarg;
+			break;
+		case 'd':
+			VideoSetDisplay(optarg);
+			break;
+		case 't':
+			trace = optarg;
+			break;
+		case 'v':
+			SysLogLevel++;
+			break;
+		case 'l':
+			if (LogSetCategories(optarg) < 0) {
+				fprintf(stderr, "unknown log category in '%s'\n", optarg);
+				return 1;
+			}
+			break;
+		default:
+			BenchUsage(argv[0]);
+			return 1;
+		}
+	}
+	if (optind + 1 != argc) {
+		BenchUsage(argv[0]);
+		return 1;
+	}
+
+	if ((fd = open(argv[optind], O_RDONLY)) < 0 || fstat(fd, &st)) {
+		perror(argv[optind]);
+		return 1;
+	}
+	if (!st.st_size) {
+		fprintf(stderr, "%s: empty file\n", argv[optind]);
+		return 1;
+	}
+	data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (data == MAP_FAILED) {
+		perror(argv[optind]);
+		return 1;
+	}
+	madvise((void *)data, st.st_size, MADV_SEQUENTIAL);
+	if (!(video.Data = malloc(PES_MAX_SIZE)) || !(audio.Data = malloc(PES_MAX_SIZE))) {
+		perror("malloc");
+		return 1;
+	}
+
+	openlog("softhddev-bench", LOG_PERROR | LOG_PID, LOG_USER);
+	signal(SIGINT, BenchSignal);
+	LogStart();
+
+	AudioSetDevice(device);
+	Start();
+	SetPlayMode(1);
+	Play();
+
+	TraceStart();
+	getrusage(RUSAGE_SELF, &usage_start);
+	start = BenchTime();
+
+	if (data[0] == 0x47 && (st.st_size < 2 * TS_PACKET_SIZE
+			|| data[TS_PACKET_SIZE] == 0x47)) {
+		BenchPlayTs(data, st.st_size, &video, &audio);
+	} else {
+		BenchPlayPes(data, st.st_size, &video, &audio);
+	}
+
+	// let the pipeline drain, at most 10s
+	for (i = 0; i < 1000 && !BenchInterrupted; ++i) {
+		if (!VideoGetPackets() && !AudioUsedBytes()) {
+			break;
+		}
+		usleep(10000);
+	}
+
+	wall = BenchTime() - start;
+	GetStats(&duped, &dropped, &frames);
+	TraceStop(trace);
+	getrusage(RUSAGE_SELF, &usage);
+	user = usage.ru_utime.tv_sec - usage_start.ru_utime.tv_sec +
+		(usage.ru_utime.tv_usec - usage_start.ru_utime.tv_usec) / 1e6;
+	sys = usage.ru_stime.tv_sec - usage_start.ru_stime.tv_sec +
+		(usage.ru_stime.tv_usec - usage_start.ru_stime.tv_usec) / 1e6;
+
+	SetPlayMode(0);
+
+	printf("file=%s\n", argv[optind]);
+	printf("mode=%s\n", BenchRealTime ? "realtime" : "fast");
+	printf("interrupted=%d\n", BenchInterrupted ? 1 : 0);
+	printf("wall_s=%.3f\n", wall / 1e6);
+	printf("bytes=%llu\n", (unsigned long long)BenchBytes);
+	printf("throughput_mbit_s=%.3f\n", wall ? BenchBytes * 8.0 / wall : 0.0);
+	printf("video_pes=%d\n", video.Packets);
+	printf("audio_pes=%d\n", audio.Packets);
+	printf("frames=%d\n", frames);
+	printf("frames_duped=%d\n", duped);
+	printf("frames_dropped=%d\n", dropped);
+	printf("cpu_user_s=%.3f\n", user);
+	printf("cpu_sys_s=%.3f\n", sys);
+	printf("cpu_percent=%.1f\n", wall ? (user + sys) * 1e8 / wall : 0.0);
+	TraceLatencies(stdout);
+
+	SoftHdDeviceExit();
+	LogStop();
+
+	munmap((void *)data, st.st_size);
+	close(fd);
+	free(video.Data);
+	free(audio.Data);
+
+	return 0;
+}
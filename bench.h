@@ -0,0 +1,132 @@
+///
+///	@file bench.h	@brief Headless runner hooks header file
+///
+///	Copyright (c) 2020 by zille.  All Rights Reserved.
+///
+///	Contributor(s):
+///
+///	License: AGPLv3
+///
+///	This program is free software: you can redistribute it and/or modify
+///	it under the terms of the GNU Affero General Public License as
+///	published by the Free Software Foundation, either version 3 of the
+///	License.
+///
+///	This program is distributed in the hope that it will be useful,
+///	but WITHOUT ANY WARRANTY; without even the implied warranty of
+///	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+///	GNU Affero General Public License for more details.
+///
+///	$Id$
+//////////////////////////////////////////////////////////////////////////////
+
+/// @addtogroup Bench
+/// @{
+
+#ifndef __BENCH_H
+#define __BENCH_H
+
+#include <stdint.h>
+
+//----------------------------------------------------------------------------
+//	Defines
+//----------------------------------------------------------------------------
+
+#ifdef BENCH
+    /// module internal, but reachable by the headless runner
+#define BENCH_STATIC
+#else
+    /// module internal
+#define BENCH_STATIC static
+#endif
+
+//----------------------------------------------------------------------------
+//	Prototypes
+//----------------------------------------------------------------------------
+
+#ifdef BENCH
+
+struct drm_buf;
+struct AVFrame;
+struct AVRational;
+struct _Drm_Render_;
+struct _ring_buffer_;
+
+    /// palette size the osd vector table lookup handles
+extern int OsdIndexedTable(int);
+
+    /// convert a row of osd palette indexes to ARGB
+extern void OsdIndexedRow(uint32_t *, const uint8_t *, const uint32_t *,
+    const uint8_t[4][256], int);
+
+    /// copy a NV12 frame into a dumb buffer
+extern void VideoCopyNV12(struct drm_buf *, const struct AVFrame *);
+
+    /// queue a decoded frame for the display thread
+extern void EnqueueFB(struct _Drm_Render_ *, struct AVFrame *);
+
+    /// set up the display, without the display thread
+extern void VideoSetupDisplay(struct _Drm_Render_ *);
+
+    /// display the next frame and wait for its vblank
+extern int VideoDisplayVblank(struct _Drm_Render_ *);
+
+    /// check for Mpeg audio
+extern int MpegCheck(const uint8_t *, int);
+
+    /// check for AAC LATM audio
+extern int LatmCheck(const uint8_t *, int);
+
+    /// check for (E-)AC-3 audio
+extern int Ac3Check(const uint8_t *, int);
+
+    /// check for ADTS audio
+extern int AdtsCheck(const uint8_t *, int);
+
+    /// parse the resolution from the H.264 sequence parameter set
+extern int ParseSpsH264(const uint8_t *, int, int *, int *);
+
+    /// reorder the channels of an audio frame for alsa
+extern void AudioReorderAudioFrame(int16_t *, int, int);
+
+    /// normalize the audio volume
+extern void AudioNormalizer(int16_t *, int);
+
+    /// reset the audio normalizer
+extern void AudioResetNormalizer(void);
+
+    /// compress the audio volume
+extern void AudioCompressor(int16_t *, int);
+
+    /// reset the audio compressor
+extern void AudioResetCompressor(void);
+
+    /// apply the software volume
+extern void AudioSoftAmplifier(int16_t *, int);
+
+    /// audio output started
+extern volatile char AudioRunning;
+
+    /// virtual pcm delay in frames, replaces the alsa device if set
+extern long (*AlsaVirtualDelay)(void);
+
+    /// audio hardware sample rate in Hz
+extern unsigned int HwSampleRate;
+
+    /// audio hardware channels
+extern unsigned int HwChannels;
+
+    /// time base of the audio pts
+extern struct AVRational *timebase;
+
+    /// audio pts after the last decoded sample
+extern int64_t PTS;
+
+    /// decoded audio waiting for alsa
+extern struct _ring_buffer_ *AudioRingBuffer;
+
+#endif
+
+#endif
+
+/// @}
@@ -48,6 +48,7 @@
 #include "audio.h"
 #include "codec.h"
 #include "softhddev.h"
+#include "trace.h"
 
 
 //----------------------------------------------------------------------------
@@ -233,11 +234,11 @@ void CodecVideoOpen(VideoDecoder * decoder, int codec_id, AVCodecParameters * Pa
 void CodecVideoClose(VideoDecoder * decoder)
 {
 	Debug2(L_CODEC, "CodecVideoClose: VideoCtx %p", decoder->VideoCtx);
-	pthread_mutex_lock(&CodecLockMutex);
+	TraceMutexLock(CodecLockMutex);
 	if (decoder->VideoCtx) {
 		avcodec_free_context(&decoder->VideoCtx);
 	}
-	pthread_mutex_unlock(&CodecLockMutex);
+	TraceMutexUnlock(CodecLockMutex);
 }
 
 /**
@@ -251,6 +252,7 @@ void CodecVideoClose(VideoDecoder * decoder)
 int CodecVideoSendPacket(VideoDecoder * decoder, const AVPacket * avpkt)
 {
 	int ret = AVERROR_DECODER_NOT_FOUND;
+	uint64_t start;
 
 #if 0
 	if (!decoder->VideoCtx->extradata_size) {
@@ -294,11 +296,14 @@ int CodecVideoSendPacket(VideoDecoder * decoder, const AVPacket * avpkt)
 		return 0;
 	}
 
-	pthread_mutex_lock(&CodecLockMutex);
+	Trace(TRACE_VIDEO_SEND, avpkt->pts);
+	TraceMutexLock(CodecLockMutex);
 	if (decoder->VideoCtx) {
+		start = TraceTime();
 		ret = avcodec_send_packet(decoder->VideoCtx, avpkt);
+		decoder->DecodeNs += TraceTime() - start;
 	}
-	pthread_mutex_unlock(&CodecLockMutex);
+	TraceMutexUnlock(CodecLockMutex);
 	if (ret == AVERROR(EAGAIN))
 		return 1;
 	if (ret < 0)
@@ -317,26 +322,32 @@ int CodecVideoSendPacket(VideoDecoder * decoder, const AVPacket * avpkt)
 */
 int CodecVideoReceiveFrame(VideoDecoder * decoder, int no_deint)
 {
+	uint64_t start;
 	int ret;
 
 	if (!(decoder->Frame = av_frame_alloc())) {
 		Fatal("CodecVideoReceiveFrame: can't allocate decoder frame");
 	}
 
-	pthread_mutex_lock(&CodecLockMutex);
+	TraceMutexLock(CodecLockMutex);
 	if (decoder->VideoCtx) {
+		start = TraceTime();
 		ret = avcodec_receive_frame(decoder->VideoCtx, decoder->Frame);
+		decoder->DecodeNs += TraceTime() - start;
 	} else {
 		av_frame_free(&decoder->Frame);
-		pthread_mutex_unlock(&CodecLockMutex);
+		TraceMutexUnlock(CodecLockMutex);
 		return 1;
 	}
-	pthread_mutex_unlock(&CodecLockMutex);
+	TraceMutexUnlock(CodecLockMutex);
 
 	if (decoder->Frame->flags == AV_FRAME_FLAG_CORRUPT)
 		Debug2(L_CODEC, "CodecVideoReceiveFrame: AV_FRAME_FLAG_CORRUPT");
 
 	if (!ret) {
+		Trace(TRACE_VIDEO_FRAME, decoder->Frame->pts);
+		TraceHistAdd(&decoder->Render->DecodeHist, decoder->DecodeNs);
+		decoder->DecodeNs = 0;
 		if (no_deint) {
 			decoder->Frame->interlaced_frame = 0;
 			Debug2(L_CODEC, "CodecVideoReceiveFrame: interlaced_frame = 0");
@@ -361,11 +372,11 @@ int CodecVideoReceiveFrame(VideoDecoder * decoder, int no_deint)
 void CodecVideoFlushBuffers(VideoDecoder * decoder)
 {
 	Debug2(L_CODEC, "CodecVideoFlushBuffers: VideoCtx %p", decoder->VideoCtx);
-	pthread_mutex_lock(&CodecLockMutex);
+	TraceMutexLock(CodecLockMutex);
 	if (decoder->VideoCtx) {
 		avcodec_flush_buffers(decoder->VideoCtx);
 	}
-	pthread_mutex_unlock(&CodecLockMutex);
+	TraceMutexUnlock(CodecLockMutex);
 }
 
 //----------------------------------------------------------------------------
@@ -532,6 +543,7 @@ send:
 		Error("CodecAudioDecode: avcodec_receive_frame error: %s",
 			av_err2str(ret_rec));
 	} else {
+		Trace(TRACE_AUDIO_FRAME, frame->pts);
 		// Control PTS is valid
 		if (audio_decoder->last_pts == (int64_t) AV_NOPTS_VALUE &&
 			frame->pts == (int64_t) AV_NOPTS_VALUE) {
@@ -48,6 +48,7 @@ struct _video_decoder_
 
     AVCodecContext *VideoCtx;		///< video codec context
     AVFrame *Frame;			///< decoded video frame
+    uint64_t DecodeNs;			///< time in the decoder since the last frame
 };
 
 //----------------------------------------------------------------------------
@@ -20,11 +20,20 @@
 ///	$Id$
 //////////////////////////////////////////////////////////////////////////////
 
+#include <cinttypes>
+#include <climits>
 #include <cstdlib>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
 #include <sys/stat.h>
+#include <unistd.h>
 
+#include <algorithm>
+#include <map>
 #include <string>
 using std::string;
+#include <vector>
 #include <fstream>
 using std::ifstream;
 #include <sys/stat.h>
@@ -57,6 +66,591 @@ av_always_inline char* av_err2str(int errnum)
 }
 #endif
 
+//////////////////////////////////////////////////////////////////////////////
+//	cDemuxer Mediaplayer
+//////////////////////////////////////////////////////////////////////////////
+
+cSoftHdDemuxer::cSoftHdDemuxer(AVFormatContext *format, int audio_index,
+	int video_index)
+:cThread("softhddev demux")
+{
+	Format = format;
+	AudioIndex = audio_index;
+	VideoIndex = video_index;
+	AudioMs = VideoMs = Bytes = 0;
+	LastPts[0] = LastPts[1] = AV_NOPTS_VALUE;
+	Generation = 0;
+	SeekStream = 0;
+	SeekTimestamp = 0;
+	SeekFlags = 0;
+	SeekPending = false;
+	Eof = false;
+
+	// a blocking network read must not hold up the stop
+	Format->interrupt_callback.callback = Interrupt;
+	Format->interrupt_callback.opaque = this;
+}
+
+cSoftHdDemuxer::~cSoftHdDemuxer()
+{
+	Cancel(-1);
+	SpaceCond.Broadcast();
+	Cancel(3);
+
+	Format->interrupt_callback.callback = NULL;
+	Format->interrupt_callback.opaque = NULL;
+	Drop();
+}
+
+/**
+**	Interrupt callback of libavformat, stops blocking reads.
+*/
+int cSoftHdDemuxer::Interrupt(void *opaque)
+{
+	return !((cSoftHdDemuxer *)opaque)->Running();
+}
+
+/**
+**	Duration of a packet in ms.
+**
+**	Estimated from the pts of the last packet, if the demuxer
+**	doesn't know it.
+*/
+int cSoftHdDemuxer::PacketMs(AVPacket *packet, bool audio)
+{
+	AVRational time_base = Format->streams[packet->stream_index]->time_base;
+	int64_t *last_pts = &LastPts[audio ? 0 : 1];
+	int64_t duration = packet->duration;
+
+	if (duration <= 0 && packet->pts != AV_NOPTS_VALUE
+		&& *last_pts != AV_NOPTS_VALUE && packet->pts > *last_pts) {
+		duration = packet->pts - *last_pts;
+	}
+	if (packet->pts != AV_NOPTS_VALUE)
+		*last_pts = packet->pts;
+
+	return duration > 0 ? (int)(duration * 1000 * av_q2d(time_base)) : 0;
+}
+
+/**
+**	Check if the read ahead budgets are used up.
+**
+**	A stream that isn't played doesn't need its budget.
+*/
+bool cSoftHdDemuxer::Full(void)
+{
+	if (Bytes >= MEDIA_QUEUE_MAX_BYTES)
+		return true;
+
+	return (AudioIndex < 0 || AudioMs >= MEDIA_QUEUE_AUDIO_MS)
+		&& (VideoIndex < 0 || VideoMs >= MEDIA_QUEUE_VIDEO_MS);
+}
+
+/**
+**	Drop all queued packets. Call locked.
+*/
+void cSoftHdDemuxer::Drop(void)
+{
+	cMediaPacket *item;
+
+	while ((item = Queue.First())) {
+		av_packet_free(&item->Packet);
+		Queue.Del(item);
+	}
+	AudioMs = VideoMs = Bytes = 0;
+	LastPts[0] = LastPts[1] = AV_NOPTS_VALUE;
+}
+
+/**
+**	Demux thread, fills the read ahead queue.
+*/
+void cSoftHdDemuxer::Action(void)
+{
+	AVPacket *packet = av_packet_alloc();
+	int generation;
+	int err;
+
+	while (Running()) {
+		Mutex.Lock();
+		if (SeekPending) {
+			int stream = SeekStream;
+			int64_t timestamp = SeekTimestamp;
+			int flags = SeekFlags;
+
+			SeekPending = false;
+			Mutex.Unlock();
+			if (av_seek_frame(Format, stream, timestamp, flags) < 0)
+				Error("Mediaplayer: seek to %" PRId64 " failed", timestamp);
+			continue;
+		}
+		if (Full() || Eof) {
+			SpaceCond.TimedWait(Mutex, 100);
+			Mutex.Unlock();
+			continue;
+		}
+		generation = Generation;
+		Mutex.Unlock();
+
+		err = av_read_frame(Format, packet);
+
+		cMutexLock lock(&Mutex);
+		if (err) {
+			if (!Running())
+				break;
+			Debug2(L_MEDIA, "Demuxer: av_read_frame error: %s",
+				av_err2str(err));
+			// a seek makes a new start
+			if (generation == Generation)
+				Eof = true;
+			DataCond.Broadcast();
+			continue;
+		}
+		// read while a seek was requested
+		if (generation != Generation ||
+			(packet->stream_index != AudioIndex &&
+			 packet->stream_index != VideoIndex)) {
+			av_packet_unref(packet);
+			continue;
+		}
+
+		bool audio = packet->stream_index == AudioIndex;
+		int ms = PacketMs(packet, audio);
+
+		if (audio)
+			AudioMs += ms;
+		else
+			VideoMs += ms;
+		Bytes += packet->size;
+		Queue.Add(new cMediaPacket(packet, ms, audio));
+		DataCond.Broadcast();
+
+		packet = av_packet_alloc();
+	}
+	av_packet_free(&packet);
+}
+
+/**
+**	Take the next packet from the read ahead queue.
+**
+**	@param[out] audio	set if audio packet
+**	@param timeout		max. wait for a packet in ms
+**
+**	@returns packet, to be freed with av_packet_free() or NULL
+*/
+AVPacket *cSoftHdDemuxer::Get(bool *audio, int timeout)
+{
+	cMutexLock lock(&Mutex);
+	cMediaPacket *item;
+	AVPacket *packet;
+
+	if (!Queue.First() && !Eof)
+		DataCond.TimedWait(Mutex, timeout);
+
+	if (!(item = Queue.First()))
+		return NULL;
+
+	packet = item->Packet;
+	*audio = item->Audio;
+	if (item->Audio)
+		AudioMs -= item->Ms;
+	else
+		VideoMs -= item->Ms;
+	Bytes -= packet->size;
+	Queue.Del(item);
+	SpaceCond.Broadcast();
+
+	return packet;
+}
+
+/**
+**	Request a seek, queued packets are dropped.
+**
+**	@param stream		stream index of the timestamp, -1 for bytes
+**	@param timestamp	seek target in stream time base or bytes
+**	@param flags		av_seek_frame flags
+*/
+void cSoftHdDemuxer::Seek(int stream, int64_t timestamp, int flags)
+{
+	cMutexLock lock(&Mutex);
+
+	Drop();
+	Generation++;
+	SeekStream = stream;
+	SeekTimestamp = timestamp;
+	SeekFlags = flags;
+	SeekPending = true;
+	Eof = false;
+	SpaceCond.Broadcast();
+}
+
+/**
+**	All packets of the file are played.
+*/
+bool cSoftHdDemuxer::AtEnd(void)
+{
+	cMutexLock lock(&Mutex);
+
+	return Eof && !Queue.First();
+}
+
+/**
+**	Check if the whole file is read, packets may still be queued.
+*/
+bool cSoftHdDemuxer::ReadDone(void)
+{
+	cMutexLock lock(&Mutex);
+
+	return Eof && !SeekPending;
+}
+
+/**
+**	Queued duration in ms, the longer of audio and video.
+*/
+int cSoftHdDemuxer::QueuedMs(void)
+{
+	cMutexLock lock(&Mutex);
+
+	return AudioMs > VideoMs ? AudioMs : VideoMs;
+}
+
+/**
+**	Wait until enough is read ahead.
+**
+**	@param ms	queued duration to wait for
+**	@param timeout	max. wait in ms
+*/
+void cSoftHdDemuxer::WaitQueued(int ms, int timeout)
+{
+	cTimeMs timer(timeout);
+	cMutexLock lock(&Mutex);
+
+	while (!Eof && !Full() && (AudioMs > VideoMs ? AudioMs : VideoMs) < ms
+		&& !timer.TimedOut()) {
+		DataCond.TimedWait(Mutex, 20);
+	}
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//	cIndex Mediaplayer
+//////////////////////////////////////////////////////////////////////////////
+
+#define MEDIA_INDEX_MAGIC	0x58444953	///< "SIDX"
+#define MEDIA_INDEX_DISTANCE	1	///< min. seconds between index entries
+
+/**
+**	Header of a stored keyframe index.
+*/
+struct sMediaIndexHeader {
+	uint32_t Magic;
+	int32_t Stream;
+	int64_t FileSize;
+	int64_t FileTime;
+	int64_t Count;
+};
+
+cSoftHdIndex::cSoftHdIndex(const char *path, int stream)
+:cThread("softhddev index")
+{
+	struct stat st;
+
+	Path = path;
+	Stream = stream;
+	FileSize = FileTime = 0;
+	if (!stat(path, &st)) {
+		FileSize = st.st_size;
+		FileTime = st.st_mtime;
+	}
+	Complete = Load();
+}
+
+cSoftHdIndex::~cSoftHdIndex()
+{
+	Cancel(3);
+}
+
+/**
+**	Check if a media url is a local file, that can be indexed.
+*/
+bool cSoftHdIndex::IsLocal(const char *url)
+{
+	struct stat st;
+
+	return !strstr(url, "://") && !stat(url, &st) && S_ISREG(st.st_mode);
+}
+
+/**
+**	Interrupt callback of libavformat, stops indexing.
+*/
+int cSoftHdIndex::Interrupt(void *opaque)
+{
+	return !((cSoftHdIndex *)opaque)->Running();
+}
+
+/**
+**	Name of the index file in the cache directory.
+*/
+cString cSoftHdIndex::CacheFile(void)
+{
+	uint32_t hash = 0x811c9dc5;
+
+	// FNV-1a of the path
+	for (const char *s = Path.c_str(); *s; ++s) {
+		hash = (hash ^ (uint8_t)*s) * 0x01000193;
+	}
+
+	return cString::sprintf("%s/index-%08x.idx",
+		cPlugin::CacheDirectory(PLUGIN_NAME_I18N), hash);
+}
+
+/**
+**	Load a stored index, if it matches the file.
+*/
+bool cSoftHdIndex::Load(void)
+{
+	struct sMediaIndexHeader header;
+	FILE *f;
+	bool ok = false;
+
+	if (!(f = fopen(CacheFile(), "r")))
+		return false;
+
+	if (fread(&header, sizeof(header), 1, f) == 1
+		&& header.Magic == MEDIA_INDEX_MAGIC && header.Stream == Stream
+		&& header.FileSize == FileSize && header.FileTime == FileTime
+		&& header.Count > 0 && header.Count < INT_MAX) {
+		Entries.resize(header.Count);
+		ok = fread(&Entries[0], sizeof(sMediaIndexEntry), header.Count, f)
+			== (size_t)header.Count;
+	}
+	fclose(f);
+
+	if (!ok) {
+		Entries.clear();
+		Debug2(L_MEDIA, "Index: no valid index for %s", Path.c_str());
+		return false;
+	}
+	Debug2(L_MEDIA, "Index: %d keyframes of %s loaded", (int)Entries.size(),
+		Path.c_str());
+
+	return true;
+}
+
+/**
+**	Store the index in the cache directory.
+*/
+void cSoftHdIndex::Save(void)
+{
+	struct sMediaIndexHeader header;
+	cString name = CacheFile();
+	cString tmp = cString::sprintf("%s.tmp", *name);
+	FILE *f;
+
+	if (Entries.empty())
+		return;
+
+	if (!(f = fopen(tmp, "w"))) {
+		Error("Mediaplayer: can't write index %s: %m", *tmp);
+		return;
+	}
+	header.Magic = MEDIA_INDEX_MAGIC;
+	header.Stream = Stream;
+	header.FileSize = FileSize;
+	header.FileTime = FileTime;
+	header.Count = Entries.size();
+	if (fwrite(&header, sizeof(header), 1, f) != 1 ||
+		fwrite(&Entries[0], sizeof(sMediaIndexEntry), Entries.size(), f)
+			!= Entries.size()) {
+		Error("Mediaplayer: can't write index %s: %m", *tmp);
+		fclose(f);
+		unlink(tmp);
+		return;
+	}
+	fclose(f);
+	rename(tmp, name);
+}
+
+/**
+**	Index builder thread, reads the whole file once.
+*/
+void cSoftHdIndex::Action(void)
+{
+	AVFormatContext *format = NULL;
+	AVPacket *packet;
+	int64_t distance;
+	uint32_t start;
+
+	if (Complete)
+		return;
+
+	SetPriority(19);
+	SetIOPriority(7);
+	start = GetMsTicks();
+
+	if (avformat_open_input(&format, Path.c_str(), NULL, NULL) != 0) {
+		Error("Mediaplayer: index could not open file '%s'", Path.c_str());
+		return;
+	}
+	format->interrupt_callback.callback = Interrupt;
+	format->interrupt_callback.opaque = this;
+	if (avformat_find_stream_info(format, NULL) < 0
+		|| Stream >= (int)format->nb_streams) {
+		avformat_close_input(&format);
+		return;
+	}
+	distance = av_rescale_q(MEDIA_INDEX_DISTANCE * AV_TIME_BASE,
+		AV_TIME_BASE_Q, format->streams[Stream]->time_base);
+
+	packet = av_packet_alloc();
+	while (Running() && av_read_frame(format, packet) >= 0) {
+		if (packet->stream_index == Stream
+			&& (packet->flags & AV_PKT_FLAG_KEY) && packet->pos >= 0
+			&& packet->pts != AV_NOPTS_VALUE) {
+			cMutexLock lock(&Mutex);
+
+			if (Entries.empty() || packet->pts >= Entries.back().Pts + distance) {
+				sMediaIndexEntry entry = { packet->pos, packet->pts };
+
+				Entries.push_back(entry);
+			}
+		}
+		av_packet_unref(packet);
+	}
+	av_packet_free(&packet);
+	avformat_close_input(&format);
+
+	if (!Running())
+		return;
+
+	cMutexLock lock(&Mutex);
+	Complete = true;
+	Save();
+	Info("Mediaplayer: indexed %d keyframes of %s in %ums",
+		(int)Entries.size(), Path.c_str(), GetMsTicks() - start);
+}
+
+/**
+**	Find the last keyframe before pts.
+**
+**	@param pts		seek target in stream time base
+**	@param[out] pos		byte position of the keyframe
+**	@param[out] key_pts	pts of the keyframe
+**
+**	@returns false if the target isn't indexed (yet) or is before
+**		the first keyframe
+*/
+bool cSoftHdIndex::Find(int64_t pts, int64_t *pos, int64_t *key_pts)
+{
+	cMutexLock lock(&Mutex);
+	int lo;
+	int hi;
+
+	if (Entries.empty() || pts < Entries.front().Pts
+		|| (!Complete && pts > Entries.back().Pts))
+		return false;
+
+	lo = 0;
+	hi = Entries.size() - 1;
+	while (lo < hi) {
+		int mid = (lo + hi + 1) / 2;
+
+		if (Entries[mid].Pts <= pts)
+			lo = mid;
+		else
+			hi = mid - 1;
+	}
+	*pos = Entries[lo].Pos;
+	*key_pts = Entries[lo].Pts;
+
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//	cOpener Mediaplayer
+//////////////////////////////////////////////////////////////////////////////
+
+cSoftHdOpener::cSoftHdOpener(const char *url)
+:cThread("softhddev opener")
+{
+	Url = url;
+	Format = NULL;
+}
+
+cSoftHdOpener::~cSoftHdOpener()
+{
+	Cancel(3);
+	if (Format)
+		avformat_close_input(&Format);
+}
+
+/**
+**	Interrupt callback of libavformat, stops opening.
+*/
+int cSoftHdOpener::Interrupt(void *opaque)
+{
+	return !((cSoftHdOpener *)opaque)->Running();
+}
+
+/**
+**	Open and probe, the slow part of starting an entry.
+*/
+void cSoftHdOpener::Open(void)
+{
+	AVFormatContext *format = avformat_alloc_context();
+	uint32_t start = GetMsTicks();
+
+	format->interrupt_callback.callback = Interrupt;
+	format->interrupt_callback.opaque = this;
+	if (avformat_open_input(&format, Url.c_str(), NULL, NULL) != 0) {
+		Error("Mediaplayer: Could not open file '%s'", Url.c_str());
+		return;
+	}
+	if (avformat_find_stream_info(format, NULL) < 0) {
+		Error("Mediaplayer: Could not retrieve stream info from file '%s'",
+			Url.c_str());
+		avformat_close_input(&format);
+		return;
+	}
+	format->interrupt_callback.callback = NULL;
+	format->interrupt_callback.opaque = NULL;
+	Format = format;
+	Debug2(L_MEDIA, "Opener: %s opened in %ums", Url.c_str(),
+		GetMsTicks() - start);
+}
+
+/**
+**	Opener thread.
+*/
+void cSoftHdOpener::Action(void)
+{
+	Open();
+	Opened.Signal();
+}
+
+/**
+**	Take the opened format context.
+**
+**	Waits for the probing to finish.
+**
+**	@param url	entry to be played
+**
+**	@returns NULL if url wasn't pre-opened or failed
+*/
+AVFormatContext *cSoftHdOpener::Take(const char *url)
+{
+	AVFormatContext *format;
+
+	if (Url.compare(url))
+		return NULL;
+	// the thread is active from Start() until Action() is done
+	if (Active())
+		Opened.Wait(0);
+
+	format = Format;
+	Format = NULL;
+
+	return format;
+}
+
 //////////////////////////////////////////////////////////////////////////////
 //	cPlayer Mediaplayer
 //////////////////////////////////////////////////////////////////////////////
@@ -75,12 +669,22 @@ cSoftHdPlayer::cSoftHdPlayer(const char *Url)
 	}
 	Pause = 0;
 	Random = 0;
+	QueuedMs = 0;
+	Speed = 0;
+	Following = NULL;
+	Opener = NULL;
+	AudioCodec.Par = VideoCodec.Par = NULL;
+	Gapless = false;
+	EndUs = AV_NOPTS_VALUE;
 //	Debug2(L_MEDIA, "cSoftHdPlayer: Player gestartet.");
 }
 
 cSoftHdPlayer::~cSoftHdPlayer()
 {
 	StopPlay = 1;
+	delete Opener;
+	avcodec_parameters_free(&AudioCodec.Par);
+	avcodec_parameters_free(&VideoCodec.Par);
 	free(Source);
 	if (FirstEntry) {
 		while(FirstEntry) {
@@ -109,15 +713,17 @@ void cSoftHdPlayer::Action(void)
 	if (strcasestr(Source, ".M3U") && !strcasestr(Source, ".M3U8")) {
 		while(CurrentEntry) {
 			Jump = 0;
+			// known in advance, to open it before the current ends
+			if (Random) {
+				srand (time (NULL));
+				Following = GetEntry(std::rand() % (Entries));
+			} else {
+				Following = CurrentEntry->NextEntry;
+			}
 			Player(CurrentEntry->Path.c_str());
 
 			if (!NoModify) {
-				CurrentEntry = CurrentEntry->NextEntry;
-
-				if (Random) {
-					srand (time (NULL));
-					SetEntry(std::rand() % (Entries));
-				}
+				CurrentEntry = Following;
 			}
 			NoModify = 0;
 
@@ -131,6 +737,7 @@ void cSoftHdPlayer::Action(void)
 
 	while(AudioGetClock() != AV_NOPTS_VALUE)
 		usleep(5000);
+	SetAudioOnly(0);
 
 	cSoftHdControl::Control()->Close = 1;
 }
@@ -176,7 +783,7 @@ void cSoftHdPlayer::ReadPL(const char *Playlist)
 	f.close();
 }
 
-void cSoftHdPlayer::SetEntry(int index)
+PLEntry *cSoftHdPlayer::GetEntry(int index)
 {
 	PLEntry *entry;
 	entry = FirstEntry;
@@ -184,110 +791,419 @@ void cSoftHdPlayer::SetEntry(int index)
 	for(int i = 0; i < index ; i++) {
 		entry = entry->NextEntry;
 	}
-	CurrentEntry = entry;
+	return entry;
+}
+
+void cSoftHdPlayer::SetEntry(int index)
+{
+	CurrentEntry = GetEntry(index);
 	NoModify = 1;
 	StopPlay = 1;
+	Wake();
+}
+
+/**
+**	Wake up the player after Pause, Jump, Speed or StopPlay changed.
+*/
+void cSoftHdPlayer::Wake(void)
+{
+	Wakeup.Signal();
+}
+
+/**
+**	Check if a kept decoder can continue with a stream.
+*/
+static bool SameCodec(const sMediaCodec *codec, const AVStream *stream)
+{
+	const AVCodecParameters *par = stream->codecpar;
+
+	return codec->Par && codec->Par->codec_id == par->codec_id
+		&& codec->Par->format == par->format
+		&& codec->Par->sample_rate == par->sample_rate
+		&& codec->Par->channels == par->channels
+		&& codec->Par->channel_layout == par->channel_layout
+		&& codec->Par->width == par->width
+		&& codec->Par->height == par->height
+		&& codec->Par->extradata_size == par->extradata_size
+		&& (!par->extradata_size || !memcmp(codec->Par->extradata,
+			par->extradata, par->extradata_size))
+		&& codec->TimeBaseNum == stream->time_base.num
+		&& codec->TimeBaseDen == stream->time_base.den;
+}
+
+/**
+**	Remember the decoder setup of a stream.
+*/
+static void KeepCodec(sMediaCodec *codec, const AVStream *stream)
+{
+	if (!codec->Par)
+		codec->Par = avcodec_parameters_alloc();
+	avcodec_parameters_copy(codec->Par, stream->codecpar);
+	codec->TimeBaseNum = stream->time_base.num;
+	codec->TimeBaseDen = stream->time_base.den;
+}
+
+/**
+**	Shift packet timestamps, to continue those of the previous entry.
+*/
+static void SplicePacket(AVPacket *packet, AVRational tb, int64_t offset_us)
+{
+	int64_t offset = av_rescale_q(offset_us, AV_TIME_BASE_Q, tb);
+
+	if (packet->pts != AV_NOPTS_VALUE)
+		packet->pts += offset;
+	if (packet->dts != AV_NOPTS_VALUE)
+		packet->dts += offset;
 }
 
 void cSoftHdPlayer::Player(const char *url)
 {
-	AVPacket packet;
+	cSoftHdDemuxer *demuxer;
+	cSoftHdIndex *index = NULL;
+	AVPacket *packet = NULL;
+	bool audio = false;
+	bool eof = false;
+	bool prebuffer = false;
+	int64_t jump_pts = AV_NOPTS_VALUE;
+	int64_t audio_skip_pts = AV_NOPTS_VALUE;
 #if LIBAVFORMAT_VERSION_INT < AV_VERSION_INT(59,0,100)
 	AVCodec *video_codec;
 #else
 	const AVCodec *video_codec;
 #endif
-	int err = 0;
-	int audio_stream_index = 0;
+	int audio_stream_index = -1;
 	int video_stream_index;
 	int jump_stream_index = 0;
 	int start_time;
+	int64_t offset_us = 0;
+	int trick_speed = 0;
+	int64_t trick_pos = AV_NOPTS_VALUE;
+	int64_t trick_key = AV_NOPTS_VALUE;
+	int64_t resume_pts = AV_NOPTS_VALUE;
+	uint32_t trick_next = 0;
+	AVFormatContext *format = NULL;
 
 	StopPlay = 0;
 	Jump = 0;
+	Speed = 0;
 
-	AVFormatContext *format = avformat_alloc_context();
-	if (avformat_open_input(&format, url, NULL, NULL) != 0) {
-		Error("Mediaplayer: Could not open file '%s'", url);
-		return;
+	// pre-opened while the previous entry played out
+	if (Opener) {
+		format = Opener->Take(url);
+		delete Opener;
+		Opener = NULL;
+	}
+	if (!format) {
+		format = avformat_alloc_context();
+		if (avformat_open_input(&format, url, NULL, NULL) != 0) {
+			Error("Mediaplayer: Could not open file '%s'", url);
+			return;
+		}
+		if (avformat_find_stream_info(format, NULL) < 0) {
+			Error("Mediaplayer: Could not retrieve stream info from file '%s'", url);
+			avformat_close_input(&format);
+			return;
+		}
 	}
 #ifdef MEDIA_DEBUG
 	av_dump_format(format, -1, url, 0);
 #endif
-	if (avformat_find_stream_info(format, NULL) < 0) {
-		Error("Mediaplayer: Could not retrieve stream info from file '%s'", url);
-		return;
-	}
 
+	// decoders stay open, if the parameters don't change
 	for (unsigned int i = 0; i < format->nb_streams; i++) {
 		if (format->streams[i]->codecpar->codec_type == AVMEDIA_TYPE_AUDIO) {
-			SetAudioCodec(format->streams[i]->codecpar->codec_id,
-				format->streams[i]->codecpar, &format->streams[i]->time_base);
+			if (!SameCodec(&AudioCodec, format->streams[i])) {
+				KeepCodec(&AudioCodec, format->streams[i]);
+				SetAudioCodec(AudioCodec.Par->codec_id, AudioCodec.Par,
+					&format->streams[i]->time_base);
+			}
 			audio_stream_index = jump_stream_index = i;
 			break;
 		}
-	}
+	}
+
+	video_stream_index = av_find_best_stream(format, AVMEDIA_TYPE_VIDEO,
+		-1, -1, &video_codec, 0);
+
+	// no video, let the video pipeline idle
+	SetAudioOnly(video_stream_index < 0);
+	if (video_stream_index < 0) {
+		Debug2(L_MEDIA, "Player: stream does not seem to contain video");
+	} else {
+		if (!SameCodec(&VideoCodec, format->streams[video_stream_index])) {
+			KeepCodec(&VideoCodec, format->streams[video_stream_index]);
+			SetVideoCodec(video_codec->id, VideoCodec.Par,
+				&format->streams[video_stream_index]->time_base);
+		}
+		jump_stream_index = video_stream_index;
+	}
+
+	Duration = format->duration / AV_TIME_BASE;
+	start_time = format->start_time / AV_TIME_BASE;
+
+	// continue the timestamps, audio plays on without a restart
+	if (Gapless && EndUs != AV_NOPTS_VALUE) {
+		offset_us = EndUs;
+		if (format->start_time != AV_NOPTS_VALUE)
+			offset_us -= format->start_time;
+		Debug2(L_MEDIA, "Player: gapless, timestamps shifted by %" PRId64 "us",
+			offset_us);
+	} else {
+		EndUs = AV_NOPTS_VALUE;
+	}
+	Gapless = false;
+
+	// demux in its own thread, network jitter is taken by the queue
+	demuxer = new cSoftHdDemuxer(format, audio_stream_index,
+		video_stream_index);
+	demuxer->Start();
+
+	// exact seeking in local files needs a keyframe index
+	if (video_stream_index >= 0 && cSoftHdIndex::IsLocal(url)
+		&& !(format->iformat->flags & AVFMT_NO_BYTE_SEEK)) {
+		index = new cSoftHdIndex(url, video_stream_index);
+		index->Start();
+	}
+
+	while (!StopPlay) {
+		int64_t pts = AV_NOPTS_VALUE;
+		int64_t end_us = AV_NOPTS_VALUE;
+		unsigned seq;
+
+		while (Pause && !StopPlay) {
+			Wakeup.Wait(0);
+		}
+
+		// open the following entry, while this one plays out
+		if (Following && !Opener && (demuxer->ReadDone()
+			|| (Duration && CurrentTime + MEDIA_PREOPEN_S >= Duration))) {
+			Opener = new cSoftHdOpener(Following->Path.c_str());
+			Opener->Start();
+		}
+
+		// jumps while scanning move the scan position
+		if (Jump && trick_speed) {
+			trick_pos += (int64_t)(Jump /
+				av_q2d(format->streams[jump_stream_index]->time_base));
+			Jump = 0;
+		}
+
+		// leave fast forward/rewind at the scan position
+		if (!Speed && trick_speed) {
+			trick_speed = 0;
+			TrickSpeed(0);
+			resume_pts = trick_pos;
+		}
+
+		if ((Jump || resume_pts != AV_NOPTS_VALUE) && format->pb->seekable
+			&& jump_pts != AV_NOPTS_VALUE) {
+			AVRational tb = format->streams[jump_stream_index]->time_base;
+			int64_t offset = av_rescale_q(offset_us, AV_TIME_BASE_Q, tb);
+			int64_t target = jump_pts - offset + (int64_t)(Jump / av_q2d(tb));
+			int64_t pos;
+			int64_t key_pts;
+
+			if (resume_pts != AV_NOPTS_VALUE) {
+				target = resume_pts;
+				resume_pts = AV_NOPTS_VALUE;
+			}
+
+			av_packet_free(&packet);
+			EndUs = AV_NOPTS_VALUE;
+			if (index && index->Find(target, &pos, &key_pts)) {
+				// start at the keyframe, drop everything before the target
+				demuxer->Seek(-1, pos, AVSEEK_FLAG_BYTE);
+				Clear();
+				SkipVideoUntil(target + offset);
+				if (audio_stream_index >= 0)
+					audio_skip_pts = av_rescale_q(target, tb,
+						format->streams[audio_stream_index]->time_base);
+				prebuffer = true;
+				Debug2(L_MEDIA, "Player: seek to %" PRId64 " from keyframe %"
+					PRId64 " at %" PRId64, target, key_pts, pos);
+			} else {
+				demuxer->Seek(jump_stream_index, target);
+				Clear();
+			}
+			Jump = 0;
+		}
 
-	video_stream_index = av_find_best_stream(format, AVMEDIA_TYPE_VIDEO,
-		-1, -1, &video_codec, 0);
+		// fast forward/rewind: only keyframes, paced to the speed
+		if (Speed && video_stream_index >= 0 && format->pb->seekable
+			&& jump_pts != AV_NOPTS_VALUE) {
+			AVStream *stream = format->streams[video_stream_index];
+			AVRational ms = { 1, 1000 };
+			int64_t start = stream->start_time != AV_NOPTS_VALUE
+				? stream->start_time : 0;
+			int64_t pos;
+			int64_t key_pts;
+			unsigned seq;
+
+			if (!trick_speed) {
+				av_packet_free(&packet);
+				Clear();
+				TrickSpeed(1);
+				trick_pos = jump_pts - av_rescale_q(offset_us,
+					AV_TIME_BASE_Q, stream->time_base);
+				trick_key = AV_NOPTS_VALUE;
+				trick_next = GetMsTicks();
+			}
+			// Play() after a pause resets the device
+			if (trick_speed != Speed)
+				TrickSpeed(1);
+			trick_speed = Speed;
+
+			if ((int32_t)(trick_next - GetMsTicks()) > 0) {
+				// control changes end the wait early
+				Wakeup.Wait((int32_t)(trick_next - GetMsTicks()) + 1);
+				continue;
+			}
+			trick_next = GetMsTicks() + MEDIA_TRICK_STEP_MS;
+			trick_pos += av_rescale_q((int64_t)trick_speed * MEDIA_TRICK_STEP_MS,
+				ms, stream->time_base);
+
+			// at the start or end, play on from there
+			if (trick_pos < start) {
+				trick_pos = start;
+				Speed = 0;
+			}
+			if (format->duration != AV_NOPTS_VALUE && trick_pos > start
+				+ av_rescale_q(format->duration, AV_TIME_BASE_Q, stream->time_base)) {
+				trick_pos = start + av_rescale_q(format->duration - AV_TIME_BASE,
+					AV_TIME_BASE_Q, stream->time_base);
+				Speed = 0;
+			}
+			CurrentTime = trick_pos * av_q2d(stream->time_base) - start_time;
+			if (!Speed)
+				continue;
+
+			if (index && index->Find(trick_pos, &pos, &key_pts)) {
+				if (key_pts == trick_key)
+					continue;
+				demuxer->Seek(-1, pos, AVSEEK_FLAG_BYTE);
+			} else {
+				// the seek goes to the next keyframe in scan direction,
+				// up to the shown one it finds that one again
+				if (trick_key != AV_NOPTS_VALUE && (trick_speed > 0
+					? trick_pos <= trick_key : trick_pos >= trick_key))
+					continue;
+				demuxer->Seek(video_stream_index, trick_pos,
+					trick_speed < 0 ? AVSEEK_FLAG_BACKWARD : 0);
+			}
 
-	if (video_stream_index < 0) {
-		Debug2(L_MEDIA, "Player: stream does not seem to contain video");
-	} else {
-		 SetVideoCodec(video_codec->id,
-			format->streams[video_stream_index]->codecpar,
-			&format->streams[video_stream_index]->time_base);
-		jump_stream_index = video_stream_index;
-	}
+			// audio and everything up to the keyframe is dropped
+			while (!StopPlay && !Jump && Speed) {
+				if (!(packet = demuxer->Get(&audio, 100))) {
+					if (demuxer->AtEnd())
+						break;
+					continue;
+				}
+				if (!audio && packet->stream_index == video_stream_index
+					&& (packet->flags & AV_PKT_FLAG_KEY))
+					break;
+				av_packet_free(&packet);
+			}
+			if (!packet)
+				continue;
+			// the same keyframe again, nothing to show
+			if (packet->pts == trick_key) {
+				av_packet_free(&packet);
+				continue;
+			}
+			trick_key = packet->pts;
+			if (offset_us)
+				SplicePacket(packet, stream->time_base, offset_us);
+			if (packet->pts != AV_NOPTS_VALUE)
+				jump_pts = packet->pts;
+
+			seq = GetBufferSpaceSeq();
+			while (!PlayVideoPkts(packet) && !StopPlay) {
+				WaitBufferSpace(seq, 100);
+				seq = GetBufferSpaceSeq();
+			}
+			av_packet_free(&packet);
+			continue;
+		}
 
-	Duration = format->duration / AV_TIME_BASE;
-	start_time = format->start_time / AV_TIME_BASE;
+		if (prebuffer) {
+			demuxer->WaitQueued(MEDIA_PREBUFFER_MS, 1000);
+			prebuffer = false;
+		}
 
-	while (!StopPlay) {
-		err = av_read_frame(format, &packet);
-		if (err == 0) {
-repeat:
-			if (audio_stream_index == packet.stream_index) {
-				if (!PlayAudioPkts(&packet)) {
-					usleep(packet.duration * AV_TIME_BASE *
-						av_q2d(format->streams[audio_stream_index]->time_base));
-					goto repeat;
+		if (!packet) {
+			if (!(packet = demuxer->Get(&audio, 100))) {
+				if (demuxer->AtEnd()) {
+					Debug2(L_MEDIA, "Player: end of stream");
+					eof = true;
+					break;
 				}
-				CurrentTime = AudioGetClock() / 1000 - start_time;
+				QueuedMs = 0;
+				continue;
 			}
 
-			if (video_stream_index == packet.stream_index) {
-				if (!PlayVideoPkts(&packet)) {
-					usleep(packet.duration * AV_TIME_BASE *
-						av_q2d(format->streams[video_stream_index]->time_base));
-					goto repeat;
+			if (audio && audio_skip_pts != AV_NOPTS_VALUE) {
+				if (packet->pts != AV_NOPTS_VALUE && packet->pts < audio_skip_pts) {
+					av_packet_free(&packet);
+					continue;
 				}
+				audio_skip_pts = AV_NOPTS_VALUE;
+			}
+			if (offset_us) {
+				SplicePacket(packet,
+					format->streams[packet->stream_index]->time_base, offset_us);
 			}
-		} else {
-			Debug2(L_MEDIA, "Player: av_read_frame error: %s",
-				av_err2str(err));
-			StopPlay = 1;
-			continue;
 		}
 
-		while (Pause) {
-			sleep(1);
+		// the video packet is moved into the device, remember its pts
+		if (packet->stream_index == jump_stream_index)
+			pts = packet->pts;
+		if (packet->pts != AV_NOPTS_VALUE) {
+			end_us = av_rescale_q(packet->pts + packet->duration,
+				format->streams[packet->stream_index]->time_base,
+				AV_TIME_BASE_Q);
 		}
 
-		if (Jump && format->pb->seekable) {
-			av_seek_frame(format, format->streams[jump_stream_index]->index,
-				packet.pts + (int64_t)(Jump /		// - BufferOffset
-				av_q2d(format->streams[jump_stream_index]->time_base)), 0);
-			Clear();
-			Jump = 0;
+		// wait for the device to consume, instead of sleeping
+		seq = GetBufferSpaceSeq();
+		if (audio) {
+			if (!PlayAudioPkts(packet)) {
+				WaitBufferSpace(seq, 100);
+				continue;
+			}
+			CurrentTime = (AudioGetClock() - offset_us / 1000) / 1000
+				- start_time;
+		} else {
+			if (!PlayVideoPkts(packet)) {
+				WaitBufferSpace(seq, 100);
+				continue;
+			}
 		}
+		if (pts != AV_NOPTS_VALUE)
+			jump_pts = pts;
+		if (end_us != AV_NOPTS_VALUE && (EndUs == AV_NOPTS_VALUE || end_us > EndUs))
+			EndUs = end_us;
+		av_packet_free(&packet);
+		QueuedMs = demuxer->QueuedMs();
+	}
 
-		if (StopPlay)
-			Clear();
+	if (trick_speed)
+		TrickSpeed(0);
+	Speed = 0;
 
-		av_packet_unref(&packet);
-	}
+	// at the end of the file, let the buffers play out
+	if (!eof)
+		Clear();
+	// a seek target past the end isn't reached, don't let it drop
+	// the frames of the next entry or of live tv
+	SkipVideoUntil(AV_NOPTS_VALUE);
+	Gapless = eof;
+	StopPlay = 1;
 
+	delete index;
+	delete demuxer;
+	av_packet_free(&packet);
+
+	QueuedMs = 0;
 	Duration = 0;
 	CurrentTime = 0;
 
@@ -342,6 +1258,41 @@ void cSoftHdControl::Hide(void)
 	}
 }
 
+/**
+**	Skin speed level of a fast forward/rewind speed.
+**
+**	@param speed	player speed, 0 normal
+**
+**	@returns -1 for normal play, 1 .. for 2x ..
+*/
+static int TrickLevel(int speed)
+{
+	int level = 0;
+
+	if (!speed)
+		return -1;
+	for (speed = abs(speed); speed > 1; speed >>= 1)
+		level++;
+
+	return level;
+}
+
+/**
+**	Next fast forward/rewind speed.
+**
+**	@param speed	current player speed
+**	@param dir	1 fast forward, -1 rewind
+*/
+static int TrickNext(int speed, int dir)
+{
+	if (speed * dir <= 0)
+		return 2 * dir;
+	if (abs(speed) >= MEDIA_TRICK_MAX)
+		return speed;
+
+	return speed * 2;
+}
+
 void cSoftHdControl::ShowProgress(void)
 {
 	if (!pOsd) {
@@ -349,7 +1300,11 @@ void cSoftHdControl::ShowProgress(void)
 		pOsd = Skins.Current()->DisplayReplay(false);
 	}
 
-	pOsd->SetTitle(pPlayer->GetTitle());
+	// show the read ahead of the demuxer
+	pOsd->SetTitle(cString::sprintf("%s (%d.%ds)", pPlayer->GetTitle(),
+		pPlayer->QueuedMs / 1000, pPlayer->QueuedMs % 1000 / 100));
+	pOsd->SetMode(!pPlayer->Pause, pPlayer->Speed >= 0,
+		TrickLevel(pPlayer->Speed));
 	pOsd->SetProgress(pPlayer->CurrentTime, pPlayer->Duration);
 	pOsd->SetCurrent(IndexToHMSF(pPlayer->CurrentTime, false, 1));
 	pOsd->SetTotal(IndexToHMSF(pPlayer->Duration, false, 1));
@@ -387,24 +1342,43 @@ eOSState cSoftHdControl::ProcessKey(eKeys key)
 				pPlayer->Pause = 0;
 				Play();
 			}
+			pPlayer->Speed = 0;
+			pPlayer->Wake();
+			break;
+
+		case kFastFwd:
+		case kFastRew:
+			if (pPlayer->Pause) {
+				pPlayer->Pause = 0;
+				Play();
+			}
+			pPlayer->Speed = TrickNext(pPlayer->Speed,
+				key == kFastFwd ? 1 : -1);
+			pPlayer->Wake();
+			ShowProgress();
 			break;
 
 		case kGreen:
 			pPlayer->Jump = -60;
+			pPlayer->Wake();
 		break;
 
 		case kYellow:
 			pPlayer->Jump = 60;
+			pPlayer->Wake();
 		break;
 
 		case kBlue:
 			Hide();
 			pPlayer->StopPlay = 1;
+			pPlayer->Wake();
 			return osStopReplay;
 
 		case kPause:
 			if (pPlayer->Pause) {
 				pPlayer->Pause = 0;
+				pPlayer->Speed = 0;
+				pPlayer->Wake();
 				Play();
 			} else {
 				pPlayer->Pause = 1;
@@ -414,6 +1388,7 @@ eOSState cSoftHdControl::ProcessKey(eKeys key)
 
 		case kNext:
 			pPlayer->StopPlay = 1;
+			pPlayer->Wake();
 			break;
 
 		default:
@@ -424,6 +1399,510 @@ eOSState cSoftHdControl::ProcessKey(eKeys key)
 }
 
 
+//////////////////////////////////////////////////////////////////////////////
+//	cLibrary Mediaplayer
+//////////////////////////////////////////////////////////////////////////////
+
+#define MEDIA_LIBRARY_MAGIC	"SOFTHDDEV-LIBRARY 1"	///< index file header
+#define MEDIA_LIBRARY_EVENTS	(IN_CREATE | IN_DELETE | IN_MOVED_FROM | \
+	IN_MOVED_TO | IN_CLOSE_WRITE | IN_DELETE_SELF | IN_MOVE_SELF)
+
+cSoftHdLibrary *cSoftHdLibrary::pLibrary = NULL;
+
+/**
+**	Start the media library of a directory.
+*/
+void cSoftHdLibrary::Startup(const char *root)
+{
+	if (!pLibrary) {
+		pLibrary = new cSoftHdLibrary(root);
+		pLibrary->Start();
+	}
+}
+
+/**
+**	Stop the media library.
+*/
+void cSoftHdLibrary::Shutdown(void)
+{
+	delete pLibrary;
+	pLibrary = NULL;
+}
+
+cSoftHdLibrary::cSoftHdLibrary(const char *root)
+:cThread("softhddev library")
+{
+	Root = root;
+	while (Root.size() > 1 && Root[Root.size() - 1] == '/')
+		Root.erase(Root.size() - 1);
+	Inotify = -1;
+	StopEvent = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	Dirty = false;
+}
+
+cSoftHdLibrary::~cSoftHdLibrary()
+{
+	Cancel(-1);
+	if (StopEvent >= 0)
+		eventfd_write(StopEvent, 1);
+	Cancel(3);
+	if (Inotify >= 0)
+		close(Inotify);
+	if (StopEvent >= 0)
+		close(StopEvent);
+}
+
+/**
+**	Check if a file can be played and probed.
+*/
+bool cSoftHdLibrary::IsMedia(const char *name)
+{
+	return strcasestr(name, ".MP3") || strcasestr(name, ".MP4")
+		|| strcasestr(name, ".TS");
+}
+
+/**
+**	Sort predicate, directories before files.
+*/
+static bool LibraryEntryIsDir(const sLibraryEntry &entry)
+{
+	return entry.Dir;
+}
+
+/**
+**	List a directory, directories first.
+**
+**	Needs one stat per file, directories are known by d_type.
+**
+**	@param path		directory
+**	@param[out] entries	visible files and directories
+**
+**	@returns false if the directory can't be read
+*/
+bool cSoftHdLibrary::ReadDir(const string &path,
+	std::vector<sLibraryEntry> &entries)
+{
+	struct dirent **list;
+	int n;
+
+	entries.clear();
+	if ((n = scandir(path.empty() ? "/" : path.c_str(), &list, NULL,
+		alphasort)) == -1) {
+		return false;
+	}
+	for (int i = 0; i < n; i++) {
+		sLibraryEntry entry;
+		struct stat st;
+
+		entry.Name = list[i]->d_name;
+		entry.Size = 0;
+		entry.Mtime = 0;
+		entry.Duration = -1;
+		// the index is line based, skip names it can't store
+		if (list[i]->d_name[0] != '.' && !strchr(list[i]->d_name, '\n')) {
+			if (list[i]->d_type == DT_DIR) {
+				entry.Dir = true;
+				entries.push_back(entry);
+			} else if (!stat((path + "/" + entry.Name).c_str(), &st)
+				&& (S_ISDIR(st.st_mode) || S_ISREG(st.st_mode))) {
+				entry.Dir = S_ISDIR(st.st_mode);
+				entry.Size = st.st_size;
+				entry.Mtime = st.st_mtime;
+				entries.push_back(entry);
+			}
+		}
+		free(list[i]);
+	}
+	free(list);
+
+	std::stable_partition(entries.begin(), entries.end(), LibraryEntryIsDir);
+
+	return true;
+}
+
+/**
+**	Get an indexed directory.
+**
+**	@param path		directory
+**	@param[out] entries	files and directories
+**
+**	@returns false if the directory isn't indexed
+*/
+bool cSoftHdLibrary::List(const string &path,
+	std::vector<sLibraryEntry> &entries)
+{
+	cMutexLock lock(&Mutex);
+	std::map<string, sLibraryDir>::iterator dir = Dirs.find(path);
+
+	if (dir == Dirs.end())
+		return false;
+	entries = dir->second.Entries;
+
+	return true;
+}
+
+/**
+**	Name of the index file in the cache directory.
+*/
+cString cSoftHdLibrary::CacheFile(void)
+{
+	return cString::sprintf("%s/library.idx",
+		cPlugin::CacheDirectory(PLUGIN_NAME_I18N));
+}
+
+/**
+**	Load the stored index.
+**
+**	Directories are verified by the following crawl.
+*/
+void cSoftHdLibrary::Load(void)
+{
+	cReadLine reader;
+	sLibraryDir *dir = NULL;
+	char *line;
+	FILE *f;
+
+	if (!(f = fopen(CacheFile(), "r")))
+		return;
+
+	line = reader.Read(f);
+	if (!line || strcmp(line, MEDIA_LIBRARY_MAGIC) || !(line = reader.Read(f))
+		|| Root.compare(line)) {
+		fclose(f);
+		return;
+	}
+
+	cMutexLock lock(&Mutex);
+	while ((line = reader.Read(f))) {
+		long long size;
+		long long mtime;
+		int is_dir;
+		int duration;
+		int n = 0;
+
+		if (sscanf(line, "D %lld%n", &mtime, &n) == 1 && line[n] == ' ') {
+			dir = &Dirs[line + n + 1];
+			dir->Mtime = mtime;
+		} else if (dir && sscanf(line, "F %d %lld %lld %d%n", &is_dir,
+			&size, &mtime, &duration, &n) == 4 && line[n] == ' ') {
+			sLibraryEntry entry;
+
+			entry.Name = line + n + 1;
+			entry.Dir = is_dir;
+			entry.Size = size;
+			entry.Mtime = mtime;
+			entry.Duration = duration;
+			dir->Entries.push_back(entry);
+		}
+	}
+	fclose(f);
+	Debug2(L_MEDIA, "Library: %d directories loaded", (int)Dirs.size());
+}
+
+/**
+**	Store the index in the cache directory.
+*/
+void cSoftHdLibrary::Save(void)
+{
+	cString name = CacheFile();
+	cString tmp = cString::sprintf("%s.tmp", *name);
+	FILE *f;
+
+	if (!(f = fopen(tmp, "w"))) {
+		Error("Mediaplayer: can't write library %s: %m", *tmp);
+		return;
+	}
+
+	Mutex.Lock();
+	fprintf(f, "%s\n%s\n", MEDIA_LIBRARY_MAGIC, Root.c_str());
+	for (std::map<string, sLibraryDir>::iterator dir = Dirs.begin();
+		dir != Dirs.end(); ++dir) {
+		fprintf(f, "D %lld %s\n", (long long)dir->second.Mtime,
+			dir->first.c_str());
+		for (size_t i = 0; i < dir->second.Entries.size(); i++) {
+			const sLibraryEntry &entry = dir->second.Entries[i];
+
+			fprintf(f, "F %d %lld %lld %d %s\n", entry.Dir,
+				(long long)entry.Size, (long long)entry.Mtime,
+				entry.Duration, entry.Name.c_str());
+		}
+	}
+	Dirty = false;
+	Mutex.Unlock();
+
+	if (fclose(f)) {
+		Error("Mediaplayer: can't write library %s: %m", *tmp);
+		unlink(tmp);
+		return;
+	}
+	rename(tmp, name);
+}
+
+/**
+**	Drop a directory and its subdirectories from the index.
+**
+**	Call with the mutex locked.
+*/
+void cSoftHdLibrary::Remove(const string &path)
+{
+	string prefix = path + "/";
+	std::map<string, sLibraryDir>::iterator dir = Dirs.find(path);
+
+	if (dir == Dirs.end())
+		return;
+	// subdirectories sort after the prefix, not after the directory
+	for (bool self = true; dir != Dirs.end() && (self
+		|| !dir->first.compare(0, prefix.size(), prefix)); self = false) {
+		if (dir->second.Watch >= 0) {
+			inotify_rm_watch(Inotify, dir->second.Watch);
+			Watches.erase(dir->second.Watch);
+		}
+		Dirs.erase(dir);
+		dir = Dirs.lower_bound(prefix);
+	}
+	Dirty = true;
+}
+
+/**
+**	Index a directory.
+**
+**	Unchanged directories aren't listed again, durations of unchanged
+**	files are kept.
+**
+**	@param path		directory
+**	@param recursive	also index subdirectories
+**	@param force		list even if the directory mtime is unchanged
+*/
+void cSoftHdLibrary::ScanDir(const string &path, bool recursive, bool force)
+{
+	std::vector<sLibraryEntry> entries;
+	std::map<string, sLibraryDir>::iterator old;
+	struct stat st;
+
+	if (!Running())
+		return;
+
+	if (stat(path.c_str(), &st) || !S_ISDIR(st.st_mode)) {
+		cMutexLock lock(&Mutex);
+
+		Remove(path);
+		return;
+	}
+
+	Mutex.Lock();
+	old = Dirs.find(path);
+	if (!force && old != Dirs.end() && old->second.Mtime == st.st_mtime) {
+		entries = old->second.Entries;
+	} else {
+		Mutex.Unlock();
+		if (!ReadDir(path, entries)) {
+			Error("Mediaplayer: library can't read %s: %m", path.c_str());
+			return;
+		}
+		Mutex.Lock();
+		old = Dirs.find(path);
+		if (old != Dirs.end()) {
+			std::map<string, const sLibraryEntry *> known;
+
+			for (size_t i = 0; i < old->second.Entries.size(); i++)
+				known[old->second.Entries[i].Name] = &old->second.Entries[i];
+			for (size_t i = 0; i < entries.size(); i++) {
+				std::map<string, const sLibraryEntry *>::iterator e =
+					known.find(entries[i].Name);
+
+				if (e == known.end())
+					continue;
+				if (!entries[i].Dir && e->second->Size == entries[i].Size
+					&& e->second->Mtime == entries[i].Mtime) {
+					entries[i].Duration = e->second->Duration;
+				}
+				known.erase(e);
+			}
+			// subdirectories gone
+			for (std::map<string, const sLibraryEntry *>::iterator e =
+				known.begin(); e != known.end(); ++e) {
+				if (e->second->Dir)
+					Remove(path + "/" + e->first);
+			}
+		}
+		Dirs[path].Mtime = st.st_mtime;
+		Dirs[path].Entries = entries;
+		Dirty = true;
+	}
+
+	sLibraryDir &dir = Dirs[path];
+
+	if (Inotify >= 0 && dir.Watch < 0) {
+		dir.Watch = inotify_add_watch(Inotify, path.c_str(),
+			MEDIA_LIBRARY_EVENTS | IN_ONLYDIR);
+		if (dir.Watch >= 0)
+			Watches[dir.Watch] = path;
+	}
+	Mutex.Unlock();
+
+	if (recursive) {
+		for (size_t i = 0; i < entries.size() && entries[i].Dir; i++)
+			ScanDir(path + "/" + entries[i].Name, true, false);
+	}
+}
+
+/**
+**	Update the index from inotify events.
+*/
+void cSoftHdLibrary::HandleEvents(void)
+{
+	char buf[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+	std::map<string, bool> changed;		// directory, rescan recursive
+	ssize_t len;
+
+	while ((len = read(Inotify, buf, sizeof(buf))) > 0) {
+		for (char *p = buf; p < buf + len;
+			p += sizeof(struct inotify_event) + ((struct inotify_event *)p)->len) {
+			struct inotify_event *event = (struct inotify_event *)p;
+			cMutexLock lock(&Mutex);
+			std::map<int, string>::iterator watch = Watches.find(event->wd);
+
+			if (watch == Watches.end())
+				continue;
+			if (event->mask & IN_IGNORED) {
+				std::map<string, sLibraryDir>::iterator dir =
+					Dirs.find(watch->second);
+
+				if (dir != Dirs.end())
+					dir->second.Watch = -1;
+				Watches.erase(watch);
+				continue;
+			}
+			// gone directories are dropped by the rescan
+			if (!changed.count(watch->second))
+				changed[watch->second] = false;
+			if ((event->mask & IN_ISDIR) && event->len
+				&& (event->mask & (IN_CREATE | IN_MOVED_TO))) {
+				changed[watch->second + "/" + event->name] = true;
+			}
+		}
+	}
+
+	for (std::map<string, bool>::iterator dir = changed.begin();
+		dir != changed.end(); ++dir) {
+		Debug2(L_MEDIA, "Library: %s changed", dir->first.c_str());
+		ScanDir(dir->first, dir->second, true);
+	}
+}
+
+/**
+**	Interrupt callback of libavformat, stops probing.
+*/
+int cSoftHdLibrary::Interrupt(void *opaque)
+{
+	return !((cSoftHdLibrary *)opaque)->Running();
+}
+
+/**
+**	Probe the duration of new media files.
+*/
+void cSoftHdLibrary::Probe(void)
+{
+	std::vector<string> files;
+
+	Mutex.Lock();
+	for (std::map<string, sLibraryDir>::iterator dir = Dirs.begin();
+		dir != Dirs.end(); ++dir) {
+		for (size_t i = 0; i < dir->second.Entries.size(); i++) {
+			const sLibraryEntry &entry = dir->second.Entries[i];
+
+			if (!entry.Dir && entry.Duration < 0 && IsMedia(entry.Name.c_str()))
+				files.push_back(dir->first + "/" + entry.Name);
+		}
+	}
+	Mutex.Unlock();
+
+	for (size_t i = 0; i < files.size() && Running(); i++) {
+		AVFormatContext *format = avformat_alloc_context();
+		string path = files[i].substr(0, files[i].find_last_of('/'));
+		string name = files[i].substr(files[i].find_last_of('/') + 1);
+		int duration = 0;
+
+		format->interrupt_callback.callback = Interrupt;
+		format->interrupt_callback.opaque = this;
+		if (!avformat_open_input(&format, files[i].c_str(), NULL, NULL)) {
+			// only streams without a header need the slow way
+			if (format->duration == AV_NOPTS_VALUE)
+				avformat_find_stream_info(format, NULL);
+			if (format->duration != AV_NOPTS_VALUE)
+				duration = format->duration / AV_TIME_BASE;
+			avformat_close_input(&format);
+		}
+		if (!Running())
+			break;
+
+		cMutexLock lock(&Mutex);
+		std::map<string, sLibraryDir>::iterator dir = Dirs.find(path);
+
+		if (dir == Dirs.end())
+			continue;
+		for (size_t j = 0; j < dir->second.Entries.size(); j++) {
+			if (dir->second.Entries[j].Name == name) {
+				dir->second.Entries[j].Duration = duration;
+				Dirty = true;
+				break;
+			}
+		}
+	}
+}
+
+/**
+**	Library thread, crawls and keeps the index up to date.
+*/
+void cSoftHdLibrary::Action(void)
+{
+	uint32_t rescan;
+	uint32_t start;
+
+	WakeRegister(WAKE_LIBRARY);
+	SetPriority(19);
+	SetIOPriority(7);
+
+	Load();
+	if ((Inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) < 0)
+		Warning("Mediaplayer: no inotify, library is updated every %ds",
+			MEDIA_LIBRARY_RESCAN);
+
+	start = GetMsTicks();
+	ScanDir(Root, true, false);
+	Info("Mediaplayer: library of %s, %d directories in %ums", Root.c_str(),
+		(int)Dirs.size(), GetMsTicks() - start);
+	rescan = GetMsTicks() + MEDIA_LIBRARY_RESCAN * 1000;
+
+	while (Running()) {
+		// without inotify only the stop event and the rescan wake up
+		struct pollfd fds[2] = {
+			{ StopEvent, POLLIN, 0 }, { Inotify, POLLIN, 0 } };
+		int timeout;
+
+		if (Dirty) {
+			Probe();
+			Save();
+		}
+		timeout = (int32_t)(rescan - GetMsTicks());
+		// no stop event, check for the stop once a second
+		if (StopEvent < 0 && timeout > 1000)
+			timeout = 1000;
+		if (timeout > 0) {
+			if (poll(fds, 2, timeout) > 0 && (fds[1].revents & POLLIN))
+				HandleEvents();
+			WakeCount();
+		}
+		// network shares don't report remote changes
+		if ((int32_t)(rescan - GetMsTicks()) <= 0) {
+			ScanDir(Root, true, false);
+			rescan = GetMsTicks() + MEDIA_LIBRARY_RESCAN * 1000;
+		}
+	}
+	if (Dirty)
+		Save();
+}
+
 //////////////////////////////////////////////////////////////////////////////
 //	cOsdMenu
 //////////////////////////////////////////////////////////////////////////////
@@ -530,63 +2009,44 @@ void cSoftHdMenu::SelectPL(void)
 */
 void cSoftHdMenu::FindFile(string SearchPath, FILE *playlist)
 {
-	struct dirent **DirList;
-	int n, i;
-	const char * sp;
+	cSoftHdLibrary *library = cSoftHdLibrary::Library();
+	std::vector<sLibraryEntry> entries;
+
+	// the media library answers without touching the disk
+	if (!library || !library->List(SearchPath, entries)) {
+		if (!cSoftHdLibrary::ReadDir(SearchPath, entries))
+			Error("FindFile: scanning directory %s failed (%d): %m",
+				SearchPath.size() ? SearchPath.c_str() : "/", errno);
+	}
 
-	if (!SearchPath.size())
-		sp = "/";
-	else sp = SearchPath.c_str();
+	if (playlist) {
+		for (size_t i = 0; i < entries.size(); i++) {
+			string str = SearchPath + "/" + entries[i].Name;
 
-	if (!playlist) {
-		Clear();
-		if (SearchPath.size())
-			Add(new cOsdItem("[..]"));
+			if (entries[i].Dir)
+				FindFile(str, playlist);
+			else if (TestMedia(entries[i].Name.c_str()))
+				fprintf(playlist, "%s\n", str.c_str());
+		}
+		return;
 	}
 
-	if ((n = scandir(sp, &DirList, NULL, alphasort)) == -1) {
-		Error("FindFile: scanning directory %s failed (%d): %m", sp, errno);
-	} else {
-		struct stat fileAttributs;
-		for (i = 0; i < n; i++) {
-			string str = SearchPath + "/" + DirList[i]->d_name;
-			if (stat(str.c_str(), &fileAttributs) == -1) {
-				Error("FindFile: stat on %s failed (%d): %m", str.c_str(), errno);
-			} else {
-			if (S_ISDIR(fileAttributs.st_mode) && DirList[i]->d_name[0] != '.') {
-				if (playlist) {
-					FindFile(str.c_str(), playlist);
-				} else {
-					Add(new cOsdItem(DirList[i]->d_name),
-						!LastItem.compare(0, LastItem.length(), DirList[i]->d_name));
-				}
-			}
-			}
-		}
-		for (i = 0; i < n; i++) {
-			string str = SearchPath + "/" + DirList[i]->d_name;
-			if (stat(str.c_str(), &fileAttributs) == -1) {
-				Error("FindFile: stat on %s failed (%d): %m", str.c_str(), errno);
-			} else {
-			if (S_ISREG(fileAttributs.st_mode) && DirList[i]->d_name[0] != '.') {
-				if (playlist) {
-					if (TestMedia(DirList[i]->d_name))
-						fprintf(playlist, "%s/%s\n", SearchPath.c_str(),
-							DirList[i]->d_name);
-				} else {
-					Add(new cOsdItem(DirList[i]->d_name));
-				}
-			}
-			}
+	Clear();
+	if (SearchPath.size())
+		Add(new cOsdItem("[..]"));
+	for (size_t i = 0; i < entries.size(); i++) {
+		if (entries[i].Dir) {
+			Add(new cOsdItem(entries[i].Name.c_str()),
+				!LastItem.compare(0, LastItem.length(), entries[i].Name));
+		} else {
+			Add(new cOsdItem(entries[i].Name.c_str()));
 		}
 	}
 
-	if (!playlist) {
-		SetHelp( Playlist.empty() ? "Play File" : "Play PL", "New PL", "Add to PL", NULL);
+	SetHelp( Playlist.empty() ? "Play File" : "Play PL", "New PL", "Add to PL", NULL);
 //		SetHelp(Control->Player->Running ? NULL : "Set new PL",
 //			Control->Player->Running ? "Play Menu" : "Select PL");
-		Display();
-	}
+	Display();
 }
 
 /**
@@ -691,6 +2151,7 @@ eOSState cSoftHdMenu::ProcessKey(eKeys key)
 		case kGreen:
 			if (cSoftHdControl::Control()) {
 				cSoftHdControl::Control()->Player()->Jump = -60;
+				cSoftHdControl::Control()->Player()->Wake();
 			} else {
 				MakePlayList(item->Text(), "w");
 				Interface->Confirm(tr("New Playlist"), 1, true);
@@ -703,6 +2164,7 @@ eOSState cSoftHdMenu::ProcessKey(eKeys key)
 		case kYellow:
 			if (cSoftHdControl::Control()) {
 				cSoftHdControl::Control()->Player()->Jump = 60;
+				cSoftHdControl::Control()->Player()->Wake();
 			} else {
 				MakePlayList(item->Text(), "a");
 				Interface->Confirm(tr("Added to Playlist"), 1, true);
@@ -718,8 +2180,10 @@ eOSState cSoftHdMenu::ProcessKey(eKeys key)
 			}
 			break;
 		case kNext:
-			if (cSoftHdControl::Control())
+			if (cSoftHdControl::Control()) {
 				cSoftHdControl::Control()->Player()->StopPlay = 1;
+				cSoftHdControl::Control()->Player()->Wake();
+			}
 			break;
 		default:
 			break;
@@ -28,10 +28,153 @@
 		struct PLEntry *NextEntry;
 	};
 
+struct AVCodecParameters;
+struct AVFormatContext;
+struct AVPacket;
+
+#define MEDIA_QUEUE_AUDIO_MS	2000	///< read ahead audio budget
+#define MEDIA_QUEUE_VIDEO_MS	2000	///< read ahead video budget
+#define MEDIA_QUEUE_MAX_BYTES	(32 * 1024 * 1024)	///< read ahead hard limit
+
+//////////////////////////////////////////////////////////////////////////////
+//	cDemuxer
+//////////////////////////////////////////////////////////////////////////////
+
+/**
+**	demuxed packet in the read ahead queue.
+*/
+class cMediaPacket : public cListObject
+{
+public:
+	cMediaPacket(AVPacket *packet, int ms, bool audio)
+		: Packet(packet), Ms(ms), Audio(audio) {}
+	AVPacket *Packet;
+	int Ms;				///< packet duration in ms
+	bool Audio;
+};
+
+/**
+**	read ahead demuxer for mediaplayer mode.
+**
+**	Reads packets in its own thread into a queue, bounded by a time
+**	budget for audio and video each.
+*/
+class cSoftHdDemuxer : public cThread
+{
+private:
+	AVFormatContext *Format;
+	int AudioIndex;
+	int VideoIndex;
+	cMutex Mutex;
+	cCondVar DataCond;		///< packet queued or end of file
+	cCondVar SpaceCond;		///< packet taken or seek request
+	cList<cMediaPacket> Queue;
+	int AudioMs;			///< queued audio duration
+	int VideoMs;			///< queued video duration
+	int Bytes;			///< queued bytes
+	int64_t LastPts[2];		///< last audio/video pts, to estimate durations
+	int Generation;			///< incremented with every seek
+	int SeekStream;
+	int64_t SeekTimestamp;
+	int SeekFlags;
+	bool SeekPending;
+	bool Eof;
+	int PacketMs(AVPacket *, bool);
+	bool Full(void);
+	void Drop(void);
+	static int Interrupt(void *);
+protected:
+	virtual void Action(void);
+public:
+	cSoftHdDemuxer(AVFormatContext *, int, int);
+	virtual ~cSoftHdDemuxer();
+	AVPacket *Get(bool *, int);
+	void Seek(int, int64_t, int = 0);
+	bool AtEnd(void);
+	bool ReadDone(void);
+	int QueuedMs(void);
+	void WaitQueued(int, int);
+};
+
+//////////////////////////////////////////////////////////////////////////////
+//	cIndex
+//////////////////////////////////////////////////////////////////////////////
+
+#define MEDIA_PREBUFFER_MS	500	///< read ahead after an indexed seek
+
+/**
+**	keyframe of a media file.
+*/
+struct sMediaIndexEntry {
+	int64_t Pos;			///< byte position
+	int64_t Pts;			///< pts in stream time base
+};
+
+/**
+**	keyframe index of a local media file.
+**
+**	Built in the background and stored in the plugin cache directory,
+**	so it is reused the next time the file is played.
+*/
+class cSoftHdIndex : public cThread
+{
+private:
+	string Path;
+	int Stream;			///< indexed stream
+	int64_t FileSize;
+	int64_t FileTime;
+	cMutex Mutex;
+	std::vector<sMediaIndexEntry> Entries;
+	bool Complete;			///< whole file indexed
+	cString CacheFile(void);
+	bool Load(void);
+	void Save(void);
+	static int Interrupt(void *);
+protected:
+	virtual void Action(void);
+public:
+	cSoftHdIndex(const char *, int);
+	virtual ~cSoftHdIndex();
+	static bool IsLocal(const char *);
+	bool Find(int64_t, int64_t *, int64_t *);
+};
+
 //////////////////////////////////////////////////////////////////////////////
 //	cPlayer
 //////////////////////////////////////////////////////////////////////////////
 
+#define MEDIA_PREOPEN_S		10	///< open next playlist entry before the end
+#define MEDIA_TRICK_STEP_MS	200	///< keyframe interval of fast forward/rewind
+#define MEDIA_TRICK_MAX		64	///< max. fast forward/rewind speed
+
+/**
+**	opens and probes the next playlist entry in the background.
+*/
+class cSoftHdOpener : public cThread
+{
+private:
+	string Url;
+	AVFormatContext *Format;
+	cCondWait Opened;		///< signalled when opening is done
+	static int Interrupt(void *);
+	void Open(void);
+protected:
+	virtual void Action(void);
+public:
+	cSoftHdOpener(const char *);
+	virtual ~cSoftHdOpener();
+	AVFormatContext *Take(const char *);
+};
+
+/**
+**	decoder setup, kept open between playlist entries.
+*/
+struct sMediaCodec {
+	AVCodecParameters *Par;		///< copy of the stream parameters
+	int TimeBaseNum;		///< stream time base
+	int TimeBaseDen;
+};
+
 /**
 **	player for mediaplayer mode.
 */
@@ -40,8 +183,16 @@ class cSoftHdPlayer : public cPlayer, cThread
 private:
 	void Player(const char *);
 	void ReadPL(const char *);
+	struct PLEntry *GetEntry(int);
 	char *Source;
 	int Entries;
+	struct PLEntry *Following;	///< entry played after the current
+	cSoftHdOpener *Opener;		///< pre-opens the following entry
+	sMediaCodec AudioCodec;
+	sMediaCodec VideoCodec;
+	bool Gapless;			///< previous entry played to its end
+	int64_t EndUs;			///< end of the fed packets in us
+	cCondWait Wakeup;		///< signalled on control changes
 protected:
 	virtual void Activate(bool On);
 	virtual void Action(void);
@@ -51,6 +202,7 @@ public:
 	struct PLEntry *FirstEntry;
 	struct PLEntry *CurrentEntry;
 	void SetEntry(int);
+	void Wake(void);
 	const char * GetTitle(void);
 	int Jump;
 	int Pause;
@@ -59,6 +211,8 @@ public:
 	int NoModify;
 	int CurrentTime;
 	int Duration;
+	int QueuedMs;			///< read ahead in ms
+	int Speed;			///< fast forward > 0, rewind < 0
 };
 
 //////////////////////////////////////////////////////////////////////////////
@@ -87,6 +241,72 @@ public:
 	int Close;
 };
 
+//////////////////////////////////////////////////////////////////////////////
+//	cLibrary
+//////////////////////////////////////////////////////////////////////////////
+
+#define MEDIA_LIBRARY_RESCAN	600	///< rescan interval in s, for NFS/SMB
+
+/**
+**	file or directory in the media library.
+*/
+struct sLibraryEntry {
+	string Name;
+	bool Dir;
+	int64_t Size;
+	time_t Mtime;
+	int Duration;			///< in s, 0 unknown, -1 not probed
+};
+
+/**
+**	indexed directory of the media library.
+*/
+struct sLibraryDir {
+	sLibraryDir() : Mtime(0), Watch(-1) {}
+	time_t Mtime;
+	int Watch;			///< inotify watch descriptor
+	std::vector<sLibraryEntry> Entries;	///< directories first
+};
+
+/**
+**	media library, indexes the video directory in the background.
+**
+**	Directories are crawled once and kept fresh with inotify and a
+**	periodic rescan, which only lists directories whose mtime changed.
+**	The index is stored in the plugin cache directory.
+*/
+class cSoftHdLibrary : public cThread
+{
+private:
+	static cSoftHdLibrary *pLibrary;
+	string Root;
+	cMutex Mutex;
+	std::map<string, sLibraryDir> Dirs;
+	std::map<int, string> Watches;
+	int Inotify;			///< inotify fd, -1 unsupported
+	int StopEvent;			///< eventfd, wakes up the thread to stop
+	bool Dirty;			///< changed since last save
+	cString CacheFile(void);
+	void Load(void);
+	void Save(void);
+	void ScanDir(const string &, bool, bool);
+	void Remove(const string &);
+	void HandleEvents(void);
+	void Probe(void);
+	static int Interrupt(void *);
+protected:
+	virtual void Action(void);
+public:
+	cSoftHdLibrary(const char *);
+	virtual ~cSoftHdLibrary();
+	static void Startup(const char *);
+	static void Shutdown(void);
+	static cSoftHdLibrary *Library() { return pLibrary; }
+	static bool IsMedia(const char *);
+	static bool ReadDir(const string &, std::vector<sLibraryEntry> &);
+	bool List(const string &, std::vector<sLibraryEntry> &);
+};
+
 //////////////////////////////////////////////////////////////////////////////
 //	cOsdMenu
 //////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,647 @@
+///
+///	@file misc.c	@brief Misc functions module
+///
+///	Copyright (c) 2020 by zille.  All Rights Reserved.
+///
+///	Contributor(s):
+///
+///	License: AGPLv3
+///
+///	This program is free software: you can redistribute it and/or modify
+///	it under the terms of the GNU Affero General Public License as
+///	published by the Free Software Foundation, either version 3 of the
+///	License.
+///
+///	This program is distributed in the hope that it will be useful,
+///	but WITHOUT ANY WARRANTY; without even the implied warranty of
+///	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+///	GNU Affero General Public License for more details.
+///
+///	$Id$
+//////////////////////////////////////////////////////////////////////////////
+
+///
+///	@defgroup misc The misc module.
+///
+///	Log messages are formatted by the calling thread and queued, a
+///	logger thread writes them to syslog. So the display, audio and
+///	decoder threads never block in syslog. Before the logger thread
+///	is started and after it is stopped the messages are written
+///	directly.
+///
+///	The memory accounting counts the big buffers of the subsystems.
+///	With a soft budget exceeded the subsystems shrink their pools and
+///	caches, with the hard budget exceeded they refuse to grow them.
+///
+///	All time queries and sleeps of the a/v pipeline go through the
+///	clock functions. With simulated time the clock only moves when
+///	ClockAdvance() is called, so a harness can replay sync scenarios
+///	deterministically and faster than real time. With stepped time a
+///	sleep advances the clock itself, a single thread can drive the
+///	display path without anybody else moving the clock.
+///
+///	The threads count their wakeups, every return from a sleep or a
+///	wait. Without work they should block and not wake up at all.
+///
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "misc.h"
+
+#define LOG_QUEUE_SIZE	256		///< queued log messages
+#define LOG_LINE_SIZE	512		///< max length of a log message
+
+    /// queued log message
+struct log_line
+{
+    int Level;				///< syslog level
+    char Text[LOG_LINE_SIZE];		///< formatted message
+};
+
+    /// enabled logging categories, the default is set at build time
+int LogCategories = 0
+#ifdef DEBUG
+    | L_DEBUG
+#endif
+#ifdef AV_SYNC_DEBUG
+    | L_AV_SYNC
+#endif
+#ifdef SOUND_DEBUG
+    | L_SOUND
+#endif
+#ifdef OSD_DEBUG
+    | L_OSD
+#endif
+#ifdef DRM_DEBUG
+    | L_DRM
+#endif
+#ifdef CODEC_DEBUG
+    | L_CODEC
+#endif
+#ifdef STILL_DEBUG
+    | L_STILL
+#endif
+#ifdef MEDIA_DEBUG
+    | L_MEDIA
+#endif
+#ifdef GL_DEBUG
+    | L_OPENGL
+#endif
+#ifdef GL_DEBUG_TIME
+    | L_OPENGL_TIME
+#endif
+#ifdef GL_DEBUG_TIME_ALL
+    | L_OPENGL_TIME_ALL
+#endif
+    ;
+
+    /// names of the logging categories, used by SVDRP
+static const char *LogCategoryNames[L_CATEGORIES] = {
+    "debug", "av_sync", "sound", "osd", "drm", "codec", "still", "media",
+    "opengl", "opengl_time", "opengl_time_all",
+};
+
+    /// message prefix of the logging categories
+static const char *LogCategoryPrefix[L_CATEGORIES] = {
+    "", "[AV_Sync]", "[Sound]", "[Osd]", "[Drm]", "[Codec]", "[Still]",
+    "[Media]", "[OpenGL]", "[OpenGL]", "[OpenGL]",
+};
+
+static struct log_line LogQueue[LOG_QUEUE_SIZE];	///< message queue
+static int LogRead;			///< queue read index
+static int LogFilled;			///< queued messages
+static int LogDropped;			///< messages lost, queue was full
+static pthread_mutex_t LogMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t LogCond = PTHREAD_COND_INITIALIZER;
+static pthread_t LogThread;		///< logger thread
+static int LogRunning;			///< logger thread takes messages
+
+static __thread pid_t LogThreadId;	///< cached thread id of the caller
+
+static long MemBytes[MEM_SUBSYSTEMS];	///< bytes used per subsystem
+static long MemSoftBudget;		///< soft budget in bytes, 0 none
+static long MemHardBudget;		///< hard budget in bytes, 0 none
+static int MemLastPressure;		///< pressure level of the last check
+
+static volatile int ClockSimulated;	///< enum ClockMode of the clock
+static uint64_t ClockSimTime;		///< simulated time in us
+static pthread_mutex_t ClockMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t ClockCond = PTHREAD_COND_INITIALIZER;
+
+static __thread int WakeThreadId;	///< wakeup counter of the caller
+static unsigned WakeCounts[WAKE_THREADS];	///< wakeups per thread
+static unsigned WakeLastCounts[WAKE_THREADS];	///< counts of the last report
+static uint64_t WakeLastTime;		///< time of the last report in us
+
+    /// names of the threads with wakeup counter, used by SVDRP
+static const char *WakeThreadNames[WAKE_THREADS] = {
+    "other", "video decode", "video filter", "video display", "audio",
+    "osd", "library",
+};
+
+    /// names of the memory subsystems, used by SVDRP
+static const char *MemSubsystemNames[MEM_SUBSYSTEMS] = {
+    "video packets", "audio", "drm buffers", "gpu images",
+    "gpu framebuffers", "glyphs",
+};
+
+/**
+**	Format and queue a log message.
+**
+**	Use the Error(), Warning(), Info(), Debug() and Debug2() macros,
+**	they skip the call and the evaluation of the arguments if the
+**	message isn't wanted.
+**
+**	@param level	syslog level
+**	@param cat	logging category of debug messages
+**	@param format	printf format
+*/
+void Syslog(const int level, const int cat, const char *format, ...)
+{
+	struct log_line line;
+	const char *prefix;
+	va_list ap;
+	int n;
+
+	if (!LogThreadId) {
+		LogThreadId = syscall(__NR_gettid);
+	}
+	prefix = "";
+	if (level == LOG_DEBUG && cat) {
+		prefix = LogCategoryPrefix[__builtin_ctz(cat) % L_CATEGORIES];
+	}
+	n = snprintf(line.Text, sizeof(line.Text), "[%d] [softhddevice]%s ",
+		LogThreadId, prefix);
+	va_start(ap, format);
+	vsnprintf(line.Text + n, sizeof(line.Text) - n, format, ap);
+	va_end(ap);
+
+	pthread_mutex_lock(&LogMutex);
+	if (!LogRunning) {
+		pthread_mutex_unlock(&LogMutex);
+		syslog(level, "%s", line.Text);
+		return;
+	}
+	if (LogFilled < LOG_QUEUE_SIZE) {
+		struct log_line *slot;
+
+		slot = &LogQueue[(LogRead + LogFilled) % LOG_QUEUE_SIZE];
+		slot->Level = level;
+		strcpy(slot->Text, line.Text);
+		LogFilled++;
+		pthread_cond_signal(&LogCond);
+	} else {
+		LogDropped++;
+	}
+	pthread_mutex_unlock(&LogMutex);
+}
+
+/**
+**	Logger thread, writes the queued messages to syslog.
+*/
+static void *LogHandlerThread( __attribute__ ((unused)) void *dummy)
+{
+	struct log_line line;
+	int dropped;
+
+	pthread_mutex_lock(&LogMutex);
+	for (;;) {
+		while (!LogFilled && LogRunning) {
+			pthread_cond_wait(&LogCond, &LogMutex);
+		}
+		if (!LogFilled) {
+			break;
+		}
+		line = LogQueue[LogRead];
+		LogRead = (LogRead + 1) % LOG_QUEUE_SIZE;
+		LogFilled--;
+		dropped = LogDropped;
+		LogDropped = 0;
+		pthread_mutex_unlock(&LogMutex);
+
+		if (dropped) {
+			syslog(LOG_WARNING, "[softhddevice] %d log messages dropped",
+				dropped);
+		}
+		syslog(line.Level, "%s", line.Text);
+
+		pthread_mutex_lock(&LogMutex);
+	}
+	pthread_mutex_unlock(&LogMutex);
+
+	return NULL;
+}
+
+/**
+**	Wait until the queued log messages are written.
+**
+**	Gives up after one second, used before abort().
+*/
+void LogFlush(void)
+{
+	int i;
+
+	for (i = 0; i < 1000; ++i) {
+		pthread_mutex_lock(&LogMutex);
+		if (!LogFilled || !LogRunning) {
+			pthread_mutex_unlock(&LogMutex);
+			break;
+		}
+		pthread_mutex_unlock(&LogMutex);
+		usleep(1000);
+	}
+}
+
+/**
+**	Start the logger thread.
+*/
+void LogStart(void)
+{
+	pthread_mutex_lock(&LogMutex);
+	if (!LogRunning && !pthread_create(&LogThread, NULL, LogHandlerThread, NULL)) {
+		pthread_setname_np(LogThread, "softhddev log");
+		LogRunning = 1;
+	}
+	pthread_mutex_unlock(&LogMutex);
+}
+
+/**
+**	Write the queued messages and stop the logger thread.
+*/
+void LogStop(void)
+{
+	pthread_mutex_lock(&LogMutex);
+	if (!LogRunning) {
+		pthread_mutex_unlock(&LogMutex);
+		return;
+	}
+	// new messages are written directly, the thread writes the queue
+	LogRunning = 0;
+	pthread_cond_signal(&LogCond);
+	pthread_mutex_unlock(&LogMutex);
+
+	pthread_join(LogThread, NULL);
+}
+
+/**
+**	Change the enabled logging categories.
+**
+**	A list of category names separated by spaces or commas, a name
+**	with '-' disables the category, with '+' or without it enables
+**	it. "all" and "none" change all categories.
+**
+**	@param list	category names
+**
+**	@returns new category mask, -1 for an unknown name
+*/
+int LogSetCategories(const char *list)
+{
+	char name[32];
+	int mask;
+	int n;
+
+	mask = LogCategories;
+	while (sscanf(list, " %31[^ ,]%n", name, &n) == 1) {
+		const char *s;
+		int enable;
+		int bits;
+		int i;
+
+		list += n;
+		while (*list == ',') {
+			list++;
+		}
+
+		s = name;
+		enable = *s != '-';
+		if (*s == '-' || *s == '+') {
+			s++;
+		}
+		if (!strcasecmp(s, "all")) {
+			bits = (1 << L_CATEGORIES) - 1;
+		} else if (!strcasecmp(s, "none")) {
+			bits = (1 << L_CATEGORIES) - 1;
+			enable = !enable;
+		} else {
+			for (i = 0; i < L_CATEGORIES; ++i) {
+				if (!strcasecmp(s, LogCategoryNames[i])) {
+					break;
+				}
+			}
+			if (i == L_CATEGORIES) {
+				return -1;
+			}
+			bits = 1 << i;
+		}
+		mask = enable ? mask | bits : mask & ~bits;
+	}
+
+	LogCategories = mask;
+	return mask;
+}
+
+/**
+**	Get the enabled and available logging categories as text.
+**
+**	@param buf	output buffer
+**	@param size	size of the output buffer
+*/
+void LogGetCategories(char *buf, int size)
+{
+	int n;
+	int i;
+
+	n = snprintf(buf, size, "enabled:");
+	for (i = 0; i < L_CATEGORIES && n < size; ++i) {
+		if (LogCategories & (1 << i)) {
+			n += snprintf(buf + n, size - n, " %s", LogCategoryNames[i]);
+		}
+	}
+	if (n < size) {
+		n += snprintf(buf + n, size - n, "\navailable:");
+	}
+	for (i = 0; i < L_CATEGORIES && n < size; ++i) {
+		n += snprintf(buf + n, size - n, " %s", LogCategoryNames[i]);
+	}
+}
+
+/**
+**	Count allocated or freed bytes of a subsystem.
+**
+**	@param subsystem	enum MemSubsystem
+**	@param bytes		allocated bytes, negative if freed
+*/
+void MemAccount(int subsystem, long bytes)
+{
+	__atomic_add_fetch(&MemBytes[subsystem], bytes, __ATOMIC_RELAXED);
+}
+
+/**
+**	Get the bytes used by a subsystem.
+**
+**	@param subsystem	enum MemSubsystem
+*/
+long MemUsed(int subsystem)
+{
+	return __atomic_load_n(&MemBytes[subsystem], __ATOMIC_RELAXED);
+}
+
+/**
+**	Get the memory pressure level.
+**
+**	Cheap enough to be checked whenever a pool or cache grows. A change
+**	of the level is logged.
+**
+**	@returns enum MemPressureLevel
+*/
+int MemPressure(void)
+{
+	long total;
+	int level;
+	int i;
+
+	total = 0;
+	for (i = 0; i < MEM_SUBSYSTEMS; ++i) {
+		total += MemUsed(i);
+	}
+	level = MEM_PRESSURE_NONE;
+	if (MemHardBudget && total > MemHardBudget) {
+		level = MEM_PRESSURE_HARD;
+	} else if (MemSoftBudget && total > MemSoftBudget) {
+		level = MEM_PRESSURE_SOFT;
+	}
+
+	if (__atomic_exchange_n(&MemLastPressure, level, __ATOMIC_RELAXED) != level) {
+		Warning("memory: %s, %ld MB used, budget soft %ld MB hard %ld MB",
+			level == MEM_PRESSURE_HARD ? "hard budget exceeded" :
+			level == MEM_PRESSURE_SOFT ? "soft budget exceeded" :
+			"within budget", total >> 20, MemSoftBudget >> 20,
+			MemHardBudget >> 20);
+	}
+	return level;
+}
+
+/**
+**	Set the memory budgets.
+**
+**	@param soft	soft budget in MB, 0 none
+**	@param hard	hard budget in MB, 0 none
+*/
+void MemSetBudget(int soft, int hard)
+{
+	MemSoftBudget = (long)soft << 20;
+	MemHardBudget = (long)hard << 20;
+}
+
+/**
+**	Get the memory usage as text.
+**
+**	@param buf	output buffer
+**	@param size	size of the output buffer
+*/
+void MemGetReport(char *buf, int size)
+{
+	static const char *levels[] = { "none", "soft", "hard" };
+	long total;
+	int n;
+	int i;
+
+	n = 0;
+	total = 0;
+	for (i = 0; i < MEM_SUBSYSTEMS && n < size; ++i) {
+		total += MemUsed(i);
+		n += snprintf(buf + n, size - n, "%-17s %10ld bytes\n",
+			MemSubsystemNames[i], MemUsed(i));
+	}
+	if (n < size) {
+		snprintf(buf + n, size - n, "%-17s %10ld bytes\n"
+			"budget soft %ld MB, hard %ld MB, pressure %s", "total", total,
+			MemSoftBudget >> 20, MemHardBudget >> 20,
+			levels[MemPressure()]);
+	}
+}
+
+/**
+**	Get the monotonic time.
+**
+**	@returns time in us, the simulated time if enabled
+*/
+uint64_t ClockGetTime(void)
+{
+	struct timespec tspec;
+
+	if (ClockSimulated) {
+		return __atomic_load_n(&ClockSimTime, __ATOMIC_ACQUIRE);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &tspec);
+	return tspec.tv_sec * 1000000ULL + tspec.tv_nsec / 1000;
+}
+
+/**
+**	Sleep some time.
+**
+**	With simulated time the caller waits until the clock is advanced
+**	far enough, or the simulation is switched off. With stepped time
+**	the clock is advanced by the sleep.
+**
+**	@param us	time to sleep in us
+*/
+void ClockSleep(unsigned us)
+{
+	uint64_t wakeup;
+
+	WakeCount();
+	if (!ClockSimulated) {
+		usleep(us);
+		return;
+	}
+	if (ClockSimulated == CLOCK_STEPPED) {
+		ClockAdvance(us);
+		return;
+	}
+	pthread_mutex_lock(&ClockMutex);
+	wakeup = ClockSimTime + us;
+	while (ClockSimulated && ClockSimTime < wakeup) {
+		pthread_cond_wait(&ClockCond, &ClockMutex);
+	}
+	pthread_mutex_unlock(&ClockMutex);
+}
+
+/**
+**	Switch between simulated and real time.
+**
+**	The simulated time starts at the current monotonic time, sleeping
+**	threads are woken up when it is switched off.
+**
+**	@param mode	enum ClockMode
+*/
+void ClockSimulate(int mode)
+{
+	uint64_t now;
+
+	now = ClockGetTime();
+	pthread_mutex_lock(&ClockMutex);
+	if (mode && !ClockSimulated) {
+		__atomic_store_n(&ClockSimTime, now, __ATOMIC_RELEASE);
+	}
+	ClockSimulated = mode;
+	pthread_cond_broadcast(&ClockCond);
+	pthread_mutex_unlock(&ClockMutex);
+}
+
+/**
+**	Get the clock mode.
+**
+**	@returns enum ClockMode
+*/
+int ClockGetMode(void)
+{
+	return ClockSimulated;
+}
+
+/**
+**	Advance the simulated time.
+**
+**	@param us	time step in us
+*/
+void ClockAdvance(unsigned us)
+{
+	pthread_mutex_lock(&ClockMutex);
+	__atomic_store_n(&ClockSimTime, ClockSimTime + us, __ATOMIC_RELEASE);
+	pthread_cond_broadcast(&ClockCond);
+	pthread_mutex_unlock(&ClockMutex);
+}
+
+/**
+**	Join a thread, which was asked to stop.
+**
+**	The threads stop at their next wait, a thread which is stuck
+**	somewhere else is canceled as last resort. A wait of a thread,
+**	which may be canceled, unlocks its mutex in a cleanup handler.
+**
+**	@param thread	thread to join
+**	@param name	thread name for the log
+**	@param timeout	max wait in ms
+**
+**	@returns 0 if the thread stopped in time, -1 if it was canceled
+*/
+int ThreadJoin(pthread_t thread, const char *name, int timeout)
+{
+	struct timespec abstime;
+
+	clock_gettime(CLOCK_REALTIME, &abstime);
+	abstime.tv_sec += timeout / 1000;
+	abstime.tv_nsec += (timeout % 1000) * 1000000L;
+	if (abstime.tv_nsec >= 1000000000L) {
+		abstime.tv_sec++;
+		abstime.tv_nsec -= 1000000000L;
+	}
+	if (!pthread_timedjoin_np(thread, NULL, &abstime)) {
+		return 0;
+	}
+	Error("%s thread doesn't stop in %dms, canceled", name, timeout);
+	pthread_cancel(thread);
+	pthread_join(thread, NULL);
+	return -1;
+}
+
+/**
+**	Register the calling thread for the wakeup counter.
+**
+**	@param thread	enum WakeThread
+*/
+void WakeRegister(int thread)
+{
+	WakeThreadId = thread;
+}
+
+/**
+**	Count a wakeup of the calling thread.
+*/
+void WakeCount(void)
+{
+	__atomic_add_fetch(&WakeCounts[WakeThreadId], 1, __ATOMIC_RELAXED);
+}
+
+/**
+**	Get the wakeups per second of the threads as text.
+**
+**	The rates are averaged since the last report, the first report
+**	only starts the measurement.
+**
+**	@param buf	output buffer
+**	@param size	size of the output buffer
+*/
+void WakeGetReport(char *buf, int size)
+{
+	uint64_t now;
+	double secs;
+	unsigned count;
+	int n;
+	int i;
+
+	now = ClockGetTime();
+	secs = (now - WakeLastTime) / 1e6;
+
+	n = 0;
+	for (i = 0; i < WAKE_THREADS && n < size; ++i) {
+		count = __atomic_load_n(&WakeCounts[i], __ATOMIC_RELAXED);
+		if (WakeLastTime) {
+			n += snprintf(buf + n, size - n, "%-13s %8.1f/s\n",
+				WakeThreadNames[i], (count - WakeLastCounts[i]) / secs);
+		}
+		WakeLastCounts[i] = count;
+	}
+	if (!WakeLastTime) {
+		snprintf(buf, size, "wakeup measurement started, ask again");
+	} else if (n < size) {
+		snprintf(buf + n, size - n, "over %.1fs", secs);
+	}
+	WakeLastTime = now;
+}
@@ -33,6 +33,7 @@ extern "C"
 #include <syslog.h>
 #include <stdarg.h>
 #include <time.h>			// clock_gettime
+#include <pthread.h>
 #include <sys/syscall.h>
 
 //////////////////////////////////////////////////////////////////////////////
@@ -51,8 +52,53 @@ extern "C"
 #define L_OPENGL_TIME      (1 << 9)
 #define L_OPENGL_TIME_ALL  (1 << 10)
 
+#define L_CATEGORIES       11		///< number of logging categories
+
+    /// memory accounting subsystems
+enum MemSubsystem
+{
+    MEM_VIDEO_PACKETS,			///< video packet ring buffer
+    MEM_AUDIO,				///< audio ring buffer
+    MEM_DRM,				///< DRM dumb buffers, video and osd
+    MEM_GPU_IMAGES,			///< OpenGL image cache
+    MEM_GPU_FBS,			///< OpenGL pixmap and cached layer framebuffers
+    MEM_GLYPHS,				///< OpenGL glyph textures and font atlases
+    MEM_SUBSYSTEMS
+};
+
+    /// memory pressure levels
+enum MemPressureLevel
+{
+    MEM_PRESSURE_NONE,			///< within the budgets
+    MEM_PRESSURE_SOFT,			///< soft budget exceeded, shrink caches
+    MEM_PRESSURE_HARD,			///< hard budget exceeded, refuse to grow
+};
+
+    /// clock modes
+enum ClockMode
+{
+    CLOCK_REAL,				///< monotonic clock
+    CLOCK_SIMULATED,			///< moved by ClockAdvance() only
+    CLOCK_STEPPED,			///< moved by ClockAdvance() and sleeps
+};
+
+    /// threads with a wakeup counter
+enum WakeThread
+{
+    WAKE_OTHER,				///< not registered threads
+    WAKE_VIDEO_DECODE,			///< video decode thread
+    WAKE_VIDEO_FILTER,			///< deinterlace filter thread
+    WAKE_VIDEO_DISPLAY,			///< video display thread
+    WAKE_AUDIO,				///< alsa play thread
+    WAKE_OSD,				///< OpenGL osd worker thread
+    WAKE_LIBRARY,			///< media library thread
+    WAKE_THREADS
+};
+
 typedef unsigned char uchar;
 
+extern int LogCategories;		///< enabled logging categories
+
 /**
 **	Show error.
 */
@@ -61,7 +107,7 @@ typedef unsigned char uchar;
 /**
 **	Show fatal error.
 */
-#define Fatal(fmt...) do { Error(fmt); abort(); } while (0)
+#define Fatal(fmt...) do { Error(fmt); LogFlush(); abort(); } while (0)
 
 /**
 **	Show warning.
@@ -76,12 +122,14 @@ typedef unsigned char uchar;
 /**
 **	Show debug.
 */
-#define Debug(fmt...) Syslog(LOG_DEBUG, L_DEBUG, fmt)
+#define Debug(fmt...) Debug2(L_DEBUG, fmt)
 
 /**
 **	Show debug with logging category.
+**
+**	The arguments are only evaluated if the category is enabled.
 */
-#define Debug2(cat, fmt...) Syslog(LOG_DEBUG, cat, fmt)
+#define Debug2(cat, fmt...) (void)( (LogCategories & (cat)) ? Syslog(LOG_DEBUG, cat, fmt) : (void)0 )
 
 #ifndef AV_NOPTS_VALUE
 #define AV_NOPTS_VALUE INT64_C(0x8000000000000000)
@@ -91,97 +139,71 @@ typedef unsigned char uchar;
 //	Prototypes
 //////////////////////////////////////////////////////////////////////////////
 
-static inline void Syslog(const int, const int, const char *format, ...)
+    /// queue a log message for the logger thread
+extern void Syslog(const int, const int, const char *format, ...)
     __attribute__ ((format(printf, 3, 4)));
 
+    /// wait until the queued log messages are written
+extern void LogFlush(void);
+
+    /// start the logger thread
+extern void LogStart(void);
+
+    /// flush the queue and stop the logger thread
+extern void LogStop(void);
+
+    /// change the enabled logging categories
+extern int LogSetCategories(const char *);
+
+    /// enabled and available logging categories as text
+extern void LogGetCategories(char *, int);
+
+    /// count allocated or freed bytes of a subsystem
+extern void MemAccount(int, long);
+
+    /// bytes used by a subsystem
+extern long MemUsed(int);
+
+    /// current memory pressure level
+extern int MemPressure(void);
+
+    /// set the soft and hard memory budget in MB, 0 no budget
+extern void MemSetBudget(int, int);
+
+    /// memory usage per subsystem and budgets as text
+extern void MemGetReport(char *, int);
+
+    /// monotonic time in us, the simulated time if enabled
+extern uint64_t ClockGetTime(void);
+
+    /// sleep us, in simulated time until the clock is advanced
+extern void ClockSleep(unsigned);
+
+    /// switch to simulated time or back to the monotonic clock
+extern void ClockSimulate(int);
+
+    /// current clock mode as enum ClockMode
+extern int ClockGetMode(void);
+
+    /// advance the simulated time by us
+extern void ClockAdvance(unsigned);
+
+    /// join a stopping thread, cancel it after the timeout in ms
+extern int ThreadJoin(pthread_t, const char *, int);
+
+    /// count the wakeups of the calling thread as enum WakeThread
+extern void WakeRegister(int);
+
+    /// count a wakeup of the calling thread
+extern void WakeCount(void);
+
+    /// wakeups per second of each thread since the last report
+extern void WakeGetReport(char *, int);
+
 //////////////////////////////////////////////////////////////////////////////
 //	Inlines
 //////////////////////////////////////////////////////////////////////////////
 
-/**
-**	Syslog output function.
-*/
-static inline void Syslog(const int level, const int cat, const char *format, ...)
-{
-	int DebugLogLevel = 0;
-#ifdef DEBUG
-	DebugLogLevel |= L_DEBUG;
-#endif
-#ifdef AV_SYNC_DEBUG
-	DebugLogLevel |= L_AV_SYNC;
-#endif
-#ifdef SOUND_DEBUG
-	DebugLogLevel |= L_SOUND;
-#endif
-#ifdef OSD_DEBUG
-	DebugLogLevel |= L_OSD;
-#endif
-#ifdef DRM_DEBUG
-	DebugLogLevel |= L_DRM;
-#endif
-#ifdef CODEC_DEBUG
-	DebugLogLevel |= L_CODEC;
-#endif
-#ifdef STILL_DEBUG
-	DebugLogLevel |= L_STILL;
-#endif
-#ifdef MEDIA_DEBUG
-	DebugLogLevel |= L_MEDIA;
-#endif
-#ifdef GL_DEBUG
-	DebugLogLevel |= L_OPENGL;
-#endif
-#ifdef GL_DEBUG_TIME
-	DebugLogLevel |= L_OPENGL_TIME;
-#endif
-#ifdef GL_DEBUG_TIME_ALL
-	DebugLogLevel |= L_OPENGL_TIME_ALL;
-#endif
-	va_list ap;
-	char fmt[256];
-	char prefix[20] = "";
-
-	if (level == LOG_DEBUG) {
-		switch (DebugLogLevel & cat) {
-		case L_DEBUG:
-			break;
-		case L_AV_SYNC:
-			strcpy(prefix, "[AV_Sync]");
-			break;
-		case L_SOUND:
-			strcpy(prefix, "[Sound]");
-			break;
-		case L_OSD:
-			strcpy(prefix, "[Osd]");
-			break;
-		case L_DRM:
-			strcpy(prefix, "[Drm]");
-			break;
-		case L_CODEC:
-			strcpy(prefix, "[Codec]");
-			break;
-		case L_STILL:
-			strcpy(prefix, "[Still]");
-			break;
-		case L_MEDIA:
-			strcpy(prefix, "[Media]");
-			break;
-		case L_OPENGL:
-		case L_OPENGL_TIME:
-		case L_OPENGL_TIME_ALL:
-			strcpy(prefix, "[OpenGL]");
-			break;
-		default:
-			return;
-		}
-	}
-	pid_t threadId = syscall(__NR_gettid);
-	snprintf(fmt, sizeof(fmt), "[%d] [softhddevice]%s %s", threadId, prefix, format);
-	va_start(ap, format);
-	vsyslog(level, fmt, ap);
-	va_end(ap);
-}
-
 /**
 **	Nice time-stamp string.
 **
@@ -210,19 +232,7 @@ static inline const char *Timestamp2String(int64_t ts)
 */
 static inline uint32_t GetMsTicks(void)
 {
-#ifdef CLOCK_MONOTONIC
-    struct timespec tspec;
-
-    clock_gettime(CLOCK_MONOTONIC, &tspec);
-    return (tspec.tv_sec * 1000) + (tspec.tv_nsec / (1000 * 1000));
-#else
-    struct timeval tval;
-
-    if (gettimeofday(&tval, NULL) < 0) {
-	return 0;
-    }
-    return (tval.tv_sec * 1000) + (tval.tv_usec / 1000);
-#endif
+    return ClockGetTime() / 1000;
 }
 
 /**
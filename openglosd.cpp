@@ -9,6 +9,7 @@
 #include <string>
 #endif
 #include <sys/ioctl.h>
+#include <unistd.h>
 
 #include "misc.h"
 
@@ -274,6 +275,36 @@ void main() \
 } \
 ";
 
+const char *textureFragmentShaderPalette = 
+"#version 100 \n\
+precision mediump float; \
+varying vec2 TexCoords; \
+varying vec4 alphaValue; \
+varying vec4 bColorValue; \
+\
+uniform sampler2D screenTexture; \
+uniform sampler2D paletteTexture; \
+uniform vec4 fgColor; \
+uniform vec4 bgColor; \
+uniform vec2 paletteMode; \
+\
+void main() \
+{ \
+    float index = floor(texture2D(screenTexture, TexCoords).r * 255.0 + 0.5); \
+    vec4 color = texture2D(paletteTexture, vec2((index + 0.5) / 256.0, 0.5)); \
+    color = vec4(color.b, color.g, color.r, color.a); \
+    if (paletteMode.x > 0.5) { \
+        if (index == 0.0) \
+            color = bgColor; \
+        else if (index == 1.0) \
+            color = fgColor; \
+    } \
+    if (paletteMode.y > 0.5 && index == 0.0) \
+        color = vec4(0.0, 0.0, 0.0, 0.0); \
+    gl_FragColor = color * alphaValue; \
+} \
+";
+
 const char *textVertexShader = 
 "#version 100 \n\
 \
@@ -311,6 +342,149 @@ void main() \
 
 static cShader *Shaders[stCount]; 
 
+/*
+ * Linked programs are kept in the plugin cache directory with
+ * GL_OES_get_program_binary. The file name is a hash of the driver
+ * identity and the shader sources, so a driver update or a changed
+ * shader invalidates the cache.
+ */
+#define SHADER_BINARY_MAGIC 0x53484442   // "SHDB"
+
+struct sShaderBinaryHeader {
+    uint32_t magic;
+    uint32_t format;
+    uint32_t length;
+    uint32_t compileMs;
+};
+
+static PFNGLGETPROGRAMBINARYOESPROC GetProgramBinary = NULL;
+static PFNGLPROGRAMBINARYOESPROC ProgramBinary = NULL;
+
+static uint64_t HashString(uint64_t hash, const char *s) {
+    // FNV-1a
+    while (s && *s) {
+        hash ^= (unsigned char)*s++;
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+void cShader::InitBinaryCache(void) {
+    GLint formats = 0;
+    const char *extensions = (const char *)glGetString(GL_EXTENSIONS);
+
+    GetProgramBinary = NULL;
+    ProgramBinary = NULL;
+    if (!extensions || !strstr(extensions, "GL_OES_get_program_binary"))
+        return;
+    GL_CHECK(glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS_OES, &formats));
+    if (formats <= 0)
+        return;
+
+    GetProgramBinary = (PFNGLGETPROGRAMBINARYOESPROC)eglGetProcAddress("glGetProgramBinaryOES");
+    ProgramBinary = (PFNGLPROGRAMBINARYOESPROC)eglGetProcAddress("glProgramBinaryOES");
+    if (!GetProgramBinary || !ProgramBinary) {
+        GetProgramBinary = NULL;
+        ProgramBinary = NULL;
+        return;
+    }
+    Debug2(L_OPENGL, "Shader: program binary cache in %s", cPlugin::CacheDirectory(PLUGIN_NAME_I18N));
+}
+
+cString cShader::BinaryFileName(const char *vertexCode, const char *fragmentCode) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+
+    hash = HashString(hash, (const char *)glGetString(GL_VENDOR));
+    hash = HashString(hash, (const char *)glGetString(GL_RENDERER));
+    hash = HashString(hash, (const char *)glGetString(GL_VERSION));
+    hash = HashString(hash, vertexCode);
+    hash = HashString(hash, fragmentCode);
+
+    return cString::sprintf("%s/shader-%d-%016" PRIx64 ".bin", cPlugin::CacheDirectory(PLUGIN_NAME_I18N), type, hash);
+}
+
+bool cShader::LoadBinary(const char *fileName) {
+    sShaderBinaryHeader header;
+    GLint success = 0;
+    bool ret = false;
+    void *data = NULL;
+    long size;
+    cTimeMs timer;
+
+    FILE *fp = fopen(fileName, "rb");
+    if (!fp)
+        return false;
+
+    if (fseek(fp, 0, SEEK_END) || (size = ftell(fp)) < 0 || fseek(fp, 0, SEEK_SET))
+        goto out;
+    if (fread(&header, sizeof(header), 1, fp) != 1 || header.magic != SHADER_BINARY_MAGIC)
+        goto out;
+    // a truncated or corrupt cache file
+    if (!header.length || header.length > (unsigned long)size - sizeof(header))
+        goto out;
+    if (!(data = malloc(header.length)))
+        goto out;
+    if (fread(data, header.length, 1, fp) != 1)
+        goto out;
+
+    GL_CHECK(id = glCreateProgram());
+    GL_CHECK(ProgramBinary(id, header.format, data, header.length));
+    GL_CHECK(glGetProgramiv(id, GL_LINK_STATUS, &success));
+    if (!success) {
+        // driver rejected the binary, compile it again
+        GL_CHECK(glDeleteProgram(id));
+        id = 0;
+        goto out;
+    }
+    ret = true;
+    cached = true;
+    savedMs = std::max(0, (int)header.compileMs - (int)timer.Elapsed());
+
+out:
+    free(data);
+    fclose(fp);
+    if (!ret) {
+        Debug2(L_OPENGL, "Shader: invalid program binary %s", fileName);
+        unlink(fileName);
+    }
+    return ret;
+}
+
+void cShader::SaveBinary(const char *fileName, int compileMs) {
+    sShaderBinaryHeader header;
+    GLint length = 0;
+    GLenum format;
+
+    GL_CHECK(glGetProgramiv(id, GL_PROGRAM_BINARY_LENGTH_OES, &length));
+    if (length <= 0)
+        return;
+
+    void *data = malloc(length);
+    if (!data)
+        return;
+    GL_CHECK(GetProgramBinary(id, length, &length, &format, data));
+
+    header.magic = SHADER_BINARY_MAGIC;
+    header.format = format;
+    header.length = length;
+    header.compileMs = compileMs;
+
+    // a crash while writing doesn't leave a corrupt binary behind
+    cString tmp = cString::sprintf("%s.tmp", fileName);
+    FILE *fp = fopen(tmp, "wb");
+    if (fp) {
+        if (fwrite(&header, sizeof(header), 1, fp) != 1 || fwrite(data, length, 1, fp) != 1) {
+            Error("Shader: could not write program binary %s", *tmp);
+            fclose(fp);
+            unlink(tmp);
+        } else if (fclose(fp) || rename(tmp, fileName)) {
+            Error("Shader: could not write program binary %s", fileName);
+            unlink(tmp);
+        }
+    }
+    free(data);
+}
+
 void cShader::Use(void) {
     GL_CHECK(glUseProgram(id));
 }
@@ -334,6 +508,10 @@ bool cShader::Load(eShaderType type) {
             vertexCode = textureVertexShader;
             fragmentCode = textureFragmentShaderSwapBR;
             break;
+        case stTexturePalette:
+            vertexCode = textureVertexShader;
+            fragmentCode = textureFragmentShaderPalette;
+            break;
         case stText:
             vertexCode = textVertexShader;
             fragmentCode = textFragmentShader;
@@ -381,6 +559,14 @@ void cShader::SetMatrix4(const GLchar *name, const glm::mat4 &matrix) {
 
 bool cShader::Compile(const char *vertexCode, const char *fragmentCode) {
     GLuint sVertex, sFragment;
+    cString binaryFile;
+    cTimeMs timer;
+
+    if (ProgramBinary) {
+        binaryFile = BinaryFileName(vertexCode, fragmentCode);
+        if (LoadBinary(binaryFile))
+            return true;
+    }
     // Vertex Shader
     GL_CHECK(sVertex = glCreateShader(GL_VERTEX_SHADER));
     GL_CHECK(glShaderSource(sVertex, 1, &vertexCode, NULL));
@@ -405,6 +591,8 @@ bool cShader::Compile(const char *vertexCode, const char *fragmentCode) {
     // Delete the shaders as they're linked into our program now and no longer necessery
     GL_CHECK(glDeleteShader(sVertex));
     GL_CHECK(glDeleteShader(sFragment));
+    if (GetProgramBinary)
+        SaveBinary(binaryFile, timer.Elapsed());
     return true;
 }
 
@@ -444,8 +632,10 @@ cOglGlyph::cOglGlyph(FT_ULong charCode, FT_BitmapGlyph ftGlyph) {
 }
 
 cOglGlyph::~cOglGlyph(void) {
-    if (texture)
+    if (texture) {
         GL_CHECK(glDeleteTextures(1, &texture));
+        MemAccount(MEM_GLYPHS, -(long)width * height);
+    }
 }
 
 int cOglGlyph::GetKerningCache(FT_ULong prevSym) {
@@ -481,6 +671,7 @@ void cOglGlyph::LoadTexture(FT_BitmapGlyph ftGlyph) {
         GL_UNSIGNED_BYTE,
         ftGlyph->bitmap.buffer
     ));
+    MemAccount(MEM_GLYPHS, (long)ftGlyph->bitmap.width * ftGlyph->bitmap.rows);
 
     // Set texture options
     GL_CHECK(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE));
@@ -532,6 +723,7 @@ void cOglAtlasGlyph::SetKerningCache(FT_ULong prevSym, int kerning) {
 ****************************************************************************************/
 cOglFontAtlas::cOglFontAtlas(FT_Face face, int height) {
     this->fontheight = height;
+    tex = 0;
 
     FT_Set_Pixel_Sizes(face, 0, height);
     FT_GlyphSlot g = face->glyph;
@@ -608,6 +800,7 @@ cOglFontAtlas::cOglFontAtlas(FT_Face face, int height) {
         GL_UNSIGNED_BYTE,
         0
     ));
+    MemAccount(MEM_GLYPHS, (long)w * h);
 
     GL_CHECK(glPixelStorei(GL_UNPACK_ALIGNMENT, 1));
     GL_CHECK(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE));
@@ -697,8 +890,10 @@ cOglFontAtlas::cOglFontAtlas(FT_Face face, int height) {
 }
 
 cOglFontAtlas::~cOglFontAtlas(void) {
-    if (tex)
+    if (tex) {
         GL_CHECK(glDeleteTextures(1, &tex));
+        MemAccount(MEM_GLYPHS, -(long)w * h);
+    }
 }
 
 cOglAtlasGlyph* cOglFontAtlas::GetGlyph(int sym) const {
@@ -749,6 +944,7 @@ cOglFont::cOglFont(const char *fontName, int charHeight) : name(fontName) {
 }
 
 cOglFont::~cOglFont(void) {
+    delete atlas;
     FT_Done_Face(face);
 }
 
@@ -775,6 +971,17 @@ void cOglFont::Init(void) {
     initiated = true;
 }
 
+/**
+ * Drop the glyph textures of all fonts, they are rendered again when
+ * used. The font atlases are kept.
+ */
+void cOglFont::DropGlyphs(void) {
+    if (!fonts)
+        return;
+    for (cOglFont *font = fonts->First(); font; font = fonts->Next(font))
+        font->glyphCache.Clear();
+}
+
 void cOglFont::Cleanup(void) {
     if (!initiated)
         return;
@@ -899,8 +1106,10 @@ cOglFb::cOglFb(GLint width, GLint height, GLint viewPortWidth, GLint viewPortHei
 }
 
 cOglFb::~cOglFb(void) {
-    if (texture)
+    if (texture) {
         GL_CHECK(glDeleteTextures(1, &texture));
+        MemAccount(MEM_GPU_FBS, -(long)width * height * 4);
+    }
     if (fb)
         GL_CHECK(glDeleteFramebuffers(1, &fb));
 }
@@ -910,6 +1119,7 @@ bool cOglFb::Init(void) {
     GL_CHECK(glGenTextures(1, &texture));
     GL_CHECK(glBindTexture(GL_TEXTURE_2D, texture));
     GL_CHECK(glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL));
+    MemAccount(MEM_GPU_FBS, (long)width * height * 4);
     GL_CHECK(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR));
     GL_CHECK(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR));
     GL_CHECK(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE));
@@ -979,6 +1189,7 @@ bool cOglOutputFb::Init(void) {
     GL_CHECK(glGenTextures(1, &texture));
     GL_CHECK(glBindTexture(GL_TEXTURE_2D, texture));
     GL_CHECK(glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL));
+    MemAccount(MEM_GPU_FBS, (long)width * height * 4);
     GL_CHECK(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR));
     GL_CHECK(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR));
     GL_CHECK(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE));
@@ -1046,6 +1257,13 @@ bool cOglVb::Init(void) {
         numVertices = 6;
         drawMode = GL_TRIANGLES;
         shader = stTextureSwapBR;
+    } else if (type == vbTexturePalette) {
+        //Texture VBO definition, 8bit index texture with palette lookup
+        sizeVertex1 = 2;
+        sizeVertex2 = 2;
+        numVertices = 6;
+        drawMode = GL_TRIANGLES;
+        shader = stTexturePalette;
     } else if (type == vbRect) {
         //Rectangle VBO definition
         sizeVertex1 = 2;
@@ -1140,6 +1358,16 @@ void cOglVb::SetShaderAlpha(GLint alpha) {
     Shaders[shader]->SetVector4f("alpha", 1.0f, 1.0f, 1.0f, (GLfloat)(alpha) / 255.0f);
 }
 
+void cOglVb::SetShaderPalette(GLint texture, GLint colorFg, GLint colorBg, bool specialColors, bool overlay) {
+    glm::vec4 fg, bg;
+    ConvertColor(colorFg, fg);
+    ConvertColor(colorBg, bg);
+    Shaders[shader]->SetInteger("paletteTexture", texture);
+    Shaders[shader]->SetVector4f("fgColor", fg.r, fg.g, fg.b, fg.a);
+    Shaders[shader]->SetVector4f("bgColor", bg.r, bg.g, bg.b, bg.a);
+    Shaders[shader]->SetVector2f("paletteMode", specialColors ? 1.0f : 0.0f, overlay ? 1.0f : 0.0f);
+}
+
 void cOglVb::SetShaderProjectionMatrix(GLint width, GLint height) {
     glm::mat4 projection = glm::ortho(0.0f, (GLfloat)width, (GLfloat)height, 0.0f, -1.0f, 1.0f);
     Shaders[shader]->SetMatrix4("projection", projection);
@@ -1280,12 +1508,26 @@ bool cOglCmdRenderFbToBufferFb::Execute(void) {
     return true;
 }
 
+//------------------ cOglCmdSetOsdAlpha --------------------
+cOglCmdSetOsdAlpha::cOglCmdSetOsdAlpha(GLint alpha) : cOglCmd(NULL) {
+    this->alpha = alpha;
+}
+
+bool cOglCmdSetOsdAlpha::Execute(void) {
+    // queued behind the rendering, so the plane alpha changes with the content.
+    // A fade service call may have changed it meanwhile, ask the video output.
+    if (OsdGetAlpha() != alpha)
+        OsdSetAlpha(alpha, 0);
+    return true;
+}
+
 //------------------ cOglCmdCopyBufferToOutputFb --------------------
-cOglCmdCopyBufferToOutputFb::cOglCmdCopyBufferToOutputFb(cOglFb *fb, cOglOutputFb *oFb, GLint x, GLint y, int active) : cOglCmd(fb) {
+cOglCmdCopyBufferToOutputFb::cOglCmdCopyBufferToOutputFb(cOglFb *fb, cOglOutputFb *oFb, GLint x, GLint y, int active, GLint alpha) : cOglCmd(fb) {
     this->oFb = oFb;
     this->x = (GLfloat)x;
     this->y = (GLfloat)y;
     this->bcolor = BORDERCOLOR;
+    this->alpha = alpha;
     this->active = active;
 }
 
@@ -1315,7 +1557,7 @@ bool cOglCmdCopyBufferToOutputFb::Execute(void) {
     };
 
     VertexBuffers[vbTexture]->ActivateShader();
-    VertexBuffers[vbTexture]->SetShaderAlpha(255);
+    VertexBuffers[vbTexture]->SetShaderAlpha(alpha);
     VertexBuffers[vbTexture]->SetShaderProjectionMatrix(oFb->Width(), oFb->Height());
     VertexBuffers[vbTexture]->SetShaderBorderColor(bcolor);
 
@@ -1936,6 +2178,111 @@ bool cOglCmdDrawImage::Execute(void) {
     return true;
 }
 
+//------------------ cOglCmdDrawBitmap --------------------
+cOglCmdDrawBitmap::cOglCmdDrawBitmap(cOglFb *fb, tIndex *indices, tColor *palette, GLint width, GLint height, GLint x, GLint y, tColor colorFg, tColor colorBg, bool overlay): cOglCmd(fb) {
+    this->indices = indices;
+    this->palette = palette;
+    this->x = x;
+    this->y = y;
+    this->width = width;
+    this->height = height;
+    this->colorFg = colorFg;
+    this->colorBg = colorBg;
+    this->overlay = overlay;
+}
+
+cOglCmdDrawBitmap::~cOglCmdDrawBitmap(void) {
+    free(indices);
+    free(palette);
+}
+
+bool cOglCmdDrawBitmap::Execute(void) {
+    if (width <= 0 || height <= 0)
+        return false;
+
+    // index plane, one byte per pixel, must not be filtered
+    GLuint textures[2];
+    GL_CHECK(glGenTextures(2, textures));
+    GL_CHECK(glPixelStorei(GL_UNPACK_ALIGNMENT, 1));
+    GL_CHECK(glBindTexture(GL_TEXTURE_2D, textures[0]));
+    GL_CHECK(glTexImage2D(
+        GL_TEXTURE_2D,
+        0,
+        GL_LUMINANCE,
+        width,
+        height,
+        0,
+        GL_LUMINANCE,
+        GL_UNSIGNED_BYTE,
+        indices
+    ));
+    GL_CHECK(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE));
+    GL_CHECK(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE));
+    GL_CHECK(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST));
+    GL_CHECK(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST));
+    GL_CHECK(glPixelStorei(GL_UNPACK_ALIGNMENT, 4));
+
+    // palette, 256 x 1 ARGB
+    GL_CHECK(glBindTexture(GL_TEXTURE_2D, textures[1]));
+    GL_CHECK(glTexImage2D(
+        GL_TEXTURE_2D,
+        0,
+        GL_RGBA,
+        256,
+        1,
+        0,
+        GL_RGBA,
+        GL_UNSIGNED_BYTE,
+        palette
+    ));
+    GL_CHECK(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE));
+    GL_CHECK(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE));
+    GL_CHECK(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST));
+    GL_CHECK(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST));
+    GL_CHECK(glBindTexture(GL_TEXTURE_2D, 0));
+
+    GLfloat x1 = x;          //left
+    GLfloat y1 = y;          //top
+    GLfloat x2 = x + width;  //right
+    GLfloat y2 = y + height; //bottom
+
+    GLfloat quadVertices[] = {
+        x1, y2,   0.0, 1.0,     // left bottom
+        x1, y1,   0.0, 0.0,     // left top
+        x2, y1,   1.0, 0.0,     // right top
+
+        x1, y2,   0.0, 1.0,     // left bottom
+        x2, y1,   1.0, 0.0,     // right top
+        x2, y2,   1.0, 1.0      // right bottom
+    };
+
+    VertexBuffers[vbTexturePalette]->ActivateShader();
+    VertexBuffers[vbTexturePalette]->SetShaderAlpha(255);
+    VertexBuffers[vbTexturePalette]->SetShaderProjectionMatrix(fb->Width(), fb->Height());
+    VertexBuffers[vbTexturePalette]->SetShaderTexture(0);
+    VertexBuffers[vbTexturePalette]->SetShaderPalette(1, colorFg, colorBg, colorFg || colorBg, overlay);
+
+    fb->Bind();
+    GL_CHECK(glActiveTexture(GL_TEXTURE1));
+    GL_CHECK(glBindTexture(GL_TEXTURE_2D, textures[1]));
+    GL_CHECK(glActiveTexture(GL_TEXTURE0));
+    GL_CHECK(glBindTexture(GL_TEXTURE_2D, textures[0]));
+    VertexBuffers[vbTexturePalette]->DisableBlending();
+    VertexBuffers[vbTexturePalette]->Bind();
+    VertexBuffers[vbTexturePalette]->SetVertexSubData(quadVertices);
+    VertexBuffers[vbTexturePalette]->DrawArrays();
+    VertexBuffers[vbTexturePalette]->Unbind();
+    VertexBuffers[vbTexturePalette]->EnableBlending();
+    fb->Unbind();
+    GL_CHECK(glActiveTexture(GL_TEXTURE1));
+    GL_CHECK(glBindTexture(GL_TEXTURE_2D, 0));
+    GL_CHECK(glActiveTexture(GL_TEXTURE0));
+    GL_CHECK(glBindTexture(GL_TEXTURE_2D, 0));
+    GL_CHECK(glDeleteTextures(2, textures));
+
+    return true;
+}
+
 //------------------ cOglCmdDrawTexture --------------------
 cOglCmdDrawTexture::cOglCmdDrawTexture(cOglFb *fb, sOglImage *imageRef, GLint x, GLint y, double scaleX, double scaleY): cOglCmd(fb) {
     this->imageRef = imageRef;
@@ -2031,12 +2378,17 @@ bool cOglCmdDropImage::Execute(void) {
 /******************************************************************************
 * cOglThread
 ******************************************************************************/
-cOglThread::cOglThread(cCondWait *startWait, int maxCacheSize) : cThread("oglThread") {
+cOglThread::cOglThread(cCondWait *startWait, int maxCacheSize, int maxLayerCacheSize) : cThread("oglThread") {
     stalled = false;
+    flushMs = 0;
+    commandCount = 0;
     memCached = 0;
     this->maxCacheSize = maxCacheSize * 1024 * 1024;
+    memLayers = 0;
+    this->maxLayerCacheSize = (long)maxLayerCacheSize * 1024 * 1024;
     this->startWait = startWait;
     wait = new cCondWait();
+    pthread_mutex_init(&cmdMutex, NULL);
     maxTextureSize = 0;
     for (int i = 0; i < OGL_MAX_OSDIMAGES; i++) {
         imageCache[i].used = false;
@@ -2051,6 +2403,7 @@ cOglThread::cOglThread(cCondWait *startWait, int maxCacheSize) : cThread("oglThr
 cOglThread::~cOglThread() {
     delete wait;
     wait = NULL;
+    pthread_mutex_destroy(&cmdMutex);
 }
 
 void cOglThread::Stop(void) {
@@ -2059,6 +2412,9 @@ void cOglThread::Stop(void) {
             DropImageData(i);
         }
     }
+    // the worker sleeps until the next command, wake it up to exit
+    Cancel(-1);
+    wait->Signal();
     Cancel(2);
     stalled = false;
 }
@@ -2068,11 +2424,11 @@ void cOglThread::DoCmd(cOglCmd* cmd) {
         cCondWait::SleepMs(10);
 
     bool doSignal = false;
-    Lock();
+    TraceMutexLock(cmdMutex);
     if (commands.size() == 0)
         doSignal = true;
     commands.push(cmd);
-    Unlock();
+    TraceMutexUnlock(cmdMutex);
 
     if (commands.size() > OGL_CMDQUEUE_SIZE) {
         stalled = true;
@@ -2097,6 +2453,11 @@ int cOglThread::StoreImage(const cImage &image) {
         return 0;
     }
 
+    if (MemPressure() == MEM_PRESSURE_HARD) {
+        Warning("cannot store image, memory hard budget exceeded");
+        return 0;
+    }
+
     int imgSize = image.Width() * image.Height();
     int newMemUsed = imgSize * sizeof(tColor) + memCached;
     if (newMemUsed > maxCacheSize) {
@@ -2136,11 +2497,12 @@ int cOglThread::StoreImage(const cImage &image) {
     }
 
     memCached += imgSize  * sizeof(tColor);
+    MemAccount(MEM_GPU_IMAGES, imgSize * sizeof(tColor));
     return slot;
 }
 
 int cOglThread::GetFreeSlot(void) {
-    Lock();
+    TraceMutexLock(cmdMutex);
     int slot = 0;
     for (int i = 0; i < OGL_MAX_OSDIMAGES && !slot; i++) {
         if (!imageCache[i].used) {
@@ -2148,19 +2510,19 @@ int cOglThread::GetFreeSlot(void) {
             slot = -i - 1;
         }
     }
-    Unlock();
+    TraceMutexUnlock(cmdMutex);
     return slot;
 }
 
 void cOglThread::ClearSlot(int slot) {
     int i = -slot - 1;
     if (i >= 0 && i < OGL_MAX_OSDIMAGES) {
-        Lock();
+        TraceMutexLock(cmdMutex);
         imageCache[i].used = false;    
         imageCache[i].texture = GL_NONE;
         imageCache[i].width = 0;
         imageCache[i].height = 0;
-        Unlock();
+        TraceMutexUnlock(cmdMutex);
     }
 }
 
@@ -2177,12 +2539,109 @@ void cOglThread::DropImageData(int imageHandle) {
         return;
     int imgSize = imageRef->width * imageRef->height * sizeof(tColor);
     memCached -= imgSize;
+    MemAccount(MEM_GPU_IMAGES, -imgSize);
     cCondWait dropWait;
     DoCmd(new cOglCmdDropImage(imageRef, &dropWait));
     dropWait.Wait();
     ClearSlot(imageHandle);
 }
 
+/**
+ * Keep the framebuffer of a destroyed pixmap in the layer cache.
+ *
+ * The cache is a lru list, least recently stored layers are dropped
+ * when the budget is exceeded.
+ *
+ * @returns true if the cache took over the framebuffer
+ */
+bool cOglThread::StoreLayer(const char *key, int layer, const cRect &viewPort, int generation, cOglFb *fb) {
+    long size = (long)fb->Width() * fb->Height() * sizeof(tColor);
+    if (!maxLayerCacheSize || size > maxLayerCacheSize || !fb->Initiated())
+        return false;
+    // the cache is emptied by the worker thread under memory pressure
+    if (MemPressure())
+        return false;
+
+    cVector<cOglFb *> dropped;
+    TraceMutexLock(cmdMutex);
+    // a layer with the same key is outdated now
+    for (cOglLayer *l = layerCache.First(); l; l = layerCache.Next(l)) {
+        if (!strcmp(l->key, key)) {
+            memLayers -= l->Size();
+            dropped.Append(l->fb);
+            layerCache.Del(l);
+            break;
+        }
+    }
+    while (memLayers + size > maxLayerCacheSize && layerCache.First()) {
+        cOglLayer *l = layerCache.First();
+        Debug2(L_OPENGL, "layer cache: drop %s (%.2fMB)", *l->key, l->Size() / 1024.0f / 1024.0f);
+        memLayers -= l->Size();
+        dropped.Append(l->fb);
+        layerCache.Del(l);
+    }
+    layerCache.Add(new cOglLayer(key, layer, viewPort, generation, fb));
+    memLayers += size;
+    TraceMutexUnlock(cmdMutex);
+
+    for (int i = 0; i < dropped.Size(); i++)
+        DoCmd(new cOglCmdDeleteFb(dropped[i]));
+    Debug2(L_OPENGL, "layer cache: store %s generation %d, used %.2fMB", key, generation, memLayers / 1024.0f / 1024.0f);
+    return true;
+}
+
+/**
+ * Take a framebuffer out of the layer cache.
+ *
+ * @returns framebuffer if layer, viewport and generation match, NULL otherwise
+ */
+cOglFb *cOglThread::TakeLayer(const char *key, int layer, const cRect &viewPort, int generation) {
+    cOglFb *fb = NULL;
+    cOglFb *outdated = NULL;
+
+    TraceMutexLock(cmdMutex);
+    for (cOglLayer *l = layerCache.First(); l; l = layerCache.Next(l)) {
+        if (strcmp(l->key, key))
+            continue;
+        memLayers -= l->Size();
+        if (l->layer == layer && l->viewPort == viewPort && l->generation == generation)
+            fb = l->fb;
+        else
+            outdated = l->fb;
+        layerCache.Del(l);
+        break;
+    }
+    TraceMutexUnlock(cmdMutex);
+
+    if (outdated)
+        DoCmd(new cOglCmdDeleteFb(outdated));
+    Debug2(L_OPENGL, "layer cache: %s %s generation %d", fb ? "reuse" : "miss", key, generation);
+    return fb;
+}
+
+/**
+ * Drop the layer cache under memory pressure, and the glyph textures
+ * too when the hard budget is exceeded.
+ *
+ * Runs in the worker thread between two commands, so the framebuffers
+ * and textures are deleted directly.
+ */
+void cOglThread::ReleaseMemory(void) {
+    cVector<cOglFb *> dropped;
+
+    TraceMutexLock(cmdMutex);
+    for (cOglLayer *l = layerCache.First(); l; l = layerCache.Next(l))
+        dropped.Append(l->fb);
+    layerCache.Clear();
+    memLayers = 0;
+    TraceMutexUnlock(cmdMutex);
+
+    for (int i = 0; i < dropped.Size(); i++)
+        delete dropped[i];
+    if (MemPressure() == MEM_PRESSURE_HARD)
+        cOglFont::DropGlyphs();
+    Debug2(L_OPENGL, "memory pressure: dropped %d cached layers", dropped.Size());
+}
 
 void cOglThread::Action(void) {
     if (!InitOpenGL()) {
@@ -2214,41 +2673,45 @@ void cOglThread::Action(void) {
     stalled = false;
 
     Info("OpenGL context initialized");
-#ifdef GL_DEBUG_TIME
     uint64_t start_flush = 0;
     uint64_t end_flush = 0;
     int time_reset = 0;
-#endif
+    WakeRegister(WAKE_OSD);
     while(Running()) {
 
         if (commands.empty()) {
-            wait->Wait(20);
+            wait->Wait(0);
+            WakeCount();
             continue;
         }
 
-        Lock();
+        TraceMutexLock(cmdMutex);
         cOglCmd* cmd = commands.front();
         commands.pop();
-        Unlock();
-#ifdef GL_DEBUG_TIME
+        TraceMutexUnlock(cmdMutex);
+#ifdef GL_DEBUG_TIME_ALL
         uint64_t start = cTimeMs::Now();
+#endif
         if (strcmp(cmd->Description(), "InitFramebuffer") == 0 || time_reset) {
             start_flush = cTimeMs::Now();
             time_reset = 0;
         }
-#endif
         cmd->Execute();
+        commandCount++;
 #ifdef GL_DEBUG_TIME_ALL
         Debug2(L_OPENGL_TIME_ALL, "\"%-*s\", %dms, %d commands left, time %" PRIu64 "", 15, cmd->Description(), (int)(cTimeMs::Now() - start), (int)(commands.size()), cTimeMs::Now());
 #endif
 
-#ifdef GL_DEBUG_TIME
         if (strcmp(cmd->Description(), "Copy buffer to OutputFramebuffer") == 0) {
             end_flush = cTimeMs::Now();
             time_reset = 1;
-            Debug2(L_OPENGL_TIME, "OSD Flush %dms, time %" PRIu64 "", (int)(end_flush - start_flush), cTimeMs::Now());
-        }
+            flushMs = (int)(end_flush - start_flush);
+#ifdef GL_DEBUG_TIME
+            Debug2(L_OPENGL_TIME, "OSD Flush %dms, time %" PRIu64 "", flushMs, cTimeMs::Now());
 #endif
+            if (MemPressure())
+                ReleaseMemory();
+        }
         delete cmd;
         if (stalled && commands.size() < OGL_CMDQUEUE_SIZE / 2)
             stalled = false;
@@ -2287,13 +2750,23 @@ bool cOglThread::InitOpenGL(void) {
 }
 
 bool cOglThread::InitShaders(void) {
+    cTimeMs timer;
+    int cached = 0;
+    int savedMs = 0;
+
+    cShader::InitBinaryCache();
     for (int i=0; i < stCount; i++) {
         cShader *shader = new cShader();
         if (!shader->Load((eShaderType)i))
             return false;
         Shaders[i] = shader;
+        if (shader->Cached()) {
+            cached++;
+            savedMs += shader->SavedMs();
+        }
     }
-    Debug2(L_OPENGL, "Shaders initialized");
+    Info("Shaders initialized in %dms, %d of %d from binary cache (saved %dms)",
+         (int)timer.Elapsed(), cached, stCount, savedMs);
     return true;
 }
 
@@ -2320,6 +2793,10 @@ void cOglThread::DeleteVertexBuffers(void) {
 }
 
 void cOglThread::Cleanup(void) {
+    for (cOglLayer *l = layerCache.First(); l; l = layerCache.Next(l))
+        delete l->fb;
+    layerCache.Clear();
+    memLayers = 0;
     DeleteVertexBuffers();
     delete cOglOsd::oFb;
     cOglOsd::oFb = NULL;
@@ -2345,6 +2822,9 @@ cOglPixmap::cOglPixmap(std::shared_ptr<cOglThread> oglThread, int Layer, const c
 
     fb = new cOglFb(width, height, ViewPort.Width(), ViewPort.Height());
     dirty = true;
+    alphaOnly = false;
+    blank = true;
+    layerGeneration = 0;
 
 #ifdef GRIDPOINTS
     // Creates a tiny font with height GRIDPOINTSTXTSIZE
@@ -2355,12 +2835,45 @@ cOglPixmap::cOglPixmap(std::shared_ptr<cOglThread> oglThread, int Layer, const c
 cOglPixmap::~cOglPixmap(void) {
     if (!oglThread->Active())
         return;
-    oglThread->DoCmd(new cOglCmdDeleteFb(fb));
+    // a retained layer survives its osd
+    if (!*layerKey || !oglThread->StoreLayer(layerKey, Layer(), ViewPort(), layerGeneration, fb))
+        oglThread->DoCmd(new cOglCmdDeleteFb(fb));
 #ifdef GRIDPOINTS
     delete tinyfont;
 #endif
 }
 
+/**
+ * Retain the rendered content of this pixmap across osds.
+ *
+ * The skin identifies the content by key and generation, it has to
+ * change the generation whenever it draws something different.
+ *
+ * @returns true if the content was restored from the layer cache, the
+ * pixmap must not be drawn again then
+ */
+bool cOglPixmap::Retain(const char *key, int generation) {
+    if (!oglThread->Active() || !key)
+        return false;
+    LOCK_PIXMAPS;
+    layerKey = key;
+    layerGeneration = generation;
+
+    cOglFb *cached = oglThread->TakeLayer(key, Layer(), ViewPort(), generation);
+    if (!cached)
+        return false;
+    if (cached->Width() != fb->Width() || cached->Height() != fb->Height()) {
+        oglThread->DoCmd(new cOglCmdDeleteFb(cached));
+        return false;
+    }
+
+    oglThread->DoCmd(new cOglCmdDeleteFb(fb));
+    fb = cached;
+    blank = false;
+    MarkViewPortDirty(ViewPort());
+    return true;
+}
+
 void cOglPixmap::MarkViewPortDirty(const cRect &Rect) {
     cPixmap::MarkViewPortDirty(Rect);
     SetDirty();
@@ -2379,8 +2892,11 @@ void cOglPixmap::SetLayer(int Layer) {
 void cOglPixmap::SetAlpha(int Alpha) {
     Alpha = constrain(Alpha, ALPHA_TRANSPARENT, ALPHA_OPAQUE);
     if (Alpha != cPixmap::Alpha()) {
+        // remember if only the alpha changed, the osd may fade without rendering
+        bool onlyAlpha = !dirty || alphaOnly;
         cPixmap::SetAlpha(Alpha);
         SetDirty();
+        alphaOnly = onlyAlpha;
     }
 }
 
@@ -2407,6 +2923,7 @@ void cOglPixmap::Clear(void) {
     oglThread->DoCmd(new cOglCmdFill(fb, clrTransparent));
     SetDirty();
     MarkDrawPortDirty(DrawPort());
+    blank = true;
 }
 
 void cOglPixmap::Fill(tColor Color) {
@@ -2416,6 +2933,7 @@ void cOglPixmap::Fill(tColor Color) {
     oglThread->DoCmd(new cOglCmdFill(fb, Color));
     SetDirty();
     MarkDrawPortDirty(DrawPort());
+    blank = !(Color & 0xFF000000);
 }
 
 void cOglPixmap::DrawImage(const cPoint &Point, const cImage &Image) {
@@ -2470,21 +2988,21 @@ void cOglPixmap::DrawBitmap(const cPoint &Point, const cBitmap &Bitmap, tColor C
     if (!oglThread->Active())
         return;
     LOCK_PIXMAPS;
-    bool specialColors = ColorFg || ColorBg;
-    tColor *argb = MALLOC(tColor, Bitmap.Width() * Bitmap.Height());
-    if (!argb)
+    // the color lookup is done by the shader, just hand over indices and palette
+    int numColors;
+    const tColor *colors = Bitmap.Colors(numColors);
+    tIndex *indices = MALLOC(tIndex, Bitmap.Width() * Bitmap.Height());
+    tColor *palette = (tColor *)calloc(256, sizeof(tColor));
+    if (!indices || !palette) {
+        free(indices);
+        free(palette);
         return;
+    }
 
-    tColor *p = argb;
-    for (int py = 0; py < Bitmap.Height(); py++)
-        for (int px = 0; px < Bitmap.Width(); px++) {
-                tIndex index = *Bitmap.Data(px, py);
-                *p++ = (!index && Overlay) ? clrTransparent : (specialColors ?
-                        (index == 0 ? ColorBg : index == 1 ? ColorFg :
-                                Bitmap.Color(index)) : Bitmap.Color(index));
-        }
+    memcpy(indices, Bitmap.Data(0, 0), Bitmap.Width() * Bitmap.Height());
+    memcpy(palette, colors, numColors * sizeof(tColor));
 
-    oglThread->DoCmd(new cOglCmdDrawImage(fb, argb, Bitmap.Width(), Bitmap.Height(), Point.X(), Point.Y(), true));
+    oglThread->DoCmd(new cOglCmdDrawBitmap(fb, indices, palette, Bitmap.Width(), Bitmap.Height(), Point.X(), Point.Y(), ColorFg, ColorBg, Overlay));
 #ifdef GRIDRECT
     DrawGridRect(cRect(Point.X(), Point.Y(), Bitmap.Width(), Bitmap.Height()), GRIDPOINTOFFSET, GRIDPOINTSIZE, GRIDPOINTCLR, GRIDPOINTBG, tinyfont);
 #endif
@@ -2729,8 +3247,10 @@ cOglOsd::cOglOsd(int Left, int Top, uint Level, std::shared_ptr<cOglThread> oglT
     int osdHeight = 0;
     double pixel_aspect;
     dirtyViewport = new cRect();
+    osdAlpha = -1;
+    uniformAlpha = true;
 
-    GetScreenSize(&osdWidth, &osdHeight, &pixel_aspect);
+    GetOsdSize(&osdWidth, &osdHeight, &pixel_aspect);
     Debug2(L_OSD, "New Osd %p osdLeft %d osdTop %d screenWidth %d screenHeight %d", this, Left, Top, osdWidth, osdHeight);
 
     cSize maxPixmapSize(oglThread->MaxTextureSize(), oglThread->MaxTextureSize());
@@ -2826,16 +3346,72 @@ void cOglOsd::DestroyPixmap(cPixmap *Pixmap) {
     }
 }
 
+/**
+ * Alpha shared by all visible pixmaps with content, -1 if they differ.
+ * Such pixmaps are rendered opaque and the whole osd gets the alpha
+ * at the end, so a fade of the osd doesn't need to render them again.
+ * Translucent pixmaps, which overlap, blend into each other: -1 too.
+ */
+int cOglOsd::UniformAlpha(void) {
+    int alpha = -1;
+    for (int i = 0; i < oglPixmaps.Size(); i++) {
+        if (!oglPixmaps[i] || oglPixmaps[i]->Layer() < 0 || oglPixmaps[i]->Blank())
+            continue;
+        // layer 0 is copied without alpha
+        int pixmapAlpha = oglPixmaps[i]->Layer() == 0 ? ALPHA_OPAQUE : oglPixmaps[i]->Alpha();
+        if (alpha < 0)
+            alpha = pixmapAlpha;
+        else if (alpha != pixmapAlpha)
+            return -1;
+    }
+    if (alpha < 0)
+        return ALPHA_OPAQUE;
+    if (alpha == ALPHA_OPAQUE)
+        return alpha;
+
+    for (int i = 0; i < oglPixmaps.Size(); i++) {
+        if (!oglPixmaps[i] || oglPixmaps[i]->Layer() < 0 || oglPixmaps[i]->Blank())
+            continue;
+        for (int j = i + 1; j < oglPixmaps.Size(); j++) {
+            if (!oglPixmaps[j] || oglPixmaps[j]->Layer() < 0 || oglPixmaps[j]->Blank())
+                continue;
+            if (oglPixmaps[i]->ViewPort().Intersects(oglPixmaps[j]->ViewPort()))
+                return -1;
+        }
+    }
+    return alpha;
+}
+
+void cOglOsd::SetOsdAlpha(int alpha) {
+    if (OsdHasPlaneAlpha()) {
+        oglThread->DoCmd(new cOglCmdSetOsdAlpha(alpha));
+        return;
+    }
+    if (alpha == osdAlpha)
+        return;
+    osdAlpha = alpha;
+
+    // one final composite pass with the osd alpha
+    oglThread->DoCmd(new cOglCmdBufferFill(oFb, clrTransparent));
+    oglThread->DoCmd(new cOglCmdCopyBufferToOutputFb(bFb, oFb,
+                                                     Left() + (isSubtitleOsd ? oglPixmaps[0]->ViewPort().X() : 0),
+                                                     Top() + (isSubtitleOsd ? oglPixmaps[0]->ViewPort().Y() : 0), 1, alpha));
+}
+
 void cOglOsd::Flush(void) {
     if (!oglThread->Active() || !Active())
         return;
 
     Debug2(L_OSD, "Flush Osd %p", this);
     LOCK_PIXMAPS;
+    int alpha = UniformAlpha();
+    bool alphaOnly = true;
     // check for dirty areas
     dirtyViewport->Set(0, 0, 0, 0);
     for (int i = 0; i < oglPixmaps.Size(); i++) {
         if (oglPixmaps[i] && oglPixmaps[i]->IsDirty()) {
+            if (!oglPixmaps[i]->AlphaOnly())
+                alphaOnly = false;
             if (isSubtitleOsd) {
                 dirtyViewport->Combine(oglPixmaps[i]->DirtyViewPort().Size());
             } else {
@@ -2848,6 +3424,18 @@ void cOglOsd::Flush(void) {
     if (dirtyViewport->IsEmpty())
         return;
 
+    // the whole osd fades, the buffer is still valid
+    if (alphaOnly && alpha >= 0 && uniformAlpha) {
+        SetOsdAlpha(alpha);
+        return;
+    }
+
+    // pixmap alpha moves between the pixmaps and the osd, render everything
+    if (uniformAlpha != (alpha >= 0)) {
+        uniformAlpha = alpha >= 0;
+        dirtyViewport->Set(0, 0, bFb->Width(), bFb->Height());
+    }
+
     // clear buffer within the dirty area
     oglThread->DoCmd(new cOglCmdDrawRectangle(bFb,
                                               dirtyViewport->X(),
@@ -2876,7 +3464,7 @@ void cOglOsd::Flush(void) {
                                                             bFb,
                                                             isSubtitleOsd ? 0 : oglPixmaps[i]->ViewPort().X(),
                                                             isSubtitleOsd ? 0 : oglPixmaps[i]->ViewPort().Y(),
-                                                            oglPixmaps[i]->Alpha(),
+                                                            uniformAlpha ? ALPHA_OPAQUE : oglPixmaps[i]->Alpha(),
                                                             oglPixmaps[i]->DrawPort().X(),
                                                             oglPixmaps[i]->DrawPort().Y(),
                                                             dirtyViewport->X(),
@@ -2887,11 +3475,18 @@ void cOglOsd::Flush(void) {
         }
     }
     //copy buffer to output framebuffer
+    int outputAlpha = uniformAlpha ? alpha : ALPHA_OPAQUE;
+    bool planeAlpha = OsdHasPlaneAlpha();
     oglThread->DoCmd(new cOglCmdBufferFill(oFb, clrTransparent));
 
     oglThread->DoCmd(new cOglCmdCopyBufferToOutputFb(bFb, oFb,
                                                      Left() + (isSubtitleOsd ? oglPixmaps[0]->ViewPort().X() : 0),
-                                                     Top() + (isSubtitleOsd ? oglPixmaps[0]->ViewPort().Y() : 0), 1));
+                                                     Top() + (isSubtitleOsd ? oglPixmaps[0]->ViewPort().Y() : 0), 1,
+                                                     planeAlpha ? ALPHA_OPAQUE : outputAlpha));
+    if (planeAlpha)
+        oglThread->DoCmd(new cOglCmdSetOsdAlpha(outputAlpha));
+    else
+        osdAlpha = outputAlpha;
 }
 
 void cOglOsd::DrawScaledBitmap(int x, int y, const cBitmap &Bitmap, double FactorX, double FactorY, bool AntiAlias) {
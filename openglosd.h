@@ -39,6 +39,7 @@ extern "C"
 #include "video.h"
 #include "codec.h"
 #include "softhddev.h"
+#include "trace.h"
 }
 
 struct sOglImage {
@@ -61,6 +62,7 @@ enum eShaderType {
     stRect,
     stTexture,
     stTextureSwapBR,
+    stTexturePalette,
     stText,
     stCount
 };
@@ -69,12 +71,20 @@ class cShader {
 private:
     eShaderType type;
     GLuint id;
+    bool cached;
+    int savedMs;
     bool Compile(const char *vertexCode, const char *fragmentCode);
     bool CheckCompileErrors(GLuint object, bool program = false);
+    cString BinaryFileName(const char *vertexCode, const char *fragmentCode);
+    bool LoadBinary(const char *fileName);
+    void SaveBinary(const char *fileName, int compileMs);
 public:
-    cShader(void) {};
+    cShader(void) { cached = false; savedMs = 0; };
     virtual ~cShader(void) {};
+    static void InitBinaryCache(void);
     bool Load(eShaderType type);
+    bool Cached(void) { return cached; }
+    int SavedMs(void) { return savedMs; }
     void Use(void);
     void SetFloat    (const GLchar *name, GLfloat value);
     void SetInteger  (const GLchar *name, GLint value);
@@ -206,6 +216,7 @@ public:
     static cOglFont *Get(const char *name, int charHeight);
     cOglFontAtlas *Atlas(void) { return atlas; };
     static void Cleanup(void);
+    static void DropGlyphs(void);
     const char *Name(void) { return *name; };
     int Size(void) { return size; };
     int Bottom(void) {return bottom; };
@@ -271,6 +282,7 @@ enum eVertexBufferType {
     vbSlope,
     vbTexture,
     vbTextureSwapBR,
+    vbTexturePalette,
     vbText,
     vbCount
 };
@@ -300,6 +312,7 @@ public:
     void SetShaderBorderColor(GLint bcolor);
     void SetShaderTexture(GLint value);
     void SetShaderAlpha(GLint alpha);
+    void SetShaderPalette(GLint texture, GLint colorFg, GLint colorBg, bool specialColors, bool overlay);
     void SetShaderProjectionMatrix(GLint width, GLint height);
     void SetVertexSubData(GLfloat *vertices, int count = 0);
     void SetVertexData(GLfloat *vertices, int count = 0);
@@ -366,14 +379,24 @@ public:
     virtual bool Execute(void);
 };
 
+class cOglCmdSetOsdAlpha : public cOglCmd {
+private:
+    GLint alpha;
+public:
+    cOglCmdSetOsdAlpha(GLint alpha);
+    virtual const char* Description(void) { return "Set Osd Alpha"; }
+    virtual bool Execute(void);
+};
+
 class cOglCmdCopyBufferToOutputFb : public cOglCmd {
 private:
     cOglOutputFb *oFb;
     GLfloat x, y;
     GLint bcolor;
+    GLint alpha;
     int active;
 public:
-    cOglCmdCopyBufferToOutputFb(cOglFb *fb, cOglOutputFb *oFb, GLint x, GLint y, int active);
+    cOglCmdCopyBufferToOutputFb(cOglFb *fb, cOglOutputFb *oFb, GLint x, GLint y, int active, GLint alpha = ALPHA_OPAQUE);
     virtual ~cOglCmdCopyBufferToOutputFb(void) {};
     virtual const char* Description(void) { return "Copy buffer to OutputFramebuffer"; }
     virtual bool Execute(void);
@@ -470,6 +493,20 @@ public:
     virtual bool Execute(void);
 };
 
+class cOglCmdDrawBitmap : public cOglCmd {
+private:
+    tIndex *indices;
+    tColor *palette;
+    GLint x, y, width, height;
+    tColor colorFg, colorBg;
+    bool overlay;
+public:
+    cOglCmdDrawBitmap(cOglFb *fb, tIndex *indices, tColor *palette, GLint width, GLint height, GLint x, GLint y, tColor colorFg, tColor colorBg, bool overlay);
+    virtual ~cOglCmdDrawBitmap(void);
+    virtual const char* Description(void) { return "Draw Bitmap"; }
+    virtual bool Execute(void);
+};
+
 class cOglCmdDrawTexture : public cOglCmd {
 private:
     sOglImage *imageRef;
@@ -505,6 +542,27 @@ public:
     virtual bool Execute(void);
 };
 
+/******************************************************************************
+* cOglLayer
+* rendered pixmap framebuffer, kept in the layer cache after its osd is gone
+******************************************************************************/
+class cOglLayer : public cListObject {
+public:
+    cString key;
+    int layer;
+    cRect viewPort;
+    int generation;
+    cOglFb *fb;
+    cOglLayer(const char *key, int layer, const cRect &viewPort, int generation, cOglFb *fb) {
+        this->key = key;
+        this->layer = layer;
+        this->viewPort = viewPort;
+        this->generation = generation;
+        this->fb = fb;
+    };
+    long Size(void) { return (long)fb->Width() * fb->Height() * sizeof(tColor); }
+};
+
 /******************************************************************************
 * cOglThread
 ******************************************************************************/
@@ -516,11 +574,17 @@ private:
     cCondWait *startWait;
     cCondWait *wait;
     bool stalled;
+    pthread_mutex_t cmdMutex;
     std::queue<cOglCmd*> commands;
     GLint maxTextureSize;
+    int flushMs;
+    unsigned commandCount;
     sOglImage imageCache[OGL_MAX_OSDIMAGES];
     long memCached;
     long maxCacheSize;
+    cList<cOglLayer> layerCache;
+    long memLayers;
+    long maxLayerCacheSize;
     bool InitOpenGL(void);
     bool InitShaders(void);
     void DeleteShaders(void);
@@ -529,17 +593,23 @@ private:
     void Cleanup(void);
     int GetFreeSlot(void);
     void ClearSlot(int slot);
+    void ReleaseMemory(void);
 protected:
     virtual void Action(void);
 public:
-    cOglThread(cCondWait *startWait, int maxCacheSize);
+    cOglThread(cCondWait *startWait, int maxCacheSize, int maxLayerCacheSize = 0);
     virtual ~cOglThread();
     void Stop(void);
     void DoCmd(cOglCmd* cmd);
     int StoreImage(const cImage &image);
     void DropImageData(int imageHandle);
     sOglImage *GetImageRef(int slot);
+    bool StoreLayer(const char *key, int layer, const cRect &viewPort, int generation, cOglFb *fb);
+    cOglFb *TakeLayer(const char *key, int layer, const cRect &viewPort, int generation);
     int MaxTextureSize(void) { return maxTextureSize; };
+    int FlushMs(void) { return flushMs; };
+    unsigned CommandCount(void) { return commandCount; };
+    long CacheBytes(void) { return memCached + memLayers; };
 };
 
 /****************************************************************************************
@@ -550,6 +620,10 @@ private:
     cOglFb *fb;
     std::shared_ptr<cOglThread> oglThread;
     bool dirty;
+    bool alphaOnly;
+    bool blank;
+    cString layerKey;
+    int layerGeneration;
 #ifdef GRIDPOINTS
     cFont *tinyfont;
     void DrawGridRect(const cRect &Rect, int offset, int size, tColor clr, tColor bg, const cFont *Font);
@@ -562,7 +636,11 @@ public:
     int X(void) { return ViewPort().X(); };
     int Y(void) { return ViewPort().Y(); };
     virtual bool IsDirty(void) { return dirty; }
-    virtual void SetDirty(bool dirty = true) { this->dirty = dirty; }
+    virtual void SetDirty(bool dirty = true) { this->dirty = dirty; alphaOnly = false; }
+    bool AlphaOnly(void) { return alphaOnly; }
+    bool Blank(void) { return blank; }
+    bool Retain(const char *key, int generation);
+    void MarkDrawPortDirty(const cRect &Rect) { blank = false; cPixmap::MarkDrawPortDirty(Rect); }
     virtual void SetLayer(int Layer);
     virtual void SetAlpha(int Alpha);
     virtual void SetTile(bool Tile);
@@ -599,6 +677,10 @@ private:
     bool isSubtitleOsd;
     cSize maxPixmapSize;
     cRect *dirtyViewport;
+    int osdAlpha;
+    bool uniformAlpha;
+    int UniformAlpha(void);
+    void SetOsdAlpha(int alpha);
 protected:
 public:
     cOglOsd(int Left, int Top, uint Level, std::shared_ptr<cOglThread> oglThread);
@@ -48,6 +48,8 @@
 #include "audio.h"
 #include "video.h"
 #include "codec.h"
+#include "trace.h"
+#include "bench.h"
 
 //////////////////////////////////////////////////////////////////////////////
 //	Variables
@@ -65,6 +67,7 @@ static volatile char StreamFreezed;	///< stream freezed
 //////////////////////////////////////////////////////////////////////////////
 
 #define VIDEO_BUFFER_SIZE (512 * 1024)	///< video PES buffer default size
+#define VIDEO_BUFFER_SIZE_MIN (64 * 1024)	///< video PES buffer under memory pressure
 #define VIDEO_PACKET_MAX 192		///< max number of video packets
 
 /**
@@ -84,6 +87,7 @@ struct __video_stream__
     volatile char TrickSpeed;		///< current trick speed
 
     AVPacket PacketRb[VIDEO_PACKET_MAX];	///< PES packet ring buffer
+    AVPacket *PacketRefRb[VIDEO_PACKET_MAX];	///< player packets, moved not copied
     int PacketWrite;			///< ring buffer write pointer
     int PacketRead;			///< ring buffer read pointer
     atomic_t PacketsFilled;		///< how many of the ring buffer is used
@@ -93,6 +97,14 @@ static VideoStream MyVideoStream[1];	///< normal video stream
 
 static pthread_mutex_t PktsLockMutex;	///< video packets lock mutex
 
+static unsigned VideoBytesCopied;	///< video bytes copied into the ring buffer
+static unsigned VideoBytesMoved;	///< video bytes moved into the ring buffer
+static uint32_t VideoBytesTick;		///< start of the video bytes count
+
+static pthread_mutex_t BufferSpaceMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t BufferSpaceCond = PTHREAD_COND_INITIALIZER;
+static unsigned BufferSpaceSeq;		///< counts consumed buffers
+
 //////////////////////////////////////////////////////////////////////////////
 //	Audio
 //////////////////////////////////////////////////////////////////////////////
@@ -230,7 +242,7 @@ static inline int FastMpegCheck(const uint8_t * p)
 ///	Layer II & III:
 ///		FrameLengthInBytes = 144 * BitRate / SampleRate + Padding
 ///
-static int MpegCheck(const uint8_t * data, int size)
+BENCH_STATIC int MpegCheck(const uint8_t * data, int size)
 {
     int mpeg2;
     int mpeg25;
@@ -324,7 +336,7 @@ static inline int FastLatmCheck(const uint8_t * p)
 ///	@retval 0	no valid AAC LATM audio
 ///	@retval >0	valid AAC LATM audio
 ///
-static int LatmCheck(const uint8_t * data, int size)
+BENCH_STATIC int LatmCheck(const uint8_t * data, int size)
 {
     int frame_size;
 
@@ -409,7 +421,7 @@ static inline int FastAc3Check(const uint8_t * p)
 ///	o e 2x	Framesize code
 ///	o f 2x	Framesize code 2
 ///
-static int Ac3Check(const uint8_t * data, int size)
+BENCH_STATIC int Ac3Check(const uint8_t * data, int size)
 {
     int frame_size;
 
@@ -494,7 +506,7 @@ static inline int FastAdtsCheck(const uint8_t * p)
 ///	o ..
 ///	o M*13	frame length
 ///
-static int AdtsCheck(const uint8_t * data, int size)
+BENCH_STATIC int AdtsCheck(const uint8_t * data, int size)
 {
     int frame_size;
 
@@ -586,6 +598,7 @@ int PlayAudio(const uint8_t * data, int size, uint8_t id)
 	} else {
 		Info("PlayAudio: No PTS!");
 	}
+	Trace(TRACE_AUDIO_IN, AudioAvPkt->pts);
 
 	p = data + 9 + n;
 	n = size - 9 - n;			// skip pes header
@@ -834,32 +847,32 @@ unsigned int ReadSE()
 	return r;
 }
 
-void ParseResolutionH264(int *width, int *height)
+/**
+**	Parse the resolution from the H.264 sequence parameter set.
+**
+**	@param data		H.264 stream data
+**	@param size		number of bytes
+**	@param width[OUT]	picture width
+**	@param height[OUT]	picture height
+**
+**	@returns 0 if found, -1 if the data has no sequence parameter set
+*/
+BENCH_STATIC int ParseSpsH264(const uint8_t * data, int size, int *width, int *height)
 {
-	AVPacket *avpkt;
-	m_pStart = NULL;
 	int i;
 
-	while (!VideoGetPackets()) {
-		usleep(10000);
-	}
-
-	avpkt = &MyVideoStream->PacketRb[MyVideoStream->PacketRead];
-
-	for (i = 0; i < avpkt->size; i++) {
-		if (!avpkt->data[i] && !avpkt->data[i + 1] && avpkt->data[i + 2] == 0x01 && 
-			(avpkt->data[i + 3] == 0x67 || avpkt->data[i + 3] == 0x27)) {
+	m_pStart = NULL;
+	for (i = 0; i + 3 < size; i++) {
+		if (!data[i] && !data[i + 1] && data[i + 2] == 0x01 &&
+			(data[i + 3] == 0x67 || data[i + 3] == 0x27)) {
 
-			m_pStart = &avpkt->data[i + 4];
-			m_nLength = avpkt->size - i - 4;
+			m_pStart = &data[i + 4];
+			m_nLength = size - i - 4;
 			break;
 		}
 	}
 	if (!m_pStart) {
-		Debug("ParseResolutionH264: No m_pStart %p Pkt %p Packets %d i %d",
-			m_pStart, avpkt, VideoGetPackets(), i);
-		PrintStreamData(avpkt->data, avpkt->size);
-		return;
+		return -1;
 	}
 
 	m_nCurrentBit = 0;
@@ -957,9 +970,28 @@ void ParseResolutionH264(int *width, int *height)
 	*width = ((pic_width_in_mbs_minus1 + 1) * 16) -
 		SubWidthC * (frame_crop_right_offset + frame_crop_left_offset);
 
+	// the crop unit is two lines per field for interlaced streams
 	*height = ((2 - frame_mbs_only_flag)* (pic_height_in_map_units_minus1 +1) * 16) -
-		SubHeightC * ((frame_crop_bottom_offset * 2) + (frame_crop_top_offset * 2));
+		SubHeightC * (2 - frame_mbs_only_flag) * (frame_crop_bottom_offset + frame_crop_top_offset);
 
+	return 0;
+}
+
+void ParseResolutionH264(int *width, int *height)
+{
+	AVPacket *avpkt;
+
+	while (!VideoGetPackets()) {
+		ClockSleep(10000);
+	}
+
+	avpkt = &MyVideoStream->PacketRb[MyVideoStream->PacketRead];
+
+	if (ParseSpsH264(avpkt->data, avpkt->size, width, height)) {
+		Debug("ParseResolutionH264: No SPS in Pkt %p Packets %d",
+			avpkt, VideoGetPackets());
+		PrintStreamData(avpkt->data, avpkt->size);
+	}
 }
 
 /**
@@ -977,6 +1009,11 @@ static void VideoPacketInit(VideoStream * stream)
 			Fatal("out of memory");
 		}
 		avpkt->size = 0;
+		MemAccount(MEM_VIDEO_PACKETS, avpkt->buf->size);
+
+		if (!(stream->PacketRefRb[i] = av_packet_alloc())) {
+			Fatal("out of memory");
+		}
 	}
 
 	atomic_set(&stream->PacketsFilled, 0);
@@ -994,7 +1031,95 @@ static void VideoPacketExit(VideoStream * stream)
 	atomic_set(&stream->PacketsFilled, 0);
 
 	for (int i = 0; i < VIDEO_PACKET_MAX; ++i) {
+		if (stream->PacketRb[i].buf) {
+			MemAccount(MEM_VIDEO_PACKETS, -stream->PacketRb[i].buf->size);
+		}
 		av_packet_unref(&stream->PacketRb[i]);
+		av_packet_free(&stream->PacketRefRb[i]);
+	}
+}
+
+/**
+**	Grow the buffer of a ring buffer packet, keep its data size.
+**
+**	@param avpkt	packet of the ring buffer
+**	@param size	bytes to add
+*/
+static void VideoPacketGrow(AVPacket * avpkt, int size)
+{
+	int pkt_size = avpkt->size;
+
+	Warning("video: packet buffer too small for %d", avpkt->size + size);
+	MemAccount(MEM_VIDEO_PACKETS, -avpkt->buf->size);
+	av_grow_packet(avpkt, size);
+	MemAccount(MEM_VIDEO_PACKETS, avpkt->buf->size);
+	avpkt->size = pkt_size;
+}
+
+/**
+**	Shrink the free packets of the ring buffer under memory pressure.
+**
+**	The pool is the biggest consumer, VIDEO_PACKET_MAX buffers of
+**	VIDEO_BUFFER_SIZE. With a budget exceeded the buffers of all free
+**	packets go down to the minimum size, a buffer grows again when a
+**	PES packet doesn't fit. Only the decoder touches the filled
+**	packets and it only frees them, so the free ones can be replaced.
+**
+**	@param stream	video stream, its write packet is empty
+*/
+static void VideoPacketShrink(VideoStream * stream)
+{
+	int unused;
+
+	if (!MemPressure()) {
+		return;
+	}
+	unused = VIDEO_PACKET_MAX - atomic_read(&stream->PacketsFilled);
+	for (int i = 0; i < unused; ++i) {
+		AVPacket *avpkt;
+
+		avpkt = &stream->PacketRb[(stream->PacketWrite + i) % VIDEO_PACKET_MAX];
+		if (avpkt->buf->size <= VIDEO_BUFFER_SIZE_MIN + AV_INPUT_BUFFER_PADDING_SIZE) {
+			continue;
+		}
+		MemAccount(MEM_VIDEO_PACKETS, -avpkt->buf->size);
+		av_packet_unref(avpkt);
+		if (av_new_packet(avpkt, VIDEO_BUFFER_SIZE_MIN)) {
+			Fatal("out of memory");
+		}
+		avpkt->size = 0;
+		MemAccount(MEM_VIDEO_PACKETS, avpkt->buf->size);
+	}
+}
+
+/**
+**	Count the video bytes put into the packet ringbuffer.
+**
+**	Logs the bytes per second copied and moved, to verify the
+**	player path doesn't copy.
+**
+**	@param copied	bytes copied
+**	@param moved	bytes moved by reference
+*/
+static void VideoCountBytes(int copied, int moved)
+{
+	uint32_t tick;
+	uint32_t elapsed;
+
+	tick = GetMsTicks();
+	if (!VideoBytesTick)
+		VideoBytesTick = tick;
+	VideoBytesCopied += copied;
+	VideoBytesMoved += moved;
+
+	elapsed = tick - VideoBytesTick;
+	if (elapsed >= 1000) {
+		Debug2(L_CODEC, "video: %u bytes/s copied, %u bytes/s moved",
+			(unsigned)((uint64_t)VideoBytesCopied * 1000 / elapsed),
+			(unsigned)((uint64_t)VideoBytesMoved * 1000 / elapsed));
+		VideoBytesCopied = 0;
+		VideoBytesMoved = 0;
+		VideoBytesTick = tick;
 	}
 }
 
@@ -1017,7 +1142,9 @@ static void VideoEnqueue(VideoStream * stream, int64_t pts, const void *data,
 		if (avpkt->size) {
 			stream->PacketWrite = (stream->PacketWrite + 1) % VIDEO_PACKET_MAX;
 			atomic_inc(&stream->PacketsFilled);
+			VideoIdleWakeup();
 		}
+		VideoPacketShrink(stream);
 		avpkt = &stream->PacketRb[stream->PacketWrite];
 		avpkt->size = 0;
 		avpkt->pts = pts;
@@ -1025,16 +1152,13 @@ static void VideoEnqueue(VideoStream * stream, int64_t pts, const void *data,
 	}
 
 	if ((size_t)(avpkt->size + size) >= avpkt->buf->size) {
-		int pkt_size = avpkt->size;
-		Warning("video: packet buffer too small for %d",
-			avpkt->size + size);
-		av_grow_packet(avpkt, size);
-		avpkt->size = pkt_size;
+		VideoPacketGrow(avpkt, size);
 	}
 
 	memcpy(avpkt->data + avpkt->size, data, size);
 	avpkt->size += size;
 	memset(avpkt->data + avpkt->size, 0, AV_INPUT_BUFFER_PADDING_SIZE);
+	VideoCountBytes(size, 0);
 }
 
 /**
@@ -1064,16 +1188,24 @@ void ClearVideo(VideoStream * stream)
 {
 	AVPacket *avpkt;
 	Debug("ClearVideo()");
-	pthread_mutex_lock(&PktsLockMutex);
+	TraceMutexLock(PktsLockMutex);
 	atomic_set(&stream->PacketsFilled, 0);
 	stream->PacketRead = stream->PacketWrite = 0;
 
 	avpkt = &stream->PacketRb[stream->PacketWrite];
 	avpkt->size = 0;
 	avpkt->pts = AV_NOPTS_VALUE;
+	for (int i = 0; i < VIDEO_PACKET_MAX; ++i) {
+		if (stream->PacketRefRb[i])
+			av_packet_unref(stream->PacketRefRb[i]);
+	}
 
 	CodecVideoFlushBuffers(stream->Decoder);
-	pthread_mutex_unlock(&PktsLockMutex);
+	TraceMutexUnlock(PktsLockMutex);
+
+	// the skip target belongs to the cleared stream
+	if (stream->Render)
+		VideoSetSkipPts(stream->Render, AV_NOPTS_VALUE);
 }
 
 /**
@@ -1083,7 +1215,7 @@ void ClearVideo(VideoStream * stream)
 **
 **	@retval 0	packet decoded
 **	@retval	1	stream paused
-**	@retval	-1	empty stream
+**	@retval	-1	empty stream or no codec
 */
 int VideoDecodeInput(VideoStream * stream)
 {
@@ -1111,23 +1243,46 @@ int VideoDecodeInput(VideoStream * stream)
 	}
 
 	if (stream->CodecID != AV_CODEC_ID_NONE) {
-		pthread_mutex_lock(&PktsLockMutex);
+		TraceMutexLock(PktsLockMutex);
 		if (!atomic_read(&stream->PacketsFilled)) {
-			pthread_mutex_unlock(&PktsLockMutex);
+			TraceMutexUnlock(PktsLockMutex);
 			return -1;
 		}
-		avpkt = &stream->PacketRb[stream->PacketRead];
+		// player packets are moved in, pes packets copied
+		avpkt = stream->PacketRefRb[stream->PacketRead];
+		if (!avpkt->buf) {
+			avpkt = &stream->PacketRb[stream->PacketRead];
+		}
 		if (!CodecVideoSendPacket(stream->Decoder, avpkt)) {
+			av_packet_unref(stream->PacketRefRb[stream->PacketRead]);
 			stream->PacketRead = (stream->PacketRead + 1) % VIDEO_PACKET_MAX;
 			atomic_dec(&stream->PacketsFilled);
+			TraceMutexUnlock(PktsLockMutex);
+			SignalBufferSpace();
+		} else {
+			TraceMutexUnlock(PktsLockMutex);
 		}
-		pthread_mutex_unlock(&PktsLockMutex);
 
 		if (!stream->NewStream)
 			CodecVideoReceiveFrame(stream->Decoder, 0);
+		return 0;
 	}
 
-	return 0;
+	return -1;
+}
+
+/**
+**	Check if the video decoder has work.
+**
+**	The decode thread sleeps until this is true, every change of
+**	these conditions is followed by VideoIdleWakeup().
+**
+**	@param stream	video stream
+*/
+int VideoDecodeReady(VideoStream * stream)
+{
+	return !StreamFreezed && stream->CodecID != AV_CODEC_ID_NONE &&
+		(stream->ClosingStream || atomic_read(&stream->PacketsFilled));
 }
 
 /**
@@ -1179,6 +1334,7 @@ int PlayVideo(const uint8_t * data, int size)
 		pts = (int64_t) (data[9] & 0x0E) << 29 | data[10] << 22 | (data[11] &
 			0xFE) << 14 | data[12] << 7 | (data[13] & 0xFE) >> 1;
 	}
+	Trace(TRACE_VIDEO_IN, pts);
 
 	n = PesHeadLength(data);	// PES header size
 
@@ -1334,11 +1490,7 @@ void StillPicture(const uint8_t * data, int size)
 		Debug2(L_STILL, "StillPicture: memcpy avpkt.size %d size %d size_rest %d peslength %d headlength %d I %d",
 			avpkt->size, size, size_rest, pes_length, head_length, i);
 		if ((size_t)(avpkt->size + pes_length - head_length - i) >= avpkt->buf->size) {
-			int pkt_size = avpkt->size;
-			Warning("video: packet buffer too small for %d",
-				avpkt->size + pes_length - head_length - i);
-			av_grow_packet(avpkt, pes_length - head_length - i);
-			avpkt->size = pkt_size;
+			VideoPacketGrow(avpkt, pes_length - head_length - i);
 		}
 
 		memcpy(avpkt->data + avpkt->size, pos + head_length + i, pes_length - head_length - i);
@@ -1363,7 +1515,7 @@ void StillPicture(const uint8_t * data, int size)
 
 send:
 	CodecVideoSendPacket(MyVideoStream->Decoder, avpkt);
-	usleep(20000);
+	ClockSleep(20000);
 	if (CodecVideoReceiveFrame(MyVideoStream->Decoder, 1))
 		goto send;
 	else Debug2(L_STILL, "StillPicture: Received Frame");
@@ -1373,8 +1525,9 @@ send:
 	}
 	ClearVideo(MyVideoStream);
 	StreamFreezed = 0;
+	VideoIdleWakeup();
 
-	usleep(100000);
+	ClockSleep(100000);
 	VideoSetTrickSpeed(MyVideoStream->Render, 0);
 }
 
@@ -1484,38 +1637,153 @@ void SetVideoCodec(int codec_id, AVCodecParameters * par, AVRational * timebase)
 	MyVideoStream->timebase.den = timebase->den;
 }
 
+/**
+**	Set audio only playback.
+**
+**	The video threads idle and audio is buffered deeper.
+**
+**	@param on	audio only on/off
+*/
+void SetAudioOnly(int on)
+{
+	if (MyVideoStream->Render) {
+		VideoSetAudioOnly(MyVideoStream->Render, on);
+	}
+	AudioSetDeepBuffer(on);
+}
+
+/**
+**	Don't show video frames before a seek target.
+**
+**	The decoder has to run from the keyframe before the target,
+**	the frames up to the target are dropped.
+**
+**	@param pts	seek target in video stream time base
+*/
+void SkipVideoUntil(int64_t pts)
+{
+	if (MyVideoStream->Render) {
+		VideoSetSkipPts(MyVideoStream->Render, pts);
+	}
+}
+
+/**
+**	Signal that audio or video buffers got consumed.
+*/
+void SignalBufferSpace(void)
+{
+	pthread_mutex_lock(&BufferSpaceMutex);
+	BufferSpaceSeq++;
+	pthread_cond_broadcast(&BufferSpaceCond);
+	pthread_mutex_unlock(&BufferSpaceMutex);
+}
+
+/**
+**	Get the buffer space sequence, to wait for with WaitBufferSpace().
+*/
+unsigned GetBufferSpaceSeq(void)
+{
+	unsigned seq;
+
+	pthread_mutex_lock(&BufferSpaceMutex);
+	seq = BufferSpaceSeq;
+	pthread_mutex_unlock(&BufferSpaceMutex);
+
+	return seq;
+}
+
+/**
+**	Wait until audio or video buffers got consumed.
+**
+**	Take the sequence before the buffers are tested, so a buffer
+**	consumed in between isn't missed.
+**
+**	With simulated time the timeout is simulated too.
+**
+**	@param seq	sequence from GetBufferSpaceSeq()
+**	@param timeout	timeout in ms
+*/
+void WaitBufferSpace(unsigned seq, int timeout)
+{
+	struct timespec abstime;
+	uint64_t end;
+
+	if (ClockGetMode() != CLOCK_REAL) {
+		end = ClockGetTime() + timeout * 1000ULL;
+		while (seq == GetBufferSpaceSeq() && ClockGetTime() < end) {
+			ClockSleep(1000);
+		}
+		return;
+	}
+
+	clock_gettime(CLOCK_REALTIME, &abstime);
+	abstime.tv_sec += timeout / 1000;
+	abstime.tv_nsec += (timeout % 1000) * 1000000L;
+	if (abstime.tv_nsec >= 1000000000L) {
+		abstime.tv_sec++;
+		abstime.tv_nsec -= 1000000000L;
+	}
+
+	pthread_mutex_lock(&BufferSpaceMutex);
+	while (seq == BufferSpaceSeq) {
+		if (pthread_cond_timedwait(&BufferSpaceCond, &BufferSpaceMutex,
+				&abstime))
+			break;
+	}
+	pthread_mutex_unlock(&BufferSpaceMutex);
+}
+
 int PlayAudioPkts(AVPacket * pkt)
 {
 	if (AudioFreeBytes() < AUDIO_MIN_BUFFER_FREE) {
 //		Error("PlayAudioPkts: AudioFreeBytes() < AUDIO_MIN_BUFFER_FREE!");
 		return 0;
 	}
+	Trace(TRACE_AUDIO_IN, pkt->pts);
 	CodecAudioDecode(MyAudioDecoder, pkt);
 	return 1;
 }
 
+/**
+**	Play a demuxed video packet.
+**
+**	The packet data isn't copied, the reference is moved into the
+**	ring buffer. On success the packet is left blank.
+**
+**	@param pkt	refcounted video packet
+**
+**	@retval 1	packet taken
+**	@retval 0	ring buffer full
+*/
 int PlayVideoPkts(AVPacket * pkt)
 {
 	AVPacket *avpkt;
+	int size;
 
 	if (atomic_read(&MyVideoStream->PacketsFilled) >= VIDEO_PACKET_MAX - 10) {
 		return 0;
 	}
 
-	avpkt = &MyVideoStream->PacketRb[MyVideoStream->PacketWrite];
-	MyVideoStream->PacketWrite = (MyVideoStream->PacketWrite + 1) % VIDEO_PACKET_MAX;
-	atomic_inc(&MyVideoStream->PacketsFilled);
+	Trace(TRACE_VIDEO_IN, pkt->pts);
 
-	if ((size_t)pkt->size > avpkt->buf->size) {
-		Info("PlayVideoPkts: grow packet buffer size by %d",
-			pkt->size - avpkt->buf->size + AV_INPUT_BUFFER_PADDING_SIZE);
-		av_grow_packet(avpkt, pkt->size - avpkt->buf->size +
-			AV_INPUT_BUFFER_PADDING_SIZE);
+	avpkt = MyVideoStream->PacketRefRb[MyVideoStream->PacketWrite];
+	size = pkt->size;
+	if (pkt->buf) {
+		av_packet_move_ref(avpkt, pkt);
+		VideoCountBytes(0, size);
+	} else {
+		// not refcounted, av_packet_ref copies
+		if (av_packet_ref(avpkt, pkt)) {
+			return 0;
+		}
+		VideoCountBytes(size, 0);
 	}
+	// only the pts is used, like with pes packets
+	avpkt->dts = AV_NOPTS_VALUE;
 
-	memcpy(avpkt->data, pkt->data, pkt->size);
-	avpkt->pts = pkt->pts;
-	avpkt->size = pkt->size;
+	MyVideoStream->PacketWrite = (MyVideoStream->PacketWrite + 1) % VIDEO_PACKET_MAX;
+	atomic_inc(&MyVideoStream->PacketsFilled);
+	VideoIdleWakeup();
 	return 1;
 }
 
@@ -1540,6 +1808,7 @@ void TrickSpeed(int speed)
 		ClearAudio();
 	}
 	StreamFreezed = 0;
+	VideoIdleWakeup();
 }
 
 /**
@@ -1561,6 +1830,7 @@ void Play(void)
 	Debug("Play(void)");
 	SkipAudio = 0;
 	StreamFreezed = 0;
+	VideoIdleWakeup();
 	AudioPlay();
 	VideoPlay(MyVideoStream->Render);
 }
@@ -1626,7 +1896,7 @@ int Poll(int timeout)
 	if (timeout < t) {
 	    t = timeout;
 	}
-	usleep(t * 1000);		// let display thread work
+	ClockSleep(t * 1000);		// let display thread work
 	timeout -= t;
     }
 }
@@ -1641,7 +1911,7 @@ int Flush(int timeout)
 	Debug("Flush: timeout %d", timeout);
 	if (atomic_read(&MyVideoStream->PacketsFilled)) {
 		if (timeout) {			// let display thread work
-			usleep(timeout * 1000);
+			ClockSleep(timeout * 1000);
 		}
 		return !atomic_read(&MyVideoStream->PacketsFilled);
 	}
@@ -1653,6 +1923,11 @@ void GetScreenSize(int *width, int *height, double *pixel_aspect)
 	VideoGetScreenSize(MyVideoStream->Render, width, height, pixel_aspect);
 }
 
+void GetOsdSize(int *width, int *height, double *pixel_aspect)
+{
+	VideoGetOsdSize(MyVideoStream->Render, width, height, pixel_aspect);
+}
+
 void GetVideoSize(int *width, int *height, double *aspect_ratio)
 {
 	VideoGetVideoSize(MyVideoStream->Decoder, width, height, aspect_ratio);
@@ -1677,6 +1952,7 @@ int SetPlayMode(int play_mode)
 	case 0:			// none audio/video
 		if (MyVideoStream->CodecID != AV_CODEC_ID_NONE) {
 			MyVideoStream->ClosingStream = 1;
+			VideoIdleWakeup();
 			// tell render we are closing stream
 			VideoSetClosing(MyVideoStream->Render);
 		}
@@ -1685,6 +1961,7 @@ int SetPlayMode(int play_mode)
 			NewAudioStream = 1;
 		}
 		StreamFreezed = 0;
+		VideoIdleWakeup();
 		SkipAudio = 0;
 		break;
 	case 1:			// audio/video
@@ -1815,6 +2092,33 @@ void GetStats(int *duped, int *dropped, int *counter)
 	}
 }
 
+/**
+**	Get runtime metrics.
+**
+**	Fills everything but the osd values, they belong to the osd
+**	provider.
+**
+**	@param[out] metrics	metrics, structSize is kept
+*/
+void GetMetrics(SoftHDDevice_Metrics_v1_0_t * metrics)
+{
+	int size;
+
+	size = metrics->structSize;
+	memset(metrics, 0, sizeof(*metrics));
+	metrics->structSize = size;
+
+	metrics->videoPackets = VideoGetPackets();
+	metrics->memVideoPackets = MemUsed(MEM_VIDEO_PACKETS);
+	if (MyVideoStream->Render) {
+		VideoGetMetrics(MyVideoStream->Render, metrics);
+	}
+	AudioGetStats(&metrics->alsaXruns, &metrics->alsaDelayMs,
+		&metrics->audioBufferMs);
+	metrics->memAudio = MemUsed(MEM_AUDIO);
+	metrics->memDisplay = MemUsed(MEM_DRM);
+}
+
 
 /**
 **	Scale the currently shown video.
@@ -1863,6 +2167,85 @@ void OsdDrawARGB(int xi, int yi, int height, int width, int pitch,
 			pitch, argb, x, y);
 }
 
+/**
+**	Draw an OSD 8 bit palette image.
+**
+**	@param index	palette indexes of the first pixel
+**	@param pitch	pitch of the index image
+**	@param colors	ARGB palette
+**	@param num_colors	number of palette entries
+**	@param width	width in pixel
+**	@param height	height in pixel
+**	@param x	x-coordinate on screen
+**	@param y	y-coordinate on screen
+*/
+void OsdDrawIndexed(const uint8_t * index, int pitch, const uint32_t * colors,
+	int num_colors, int width, int height, int x, int y)
+{
+	VideoOsdDrawIndexed(MyVideoStream->Render, index, pitch, colors,
+			num_colors, width, height, x, y);
+}
+
+/**
+**	Lock an area of the OSD buffer for direct drawing.
+**
+**	@param x	x-coordinate on screen
+**	@param y	y-coordinate on screen
+**	@param width	width in pixel
+**	@param height	height in pixel
+**	@param[out] pitch	pitch of the osd buffer
+**
+**	@returns pointer to the ARGB pixel at x, y, NULL if not supported
+*/
+uint8_t *OsdLockArea(int x, int y, int width, int height, int *pitch)
+{
+	return VideoOsdLockArea(MyVideoStream->Render, x, y, width, height,
+			pitch);
+}
+
+/**
+**	Unlock the OSD buffer area locked with OsdLockArea().
+*/
+void OsdUnlockArea(void)
+{
+	VideoOsdUnlockArea(MyVideoStream->Render);
+}
+
+/**
+**	Fade the OSD with the plane alpha.
+**
+**	@param alpha	osd alpha (0 transparent - 255 opaque)
+**	@param duration	fade duration in ms, 0 = set immediately
+**
+**	@retval 1	alpha is handled by the osd plane
+**	@retval 0	osd plane has no alpha, osd must be blended
+*/
+int OsdSetAlpha(int alpha, int duration)
+{
+	return !VideoSetOsdAlpha(MyVideoStream->Render, alpha, duration);
+}
+
+/**
+**	Get the OSD plane alpha.
+**
+**	@returns the alpha the osd plane shows or fades to,
+**		-1 if the osd plane has no alpha
+*/
+int OsdGetAlpha(void)
+{
+	return VideoGetOsdAlpha(MyVideoStream->Render);
+}
+
+/**
+**	Check if the OSD plane supports alpha.
+*/
+int OsdHasPlaneAlpha(void)
+{
+	VideoRender *render = MyVideoStream->Render;
+
+	return render && render->OsdPlaneAlpha;
+}
+
 //////////////////////////////////////////////////////////////////////////////
 
 /**
@@ -1874,6 +2257,7 @@ const char *CommandLineHelp(void)
 	"  -p device\taudio device for pass-through (hw:0,1)\n"
 	"  -c channel\taudio mixer channel name (fe. PCM)\n"
 	"  -d resolution\tdisplay resolution (fe. 1920x1080@50)\n"
+	"  -o resolution\tosd render resolution (fe. 1920x1080)\n"
 #ifdef USE_GLES
 	"  -w workaround\tenable/disable workarounds\n"
 	"\tdisable-ogl-osd disable openGL osd\n"
@@ -1895,9 +2279,9 @@ int ProcessArgs(int argc, char *const argv[])
 
     for (;;) {
 #ifdef USE_GLES
-	switch (getopt(argc, argv, "-a:c:p:d:w:")) {
+	switch (getopt(argc, argv, "-a:c:p:d:o:w:")) {
 #else
-	switch (getopt(argc, argv, "-a:c:p:d:")) {
+	switch (getopt(argc, argv, "-a:c:p:d:o:")) {
 #endif
 	    case 'a':			// audio device for pcm
 		AudioSetDevice(optarg);
@@ -1911,6 +2295,9 @@ int ProcessArgs(int argc, char *const argv[])
 	    case 'd':			// set display output
 		VideoSetDisplay(optarg);
 		continue;
+	    case 'o':			// set osd render resolution
+		VideoSetOsdSize(optarg);
+		continue;
 #ifdef USE_GLES
 	    case 'w':			// workarounds
 		if (!strcasecmp("disable-ogl-osd", optarg)) {
@@ -23,6 +23,8 @@
 #ifndef __SOFTHDDEV_H
 #define __SOFTHDDEV_H
 
+#include "softhddevice_service.h"
+
 #ifdef __cplusplus
 extern "C"
 {
@@ -42,12 +44,35 @@ extern "C"
     /// C plugin draw osd pixmap
     extern void OsdDrawARGB(int, int, int, int, int, const uint8_t *, int,
 		int);
+    /// C plugin draw osd 8 bit palette image
+    extern void OsdDrawIndexed(const uint8_t *, int, const uint32_t *, int,
+		int, int, int, int);
+    /// C plugin lock osd buffer area for direct drawing
+    extern uint8_t *OsdLockArea(int, int, int, int, int *);
+    /// C plugin unlock osd buffer area
+    extern void OsdUnlockArea(void);
+    /// C plugin fade osd with the plane alpha
+    extern int OsdSetAlpha(int, int);
+    /// C plugin get osd plane alpha
+    extern int OsdGetAlpha(void);
+    /// C plugin check if the osd plane supports alpha
+    extern int OsdHasPlaneAlpha(void);
 
     /// C plugin play media file
     extern void SetAudioCodec(int, AVCodecParameters *, AVRational *);
     extern void SetVideoCodec(int, AVCodecParameters *, AVRational *);
     extern int PlayAudioPkts(AVPacket *);
     extern int PlayVideoPkts(AVPacket *);
+    /// C plugin drop video frames before seek target
+    extern void SkipVideoUntil(int64_t);
+    /// C plugin audio only playback
+    extern void SetAudioOnly(int);
+    /// C plugin signal consumed audio/video buffers
+    extern void SignalBufferSpace(void);
+    /// C plugin get buffer space sequence
+    extern unsigned GetBufferSpaceSeq(void);
+    /// C plugin wait for consumed audio/video buffers
+    extern void WaitBufferSpace(unsigned, int);
 
     /// C plugin play audio packet
     extern int PlayAudio(const uint8_t *, int, uint8_t);
@@ -60,6 +85,8 @@ extern "C"
     extern int PlayVideo(const uint8_t *, int);
     /// Decode video input buffers.
     extern int VideoDecodeInput(VideoStream *);
+    /// Check if the video decoder has work.
+    extern int VideoDecodeReady(VideoStream *);
     /// Get number of input buffers.
     extern int VideoGetPackets(void);
     /// C plugin grab an image
@@ -87,6 +114,8 @@ extern "C"
     extern int64_t GetSTC(void);
     /// C plugin get video stream size and aspect
     extern void GetScreenSize(int *, int *, double *);
+    /// C plugin get osd render size and aspect
+    extern void GetOsdSize(int *, int *, double *);
     /// C plugin get video stream size and aspect
     extern void GetVideoSize(int *, int *, double *);
     /// C plugin command line help
@@ -104,6 +133,8 @@ extern "C"
 
     /// Get decoder statistics
     extern void GetStats(int *, int *, int *);
+    /// Get runtime metrics
+    extern void GetMetrics(SoftHDDevice_Metrics_v1_0_t *);
     /// Get parsed width and height
     extern void ParseResolutionH264(int *, int *);
     /// C plugin scale video
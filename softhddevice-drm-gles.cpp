@@ -23,14 +23,18 @@
 
 #define __STDC_CONSTANT_MACROS		///< needed for ffmpeg UINT64_C
 
+#include <algorithm>
 #include <string>
 using std::string;
 #include <fstream>
 using std::ifstream;
+#include <map>
+#include <vector>
 
 #include <vdr/player.h>
 #include <vdr/plugin.h>
 #include <vdr/dvbspu.h>
+#include <vdr/videodir.h>
 
 #include "softhddevice-drm-gles.h"
 #include "softhddevice_service.h"
@@ -49,6 +53,7 @@ extern "C"
 #include "audio.h"
 #include "video.h"
 #include "codec.h"
+#include "trace.h"
 }
 
 //////////////////////////////////////////////////////////////////////////////
@@ -103,6 +108,8 @@ cSoftOsd::cSoftOsd(int left, int top, uint level)
 	OsdHeight(), left, top, level);
 
     OsdLevel = level;
+    compositeRow = NULL;
+    compositeRowSize = 0;
 }
 
 /**
@@ -116,6 +123,188 @@ cSoftOsd::~cSoftOsd(void)
 
     SetActive(false);
     // done by SetActive: OsdClose();
+    free(compositeRow);
+}
+
+/**
+**	Create a true color pixmap.
+**
+**	The pixmaps are composited by the plugin, see cSoftOsd::Composite.
+*/
+cPixmap *cSoftOsd::CreatePixmap(int layer, const cRect & viewport,
+    const cRect & drawport)
+{
+    cSoftPixmap *pm;
+
+    LOCK_PIXMAPS;
+    pm = new cSoftPixmap(layer, viewport, drawport);
+    if (cOsd::AddPixmap(pm)) {
+	// find free slot
+	for (int i = 0; i < softPixmaps.Size(); i++) {
+	    if (!softPixmaps[i]) {
+		return softPixmaps[i] = pm;
+	    }
+	}
+	softPixmaps.Append(pm);
+	return pm;
+    }
+    delete pm;
+
+    return NULL;
+}
+
+/**
+**	Destroy a true color pixmap.
+*/
+void cSoftOsd::DestroyPixmap(cPixmap * pixmap)
+{
+    if (!pixmap) {
+	return;
+    }
+    LOCK_PIXMAPS;
+    // the base pixmap 0 isn't destroyed
+    for (int i = 1; i < softPixmaps.Size(); i++) {
+	if (softPixmaps[i] == pixmap) {
+	    softPixmaps[i] = NULL;
+	    cOsd::DestroyPixmap(pixmap);
+	    return;
+	}
+    }
+}
+
+/**
+**	Composite the true color pixmaps into the osd buffer.
+**
+**	Each row of the dirty area is blended premultiplied in a row
+**	buffer, layer by layer, and then written to the osd buffer.
+**
+**	@param dirty	dirty area in osd coordinates
+*/
+void cSoftOsd::Composite(const cRect & dirty)
+{
+    cVector < cSoftPixmap * >layers;
+    uint8_t *dst;
+    int pitch;
+    int xo;
+    int yo;
+    int x;
+    int y;
+    int w;
+    int h;
+    int width;
+    int height;
+    double video_aspect;
+
+    xo = dirty.X();
+    yo = dirty.Y();
+    w = dirty.Width();
+    h = dirty.Height();
+    x = xo + Left();
+    y = yo + Top();
+
+    // clip to screen
+    if (x < 0) {
+	w += x;
+	xo -= x;
+	x = 0;
+    }
+    if (y < 0) {
+	h += y;
+	yo -= y;
+	y = 0;
+    }
+    ::GetOsdSize(&width, &height, &video_aspect);
+    if (w > width - x) {
+	w = width - x;
+    }
+    if (h > height - y) {
+	h = height - y;
+    }
+    if (w <= 0 || h <= 0) {
+	return;
+    }
+
+    // visible pixmaps within the dirty area, sorted by layer
+    for (int layer = 0; layer < MAXPIXMAPLAYERS; ++layer) {
+	for (int i = 0; i < softPixmaps.Size(); ++i) {
+	    cSoftPixmap *pm = softPixmaps[i];
+
+	    if (pm && pm->Layer() == layer && !pm->DrawPort().IsEmpty()
+		&& (layer == 0 || pm->Alpha() != ALPHA_TRANSPARENT)
+		&& pm->ViewPort().Intersects(dirty)) {
+		layers.Append(pm);
+	    }
+	}
+    }
+
+    if (w > compositeRowSize) {
+	free(compositeRow);
+	compositeRow = (uint32_t *) malloc(w * sizeof(uint32_t));
+	compositeRowSize = w;
+    }
+    if (!(dst = OsdLockArea(x, y, w, h, &pitch))) {
+	Debug2(L_OSD, "OSD %s: no software osd buffer", __FUNCTION__);
+	return;
+    }
+    Debug2(L_OSD, "OSD %s: %dx%d%+d%+d, %d pixmaps", __FUNCTION__, w, h, x,
+	y, layers.Size());
+
+    for (int row = 0; row < h; ++row) {
+	int oy;
+
+	oy = yo + row;
+	memset(compositeRow, 0, w * sizeof(uint32_t));
+	for (int i = 0; i < layers.Size(); ++i) {
+	    cSoftPixmap *pm = layers[i];
+	    const cRect & vp = pm->ViewPort();
+	    const cRect & dp = pm->DrawPort();
+	    int x1;
+	    int x2;
+	    int dy;
+
+	    if (oy < vp.Top() || oy > vp.Bottom()) {
+		continue;
+	    }
+	    x1 = std::max(xo, vp.Left());
+	    x2 = std::min(xo + w, vp.Right() + 1);
+	    // the draw port position is relative to the view port
+	    dy = oy - vp.Y() - dp.Y();
+	    if (pm->Tile()) {
+		dy = (dy % dp.Height() + dp.Height()) % dp.Height();
+	    } else {
+		if (dy < 0 || dy >= dp.Height()) {
+		    continue;
+		}
+		x1 = std::max(x1, vp.X() + dp.X());
+		x2 = std::min(x2, vp.X() + dp.X() + dp.Width());
+	    }
+
+	    const tColor *src = pm->Data() + dy * dp.Width();
+
+	    while (x1 < x2) {
+		uint32_t *d;
+		int dx;
+		int n;
+
+		dx = x1 - vp.X() - dp.X();
+		if (pm->Tile()) {
+		    dx = (dx % dp.Width() + dp.Width()) % dp.Width();
+		}
+		n = std::min(x2 - x1, dp.Width() - dx);
+		d = compositeRow + x1 - xo;
+		// layer 0 is copied, not blended
+		if (pm->Layer() == 0) {
+		    memset(d, 0, n * sizeof(uint32_t));
+		    VideoOsdBlendRow(d, src + dx, n, ALPHA_OPAQUE);
+		} else {
+		    VideoOsdBlendRow(d, src + dx, n, pm->Alpha());
+		}
+		x1 += n;
+	    }
+	}
+	VideoOsdUnpremultiplyRow((uint32_t *) (dst + row * pitch), compositeRow, w);
+    }
+    OsdUnlockArea();
 }
 
 /**
@@ -146,7 +335,7 @@ eOsdError cSoftOsd::SetAreas(const tArea * areas, int n)
 */
 void cSoftOsd::Flush(void)
 {
-    cPixmapMemory *pm;
+    cRect dirty;
 
     Debug2(L_OSD, "OSD %s: level %d active %d", __FUNCTION__, OsdLevel,
 	Active());
@@ -170,11 +359,10 @@ void cSoftOsd::Flush(void)
 #endif
 	// draw all bitmaps
 	for (i = 0; (bitmap = GetBitmap(i)); ++i) {
-	    uint8_t *argb;
+	    const tColor *colors;
+	    int num_colors;
 	    int xs;
 	    int ys;
-	    int x;
-	    int y;
 	    int w;
 	    int h;
 	    int x1;
@@ -223,7 +411,7 @@ void cSoftOsd::Flush(void)
 		    }
 		    ys = 0;
 		}
-		::GetScreenSize(&width, &height, &video_aspect);
+		::GetOsdSize(&width, &height, &video_aspect);
 		if (w > width - xs - x1) {
 		    w = width - xs - x1;
 		    if (w <= 0) {
@@ -244,100 +432,38 @@ void cSoftOsd::Flush(void)
 		Fatal(": dirty area too big");
 	    }
 #endif
-	    argb = (uint8_t *) malloc(w * h * sizeof(uint32_t));
-	    for (y = y1; y <= y2; ++y) {
-		for (x = x1; x <= x2; ++x) {
-		    ((uint32_t *) argb)[x - x1 + (y - y1) * w] =
-			bitmap->GetColor(x, y);
-		}
-	    }
+	    colors = bitmap->Colors(num_colors);
 	    Debug2(L_OSD, "OSD %s: draw %dx%d%+d%+d bm", __FUNCTION__, w, h,
 		xs + x1, ys + y1);
-	    OsdDrawARGB(0, 0, w, h, w * sizeof(uint32_t), argb, xs + x1,
-		ys + y1);
+	    // palette lookup straight into the osd buffer
+	    OsdDrawIndexed(bitmap->Data(x1, y1), bitmap->Width(),
+		(const uint32_t *)colors, num_colors, w, h, xs + x1, ys + y1);
 
 	    bitmap->Clean();
-	    // FIXME: reuse argb
-	    free(argb);
 	}
 	Dirty = 0;
 	return;
     }
 
+    // composite the pixmaps ourself, instead of VDR's RenderPixmaps
     LOCK_PIXMAPS;
-    while ((pm = (dynamic_cast < cPixmapMemory * >(RenderPixmaps())))) {
-	int xp;
-	int yp;
-	int stride;
-	int x;
-	int y;
-	int w;
-	int h;
-
-	x = pm->ViewPort().X();
-	y = pm->ViewPort().Y();
-	w = pm->ViewPort().Width();
-	h = pm->ViewPort().Height();
-	stride = w * sizeof(tColor);
-
-	// clip to osd
-	xp = 0;
-	if (x < 0) {
-	    xp = -x;
-	    w -= xp;
-	    x = 0;
+    for (int i = 0; i < softPixmaps.Size(); ++i) {
+	if (softPixmaps[i]) {
+	    dirty.Combine(softPixmaps[i]->DirtyViewPort());
+	    softPixmaps[i]->SetClean();
 	}
-
-	yp = 0;
-	if (y < 0) {
-	    yp = -y;
-	    h -= yp;
-	    y = 0;
-	}
-
-	if (w > Width() - x) {
-	    w = Width() - x;
-	}
-	if (h > Height() - y) {
-	    h = Height() - y;
-	}
-
-	x += Left();
-	y += Top();
-
-	// clip to screen
-	if (1) {			// just for the case it makes trouble
-	    // and it can happen!
-	    int width;
-	    int height;
-	    double video_aspect;
-
-	    if (x < 0) {
-		w += x;
-		xp += -x;
-		x = 0;
-	    }
-	    if (y < 0) {
-		h += y;
-		yp += -y;
-		y = 0;
-	    }
-
-	    ::GetScreenSize(&width, &height, &video_aspect);
-	    if (w > width - x) {
-		w = width - x;
-	    }
-	    if (h > height - y) {
-		h = height - y;
-	    }
-	}
-	Debug2(L_OSD, "OSD %s: draw %dx%d%+d%+d*%d -> %+d%+d %p",
-	    __FUNCTION__, w, h, xp, yp, stride, x, y, pm->Data());
-	OsdDrawARGB(xp, yp, w, h, stride, pm->Data(), x, y);
-
-	DestroyPixmap(pm);
     }
-    Dirty = 0;
+    if (Dirty) {			// forced complete update
+	dirty.Set(0, 0, Width(), Height());
+	Dirty = 0;
+    }
+    dirty = dirty.Intersected(cRect(0, 0, Width(), Height()));
+    if (dirty.IsEmpty()) {
+	return;
+    }
+    cTimeMs timer;
+    Composite(dirty);
+    OsdFlushMs = timer.Elapsed();
 }
 
 //////////////////////////////////////////////////////////////////////////////
@@ -409,7 +535,7 @@ bool cSoftOsdProvider::StartOpenGlThread(void) {
     }
     cCondWait wait;
     Debug2(L_OPENGL, "Trying to start OpenGL worker thread");
-    oglThread.reset(new cOglThread(&wait, ConfigMaxSizeGPUImageCache));
+    oglThread.reset(new cOglThread(&wait, ConfigMaxSizeGPUImageCache, ConfigMaxSizeGPULayerCache));
     wait.Wait();
 
     if (oglThread->Active()) {
@@ -431,6 +557,25 @@ void cSoftOsdProvider::StopOpenGlThread(void) {
 }
 #endif
 
+/**
+**	Get the osd runtime metrics.
+**
+**	@param[out] metrics	osd values to fill in
+*/
+void cSoftOsdProvider::GetMetrics(SoftHDDevice_Metrics_v1_0_t *metrics)
+{
+    metrics->osdFlushMs = OsdFlushMs;
+#ifdef USE_GLES
+    std::shared_ptr<cOglThread> thread = oglThread;
+
+    if (thread) {
+	metrics->osdFlushMs = thread->FlushMs();
+	metrics->osdCommands = thread->CommandCount();
+	metrics->gpuCacheBytes = thread->CacheBytes();
+    }
+#endif
+}
+
 /**
 **	Create cOsdProvider class.
 */
@@ -523,12 +668,15 @@ void cMenuSetupSoft::Create(void)
 		trVDR("no"), trVDR("yes")));
 	Add(new cMenuEditBoolItem(tr("Hide main menu entry"),
 		&HideMainMenuEntry, trVDR("no"), trVDR("yes")));
+	Add(new cMenuEditIntItem(tr("Soft memory budget (MB)"), &MemBudgetSoft, 0, 4000));
+	Add(new cMenuEditIntItem(tr("Hard memory budget (MB)"), &MemBudgetHard, 0, 4000));
 	//
 	//	osd
 	//
 #ifdef USE_GLES
 	if (!DisableOglOsd) {
 		Add(new cMenuEditIntItem(tr("GPU mem used for image caching (MB)"), &MaxSizeGPUImageCache, 0, 4000));
+		Add(new cMenuEditIntItem(tr("GPU mem used for layer caching (MB)"), &MaxSizeGPULayerCache, 0, 4000));
 	}
 #endif
     }
@@ -717,6 +865,8 @@ cMenuSetupSoft::cMenuSetupSoft(void)
 #endif
     Statistics = 0;
     HideMainMenuEntry = ConfigHideMainMenuEntry;
+    MemBudgetSoft = ConfigMemBudgetSoft;
+    MemBudgetHard = ConfigMemBudgetHard;
     //
     //	audio
     //
@@ -746,6 +896,7 @@ cMenuSetupSoft::cMenuSetupSoft(void)
 
 #ifdef USE_GLES
     MaxSizeGPUImageCache = ConfigMaxSizeGPUImageCache;
+    MaxSizeGPULayerCache = ConfigMaxSizeGPULayerCache;
 #endif
 
     Create();
@@ -763,6 +914,9 @@ void cMenuSetupSoft::Store(void)
 #endif
 #endif
     SetupStore("HideMainMenuEntry", ConfigHideMainMenuEntry = HideMainMenuEntry);
+    SetupStore("MemBudgetSoft", ConfigMemBudgetSoft = MemBudgetSoft);
+    SetupStore("MemBudgetHard", ConfigMemBudgetHard = MemBudgetHard);
+    MemSetBudget(ConfigMemBudgetSoft, ConfigMemBudgetHard);
     SetupStore("AudioDelay", ConfigVideoAudioDelay = AudioDelay);
     VideoSetAudioDelay(ConfigVideoAudioDelay);
 
@@ -823,6 +977,7 @@ void cMenuSetupSoft::Store(void)
     AudioSetEq(SetupAudioEqBand, ConfigAudioEq);
 #ifdef USE_GLES
     SetupStore("MaxSizeGPUImageCache", ConfigMaxSizeGPUImageCache = MaxSizeGPUImageCache);
+    SetupStore("MaxSizeGPULayerCache", ConfigMaxSizeGPULayerCache = MaxSizeGPULayerCache);
 #endif
 }
 
@@ -1075,7 +1230,7 @@ void cSoftHdDevice::GetVideoSize(int &width, int &height, double &video_aspect)
 */
 void cSoftHdDevice::GetOsdSize(int &width, int &height, double &pixel_aspect)
 {
-    ::GetScreenSize(&width, &height, &pixel_aspect);
+    ::GetOsdSize(&width, &height, &pixel_aspect);
 }
 
 // ----------------------------------------------------------------------------
@@ -1222,6 +1377,7 @@ cPluginSoftHdDevice::~cPluginSoftHdDevice(void)
     //Debug("%s:", __FUNCTION__);
 
     ::SoftHdDeviceExit();
+    LogStop();
 }
 
 /**
@@ -1275,6 +1431,7 @@ bool cPluginSoftHdDevice::Initialize(void)
 {
     //Debug("%s:", __FUNCTION__);
 
+    LogStart();
     MyDevice = new cSoftHdDevice();
 
     return true;
@@ -1298,6 +1455,7 @@ bool cPluginSoftHdDevice::Start(void)
 		}
 	}
 	::Start();
+	cSoftHdLibrary::Startup(cVideoDirectory::Name());
 
     return true;
 }
@@ -1310,6 +1468,7 @@ void cPluginSoftHdDevice::Stop(void)
 {
     //Debug("%s:", __FUNCTION__);
 
+    cSoftHdLibrary::Shutdown();
     ::Stop();
 }
 
@@ -1371,6 +1530,16 @@ bool cPluginSoftHdDevice::SetupParse(const char *name, const char *value)
 	ConfigHideMainMenuEntry = atoi(value);
 	return true;
     }
+    if (!strcasecmp(name, "MemBudgetSoft")) {
+	ConfigMemBudgetSoft = atoi(value);
+	MemSetBudget(ConfigMemBudgetSoft, ConfigMemBudgetHard);
+	return true;
+    }
+    if (!strcasecmp(name, "MemBudgetHard")) {
+	ConfigMemBudgetHard = atoi(value);
+	MemSetBudget(ConfigMemBudgetSoft, ConfigMemBudgetHard);
+	return true;
+    }
     if (!strcasecmp(name, "AudioDelay")) {
 	VideoSetAudioDelay(ConfigVideoAudioDelay = atoi(value));
 	return true;
@@ -1512,6 +1681,10 @@ bool cPluginSoftHdDevice::SetupParse(const char *name, const char *value)
 	ConfigMaxSizeGPUImageCache = atoi(value);
 	return true;
     }
+    if (!strcasecmp(name, "MaxSizeGPULayerCache")) {
+	ConfigMaxSizeGPULayerCache = atoi(value);
+	return true;
+    }
 #endif
     return false;
 }
@@ -1572,6 +1745,55 @@ bool cPluginSoftHdDevice::Service(const char *id, void *data)
 	return true;
     }
 
+#ifdef USE_GLES
+    if (strcmp(id, OSD_RETAIN_LAYER_SERVICE) == 0) {
+	SoftHDDevice_OsdRetainLayerService_v1_0_t *r;
+	cOglPixmap *pixmap;
+
+	if (!data) {
+	    return ConfigMaxSizeGPULayerCache > 0;
+	}
+
+	r = (SoftHDDevice_OsdRetainLayerService_v1_0_t *) data;
+	r->restored = 0;
+	// only the OpenGL osd has pixmaps in GPU memory
+	if (!(pixmap = dynamic_cast<cOglPixmap *>((cPixmap *) r->pixmap))) {
+	    return false;
+	}
+	r->restored = pixmap->Retain(r->key, r->generation);
+	return true;
+    }
+#endif
+
+    if (strcmp(id, METRICS_SERVICE) == 0) {
+	SoftHDDevice_Metrics_v1_0_t *r;
+
+	if (!data) {
+	    return true;
+	}
+
+	r = (SoftHDDevice_Metrics_v1_0_t *) data;
+	if (r->structSize != sizeof(SoftHDDevice_Metrics_v1_0_t)) {
+	    return false;
+	}
+	GetMetrics(r);
+	cSoftOsdProvider::GetMetrics(r);
+	return true;
+    }
+
+    if (strcmp(id, OSD_FADE_SERVICE) == 0) {
+	SoftHDDevice_OsdFadeService_v1_0_t *r;
+
+	// without data: query if the osd plane can fade
+	if (!data) {
+	    return OsdHasPlaneAlpha();
+	}
+
+	r = (SoftHDDevice_OsdFadeService_v1_0_t *) data;
+	return OsdSetAlpha(constrain(r->alpha, ALPHA_TRANSPARENT, ALPHA_OPAQUE),
+	    r->duration);
+    }
+
     return false;
 }
 
@@ -1579,12 +1801,96 @@ bool cPluginSoftHdDevice::Service(const char *id, void *data)
 //	cPlugin SVDRP
 //----------------------------------------------------------------------------
 
+/**
+**	Format a timing histogram.
+**
+**	@param hist	histogram buckets
+**	@param json	json array instead of text
+*/
+static cString MetricsHist(const unsigned *hist, bool json)
+{
+	cString s = json ? "[" : "";
+
+	for (int i = 0; i < METRICS_HIST_BUCKETS; ++i) {
+		if (json) {
+			s = cString::sprintf("%s%s%u", *s, i ? ", " : "", hist[i]);
+		} else if (i < METRICS_HIST_BUCKETS - 1) {
+			s = cString::sprintf("%s <%dus:%u", *s, METRICS_HIST_MIN_US << i,
+				hist[i]);
+		} else {
+			s = cString::sprintf("%s more:%u", *s, hist[i]);
+		}
+	}
+	return json ? cString::sprintf("%s]", *s) : s;
+}
+
+/**
+**	Format the runtime metrics for SVDRP.
+**
+**	@param m	runtime metrics
+**	@param json	json object instead of text
+*/
+static cString MetricsText(const SoftHDDevice_Metrics_v1_0_t *m, bool json)
+{
+	const char *fmt;
+
+	if (json) {
+		fmt = "{\"video_packets\": %d, \"deint_frames\": %d, "
+			"\"display_frames\": %d, \"audio_buffer_ms\": %d,\n"
+			" \"hist_min_us\": %d,\n"
+			" \"decode_hist\": %s,\n \"filter_hist\": %s,\n"
+			" \"display_hist\": %s,\n"
+			" \"av_offset_ms\": %d, \"frames_shown\": %u, "
+			"\"dropped_late\": %u, \"dropped_seek\": %u, "
+			"\"dropped_flush\": %u, \"duped_early\": %u,\n"
+			" \"alsa_xruns\": %u, \"alsa_delay_ms\": %d,\n"
+			" \"osd_flush_ms\": %d, \"osd_commands\": %u, "
+			"\"gpu_cache_bytes\": %lld,\n"
+			" \"mem_video_packets\": %lld, \"mem_audio\": %lld, "
+			"\"mem_display\": %lld}";
+	} else {
+		fmt = "queues: packets %d, deint %d, display %d, audio %dms\n"
+			"buckets from %dus, doubling\n"
+			"decode:%s\nfilter:%s\ndisplay:%s\n"
+			"a/v offset %dms, shown %u, dropped late %u, seek %u, "
+			"flush %u, duped early %u\n"
+			"alsa: xruns %u, delay %dms\n"
+			"osd: flush %dms, commands %u, gpu cache %lld bytes\n"
+			"memory: video packets %lld, audio %lld, display %lld bytes";
+	}
+	return cString::sprintf(fmt, m->videoPackets, m->deintFrames,
+		m->displayFrames, m->audioBufferMs, METRICS_HIST_MIN_US,
+		*MetricsHist(m->decodeHist, json), *MetricsHist(m->filterHist, json),
+		*MetricsHist(m->displayHist, json), m->avOffsetMs, m->framesShown,
+		m->framesDroppedLate, m->framesDroppedSeek, m->framesDroppedFlush,
+		m->framesDupedEarly, m->alsaXruns, m->alsaDelayMs, m->osdFlushMs,
+		m->osdCommands, m->gpuCacheBytes, m->memVideoPackets, m->memAudio,
+		m->memDisplay);
+}
+
 /**
 **	SVDRP commands help text.
 **	FIXME: translation?
 */
 static const char *SVDRPHelpText[] = {
 	"PLAY Url\n" "    Play the media from the given url.\n",
+	"TRACE START|STOP [File]\n"
+	"    Start a pipeline trace, stop it and write chrome trace json\n"
+	"    to File, default trace.json in the plugin cache directory.\n",
+	"LOG [[+|-]Category ...]\n"
+	"    Enable or disable debug logging categories at runtime,\n"
+	"    without option list them. all and none change every category.\n",
+	"LOCKS [START|STOP]\n"
+	"    Start or stop the lock profiler, without option list the\n"
+	"    statistics of every mutex call site.\n",
+	"STAT [JSON]\n"
+	"    Show the runtime metrics: queue depths, timing histograms,\n"
+	"    a/v offset, drops, alsa, osd and memory, as text or json.\n",
+	"MEM\n"
+	"    Show the accounted memory per subsystem and the budgets.\n",
+	"WAKE\n"
+	"    Show the wakeups per second of the plugin threads since the\n"
+	"    last WAKE, idle threads should not wake up.\n",
 	NULL
 };
 
@@ -1608,13 +1914,92 @@ const char **cPluginSoftHdDevice::SVDRPHelpPages(void)
 */
 cString cPluginSoftHdDevice::SVDRPCommand(const char *command,
 		__attribute__ ((unused)) const char *option,
-		__attribute__ ((unused)) int &reply_code)
+		int &reply_code)
 {
 	if (!strcasecmp(command, "PLAY")) {
 		Debug2(L_MEDIA, "SVDRPCommand: %s %s", command, option);
 		cControl::Launch(new cSoftHdControl(option));
 		return "PLAY url";
 	}
+	if (!strcasecmp(command, "TRACE")) {
+		char file[256];
+		int count;
+
+		if (!strcasecmp(option, "START")) {
+			TraceStart();
+			return "trace started";
+		}
+		if (strncasecmp(option, "STOP", 4) || (option[4] && option[4] != ' ')) {
+			reply_code = 501;
+			return "TRACE START|STOP [File]";
+		}
+		option = skipspace(option + 4);
+		if (!*option) {
+			snprintf(file, sizeof(file), "%s/trace.json",
+				cPlugin::CacheDirectory(PLUGIN_NAME_I18N));
+			option = file;
+		}
+		if ((count = TraceStop(option)) < 0) {
+			reply_code = 554;
+			return cString::sprintf("can't write %s", option);
+		}
+		return cString::sprintf("%d trace events written to %s", count, option);
+	}
+	if (!strcasecmp(command, "LOG")) {
+		char buf[256];
+
+		if (*option && LogSetCategories(option) < 0) {
+			reply_code = 501;
+			return cString::sprintf("unknown category in '%s'", option);
+		}
+		LogGetCategories(buf, sizeof(buf));
+		return buf;
+	}
+	if (!strcasecmp(command, "LOCKS")) {
+		char *report;
+
+		if (!strcasecmp(option, "START")) {
+			TraceLocksStart();
+			return "lock profiling started";
+		}
+		if (!strcasecmp(option, "STOP")) {
+			TraceLocksStop();
+			return "lock profiling stopped";
+		}
+		if (*option) {
+			reply_code = 501;
+			return "LOCKS [START|STOP]";
+		}
+		if (!(report = TraceLocksReport())) {
+			reply_code = 554;
+			return "can't create report";
+		}
+		return cString(report, true);
+	}
+	if (!strcasecmp(command, "STAT")) {
+		SoftHDDevice_Metrics_v1_0_t metrics;
+
+		if (*option && strcasecmp(option, "JSON")) {
+			reply_code = 501;
+			return "STAT [JSON]";
+		}
+		metrics.structSize = sizeof(metrics);
+		GetMetrics(&metrics);
+		cSoftOsdProvider::GetMetrics(&metrics);
+		return MetricsText(&metrics, *option);
+	}
+	if (!strcasecmp(command, "MEM")) {
+		char buf[1024];
+
+		MemGetReport(buf, sizeof(buf));
+		return buf;
+	}
+	if (!strcasecmp(command, "WAKE")) {
+		char buf[512];
+
+		WakeGetReport(buf, sizeof(buf));
+		return buf;
+	}
 
     return NULL;
 }
@@ -29,6 +29,7 @@ static const char *const VERSION = "0.2.0";
 #ifdef USE_GLES
 #include "openglosd.h"
 #endif
+#include "softhddevice_service.h"
 
     /// vdr-plugin description.
 static const char *const DESCRIPTION =
@@ -50,6 +51,8 @@ char ConfigWritePngs;			///< config write pngs from OSD
 #endif
 #endif
 static char ConfigHideMainMenuEntry;	///< config hide main menu entry
+static int ConfigMemBudgetSoft;		///< config soft memory budget (MB), 0 off
+static int ConfigMemBudgetHard;		///< config hard memory budget (MB), 0 off
 static int ConfigVideoAudioDelay;	///< config audio delay
 static char ConfigAudioPassthrough;	///< config audio pass-through mask
 static char AudioPassthroughState;	///< flag audio pass-through on/off
@@ -66,9 +69,11 @@ static int ConfigAudioEq;			///< config equalizer filter
 static int SetupAudioEqBand[18];	///< config equalizer filter bands
 
 static volatile int DoMakePrimary;	///< switch primary device to this
+static int OsdFlushMs;			///< last software osd flush in ms
 
 #ifdef USE_GLES
 static int ConfigMaxSizeGPUImageCache = 128;
+static int ConfigMaxSizeGPULayerCache = 0;	///< config retained osd layers (MB), 0 off
 #endif
 
 //////////////////////////////////////////////////////////////////////////////
@@ -77,11 +82,37 @@ static int ConfigMaxSizeGPUImageCache = 128;
 //	OSD
 //////////////////////////////////////////////////////////////////////////////
 
+/**
+**	Soft device plugin true color pixmap.
+**
+**	Composited by cSoftOsd straight into the osd buffer.
+*/
+class cSoftPixmap:public cPixmapMemory
+{
+  public:
+    cSoftPixmap(int layer, const cRect & viewport,
+	const cRect & drawport = cRect::Null)
+    :cPixmapMemory(layer, viewport, drawport) {}
+    /// dirty area handling is done by the osd
+    void MarkViewPortDirty(const cRect & rect) {
+	cPixmapMemory::MarkViewPortDirty(rect);
+    }
+    void SetClean(void) {
+	cPixmapMemory::SetClean();
+    }
+};
+
 /**
 **	Soft device plugin OSD class.
 */
 class cSoftOsd:public cOsd
 {
+  private:
+    cVector < cSoftPixmap * >softPixmaps;	///< true color pixmaps
+    uint32_t *compositeRow;		///< premultiplied row for compositing
+    int compositeRowSize;		///< size of composite row in pixel
+    void Composite(const cRect &);	///< composite pixmaps into the osd
+
   public:
     static volatile char Dirty;		///< flag force redraw everything
     int OsdLevel;			///< current osd level FIXME: remove
@@ -90,6 +121,10 @@ class cSoftOsd:public cOsd
      virtual ~ cSoftOsd(void);		///< osd destructor
     /// set the sub-areas to the given areas
     virtual eOsdError SetAreas(const tArea *, int);
+    /// create a true color pixmap
+    virtual cPixmap *CreatePixmap(int, const cRect &, const cRect & =
+	cRect::Null);
+    virtual void DestroyPixmap(cPixmap *);	///< destroy a pixmap
     virtual void Flush(void);		///< commits all data to the hardware
     virtual void SetActive(bool);	///< sets OSD to be the active one
 };
@@ -124,6 +159,7 @@ class cSoftOsdProvider:public cOsdProvider
     static const cImage *GetImageData(int ImageHandle);
     static void OsdSizeChanged(void);
 #endif
+    static void GetMetrics(SoftHDDevice_Metrics_v1_0_t *);
     virtual ~cSoftOsdProvider();	///< OSD provider destructor
 };
 
@@ -172,6 +208,8 @@ class cMenuSetupSoft:public cMenuSetupPage
 #endif
     int Statistics;
     int HideMainMenuEntry;
+    int MemBudgetSoft;
+    int MemBudgetHard;
 
     int Audio;
     int AudioDelay;
@@ -195,6 +233,7 @@ class cMenuSetupSoft:public cMenuSetupPage
 
 #ifdef USE_GLES
     int MaxSizeGPUImageCache;
+    int MaxSizeGPULayerCache;
 #endif
 
     /// @}
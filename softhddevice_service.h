@@ -24,6 +24,12 @@
 
 #define ATMO_GRAB_SERVICE	"SoftHDDevice-AtmoGrabService-v1.0"
 #define ATMO1_GRAB_SERVICE	"SoftHDDevice-AtmoGrabService-v1.1"
+#define OSD_FADE_SERVICE	"SoftHDDevice-OsdFade-v1.0"
+#define OSD_RETAIN_LAYER_SERVICE	"SoftHDDevice-OsdRetainLayer-v1.0"
+#define METRICS_SERVICE		"SoftHDDevice-Metrics-v1.0"
+
+#define METRICS_HIST_BUCKETS	12	///< buckets of a timing histogram
+#define METRICS_HIST_MIN_US	128	///< upper bound of the first bucket
 
 enum
 { GRAB_IMG_RGBA_FORMAT_B8G8R8A8 };
@@ -62,3 +68,70 @@ typedef struct
 
     void *img;
 } SoftHDDevice_AtmoGrabService_v1_1_t;
+
+typedef struct
+{
+    // request data
+
+    int alpha;				///< target osd alpha (0 - 255)
+    int duration;			///< fade duration in ms
+} SoftHDDevice_OsdFadeService_v1_0_t;
+
+typedef struct
+{
+    // request data
+
+    void *pixmap;			///< cPixmap created by the osd
+    const char *key;			///< skin provided identity of the content
+    int generation;			///< content generation, change on redraw
+
+    // reply data
+
+    int restored;			///< content restored, don't draw the pixmap
+} SoftHDDevice_OsdRetainLayerService_v1_0_t;
+
+typedef struct
+{
+    // request data
+
+    int structSize;			///< sizeof(SoftHDDevice_Metrics_v1_0_t)
+
+    // reply data, queue depths
+
+    int videoPackets;			///< video packets waiting for the decoder
+    int deintFrames;			///< frames waiting for the deinterlacer
+    int displayFrames;			///< frames waiting for display
+    int audioBufferMs;			///< audio in the ring buffer in ms
+
+    // timing histograms, bucket i counts below METRICS_HIST_MIN_US << i us
+
+    unsigned decodeHist[METRICS_HIST_BUCKETS];	///< decoder time per frame
+    unsigned filterHist[METRICS_HIST_BUCKETS];	///< deinterlacer time per frame
+    unsigned displayHist[METRICS_HIST_BUCKETS];	///< commit to page flip
+
+    // a/v sync, drops and dups by cause
+
+    int avOffsetMs;			///< video - audio of the last frame
+    unsigned framesShown;		///< frames shown since stream start
+    unsigned framesDroppedLate;		///< dropped, video behind audio
+    unsigned framesDroppedSeek;		///< dropped before the seek target
+    unsigned framesDroppedFlush;	///< queued frames dropped on close
+    unsigned framesDupedEarly;		///< repeated, video ahead of audio
+
+    // alsa
+
+    unsigned alsaXruns;			///< underruns recovered
+    int alsaDelayMs;			///< last pcm delay
+
+    // osd
+
+    int osdFlushMs;			///< duration of the last osd flush
+    unsigned osdCommands;		///< OpenGL osd commands executed
+    long long gpuCacheBytes;		///< OpenGL image and layer cache
+
+    // memory per subsystem
+
+    long long memVideoPackets;		///< video packet ring buffer
+    long long memAudio;			///< audio ring buffer
+    long long memDisplay;		///< DRM dumb buffers, video and osd
+} SoftHDDevice_Metrics_v1_0_t;
@@ -0,0 +1,606 @@
+///
+///	@file trace.c	@brief Pipeline trace module
+///
+///	Copyright (c) 2020 by zille.  All Rights Reserved.
+///
+///	Contributor(s):
+///
+///	License: AGPLv3
+///
+///	This program is free software: you can redistribute it and/or modify
+///	it under the terms of the GNU Affero General Public License as
+///	published by the Free Software Foundation, either version 3 of the
+///	License.
+///
+///	This program is distributed in the hope that it will be useful,
+///	but WITHOUT ANY WARRANTY; without even the implied warranty of
+///	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+///	GNU Affero General Public License for more details.
+///
+///	$Id$
+//////////////////////////////////////////////////////////////////////////////
+
+///
+///	@defgroup Trace The pipeline trace module.
+///
+///	Every thread writes fixed size events into its own ring buffer,
+///	there are no locks on the hot path. Rings are created with the
+///	first event of a thread and never freed, a new capture resets them.
+///	The capture is written as chrome trace json, to be opened in
+///	chrome://tracing or ui.perfetto.dev.
+///
+///	The lock profiler counts acquisitions, contention, wait and hold
+///	time for every call site of the profiled mutexes. The counters of
+///	a site are only changed while its mutex is held, so they need no
+///	extra locking.
+///
+///	The duration histograms are always on, they feed the runtime
+///	metrics. Every histogram is written by one thread only.
+///
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+
+#include <libavutil/avutil.h>
+
+#include "misc.h"
+#include "trace.h"
+
+#define TRACE_RING_SIZE	(1 << 14)	///< events per thread, power of 2
+#define TRACE_LOCKS_HELD	8	///< nested locks per thread
+
+    /// trace event
+struct trace_event
+{
+    uint64_t Time;			///< CLOCK_MONOTONIC in ns
+    int64_t Pts;			///< pts of the packet or frame
+    int Stage;				///< enum TraceStage
+};
+
+    /// trace ring of a thread
+struct trace_ring
+{
+    struct trace_ring *Next;		///< list of all rings
+    int Generation;			///< capture the events belong to
+    int Exited;				///< thread has exited, ring can be reused
+    int Tid;				///< kernel thread id
+    char Name[16];			///< thread name
+    unsigned Write;			///< events written, wraps
+    struct trace_event Events[TRACE_RING_SIZE];
+};
+
+volatile int TraceEnabled;		///< tracing is running
+
+static volatile int TraceGeneration;	///< current capture
+static uint64_t TraceStartTime;		///< start of the capture in ns
+static struct trace_ring *TraceRings;	///< all rings
+static pthread_mutex_t TraceMutex = PTHREAD_MUTEX_INITIALIZER;
+static __thread struct trace_ring *TraceRing;	///< ring of this thread
+static pthread_key_t TraceRingKey;	///< releases the ring at thread exit
+static pthread_once_t TraceRingOnce = PTHREAD_ONCE_INIT;
+
+    /// mutex held by a thread
+struct trace_held
+{
+    pthread_mutex_t *Mutex;		///< locked mutex
+    struct trace_lock_site *Site;	///< where it was locked
+    uint64_t Time;			///< when it was locked
+};
+
+volatile int TraceLocksEnabled;		///< lock profiling is running
+
+static volatile int TraceLocksGeneration;	///< current lock capture
+static struct trace_lock_site *TraceLockSites;	///< all lock sites
+static __thread struct trace_held TraceHeld[TRACE_LOCKS_HELD];
+static __thread int TraceHeldCount;	///< entries in TraceHeld
+static __thread int TraceHeldGeneration;	///< capture of TraceHeld
+
+static const char *TraceStageNames[TRACE_STAGES] = {
+    "video in", "video send", "video frame", "video filter",
+    "video enqueue", "video display", "video flip",
+    "audio in", "audio frame", "audio write",
+};
+
+///
+///	Get monotonic time in ns.
+///
+uint64_t TraceTime(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+///
+///	Release the ring of an exited thread.
+///
+///	Its events stay in the running capture, the ring is reused by a
+///	later thread.
+///
+static void TraceRingExit(void *arg)
+{
+    struct trace_ring *ring;
+
+    ring = arg;
+    pthread_mutex_lock(&TraceMutex);
+    ring->Exited = 1;
+    pthread_mutex_unlock(&TraceMutex);
+}
+
+///
+///	Create the thread exit key of the rings.
+///
+static void TraceRingKeyInit(void)
+{
+    pthread_key_create(&TraceRingKey, TraceRingExit);
+}
+
+///
+///	Create the ring of the calling thread.
+///
+///	Short lived threads, like the media player ones, reuse the rings
+///	of exited threads, which aren't needed by the running capture.
+///
+static struct trace_ring *TraceNewRing(void)
+{
+    struct trace_ring *ring;
+
+    pthread_once(&TraceRingOnce, TraceRingKeyInit);
+
+    pthread_mutex_lock(&TraceMutex);
+    for (ring = TraceRings; ring; ring = ring->Next) {
+	if (ring->Exited && ring->Generation != TraceGeneration) {
+	    break;
+	}
+    }
+    if (!ring) {
+	if (!(ring = calloc(1, sizeof(*ring)))) {
+	    pthread_mutex_unlock(&TraceMutex);
+	    return NULL;
+	}
+	ring->Next = TraceRings;
+	TraceRings = ring;
+    }
+    ring->Exited = 0;
+    ring->Write = 0;
+    ring->Tid = syscall(SYS_gettid);
+    pthread_getname_np(pthread_self(), ring->Name, sizeof(ring->Name));
+    pthread_mutex_unlock(&TraceMutex);
+
+    pthread_setspecific(TraceRingKey, ring);
+
+    return ring;
+}
+
+///
+///	Record a trace event.
+///
+///	Use the Trace() macro, it skips the call while tracing is off.
+///
+///	@param stage	enum TraceStage
+///	@param pts	pts or AV_NOPTS_VALUE
+///
+void TraceEvent(int stage, int64_t pts)
+{
+    struct trace_ring *ring;
+    struct trace_event *event;
+
+    if (!(ring = TraceRing) && !(ring = TraceRing = TraceNewRing())) {
+	return;
+    }
+    if (ring->Generation != TraceGeneration) {
+	ring->Generation = TraceGeneration;
+	ring->Write = 0;
+    }
+
+    event = &ring->Events[ring->Write & (TRACE_RING_SIZE - 1)];
+    event->Time = TraceTime();
+    event->Pts = pts;
+    event->Stage = stage;
+    ring->Write++;
+}
+
+///
+///	Start a trace capture.
+///
+void TraceStart(void)
+{
+    TraceStartTime = TraceTime();
+    TraceGeneration++;
+    TraceEnabled = 1;
+}
+
+///
+///	Stop the trace capture and write it.
+///
+///	Only the last TRACE_RING_SIZE events of every thread are kept.
+///
+///	@param file	json output file, NULL only stops the capture
+///
+///	@returns number of written events, -1 on error
+///
+int TraceStop(const char *file)
+{
+    struct trace_ring *ring;
+    FILE *f;
+    int count;
+
+    TraceEnabled = 0;
+    // let trace points in progress finish
+    usleep(10000);
+    if (!file) {
+	return 0;
+    }
+
+    if (!(f = fopen(file, "w"))) {
+	Error("trace: can't write %s: %m", file);
+	return -1;
+    }
+
+    count = 0;
+    fprintf(f, "{\"traceEvents\":[\n");
+    pthread_mutex_lock(&TraceMutex);
+    for (ring = TraceRings; ring; ring = ring->Next) {
+	unsigned i;
+
+	if (ring->Generation != TraceGeneration || !ring->Write) {
+	    continue;
+	}
+	fprintf(f, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+	    "\"tid\":%d,\"args\":{\"name\":\"%s\"}}", count ? ",\n" : "",
+	    ring->Tid, ring->Name);
+	count++;
+
+	i = ring->Write > TRACE_RING_SIZE ? ring->Write - TRACE_RING_SIZE : 0;
+	for (; i < ring->Write; ++i) {
+	    const struct trace_event *event =
+		&ring->Events[i & (TRACE_RING_SIZE - 1)];
+
+	    if (event->Time < TraceStartTime) {
+		continue;
+	    }
+	    fprintf(f, ",\n{\"name\":\"%s\",\"ph\":\"i\",\"s\":\"t\",\"pid\":1,"
+		"\"tid\":%d,\"ts\":%.3f", TraceStageNames[event->Stage],
+		ring->Tid, (event->Time - TraceStartTime) / 1000.0);
+	    if (event->Pts != (int64_t) AV_NOPTS_VALUE) {
+		fprintf(f, ",\"args\":{\"pts\":%lld}", (long long)event->Pts);
+	    }
+	    fprintf(f, "}");
+	    count++;
+	}
+    }
+    pthread_mutex_unlock(&TraceMutex);
+    fprintf(f, "\n]}\n");
+
+    if (fclose(f)) {
+	Error("trace: can't write %s: %m", file);
+	return -1;
+    }
+    return count;
+}
+
+    /// trace event with pts, for the latency statistics
+struct trace_match
+{
+    int64_t Pts;			///< pts of the event
+    uint64_t Time;			///< time of the event
+    int Stage;				///< enum TraceStage
+};
+
+///
+///	Compare trace events by pts and time.
+///
+static int TraceMatchCmp(const void *a, const void *b)
+{
+    const struct trace_match *x = a;
+    const struct trace_match *y = b;
+
+    if (x->Pts != y->Pts) {
+	return x->Pts < y->Pts ? -1 : 1;
+    }
+    if (x->Time != y->Time) {
+	return x->Time < y->Time ? -1 : 1;
+    }
+    return 0;
+}
+
+///
+///	Print the latency between the stages of the last capture.
+///
+///	Events of different stages are matched by their pts. For every
+///	pts the first event of each stage counts, the latency is taken to
+///	the previous stage of the same (video or audio) chain which has
+///	seen the pts.
+///
+///	@param f	output file
+///
+void TraceLatencies(FILE * f)
+{
+    static uint64_t sum[TRACE_STAGES][TRACE_STAGES];
+    static uint64_t max[TRACE_STAGES][TRACE_STAGES];
+    static int count[TRACE_STAGES][TRACE_STAGES];
+    struct trace_match *events;
+    struct trace_ring *ring;
+    int n;
+    int i;
+    int j;
+
+    memset(sum, 0, sizeof(sum));
+    memset(max, 0, sizeof(max));
+    memset(count, 0, sizeof(count));
+
+    // collect the events with pts
+    pthread_mutex_lock(&TraceMutex);
+    n = 0;
+    for (ring = TraceRings; ring; ring = ring->Next) {
+	if (ring->Generation == TraceGeneration) {
+	    n += ring->Write > TRACE_RING_SIZE ? TRACE_RING_SIZE : ring->Write;
+	}
+    }
+    if (!(events = malloc((n + 1) * sizeof(*events)))) {
+	pthread_mutex_unlock(&TraceMutex);
+	return;
+    }
+    n = 0;
+    for (ring = TraceRings; ring; ring = ring->Next) {
+	unsigned k;
+
+	if (ring->Generation != TraceGeneration) {
+	    continue;
+	}
+	k = ring->Write > TRACE_RING_SIZE ? ring->Write - TRACE_RING_SIZE : 0;
+	for (; k < ring->Write; ++k) {
+	    const struct trace_event *event =
+		&ring->Events[k & (TRACE_RING_SIZE - 1)];
+
+	    if (event->Pts == (int64_t) AV_NOPTS_VALUE
+		|| event->Time < TraceStartTime) {
+		continue;
+	    }
+	    events[n].Pts = event->Pts;
+	    events[n].Time = event->Time;
+	    events[n].Stage = event->Stage;
+	    n++;
+	}
+    }
+    pthread_mutex_unlock(&TraceMutex);
+
+    qsort(events, n, sizeof(*events), TraceMatchCmp);
+
+    for (i = 0; i < n; i = j) {
+	uint64_t first[TRACE_STAGES];
+	int prev;
+	int s;
+
+	memset(first, 0, sizeof(first));
+	for (j = i; j < n && events[j].Pts == events[i].Pts; ++j) {
+	    if (!first[events[j].Stage]) {
+		first[events[j].Stage] = events[j].Time;
+	    }
+	}
+	prev = -1;
+	for (s = 0; s < TRACE_STAGES; ++s) {
+	    if (s == TRACE_AUDIO_IN) {
+		prev = -1;
+	    }
+	    if (!first[s]) {
+		continue;
+	    }
+	    if (prev >= 0 && first[s] >= first[prev]) {
+		uint64_t d = first[s] - first[prev];
+
+		sum[prev][s] += d;
+		if (d > max[prev][s]) {
+		    max[prev][s] = d;
+		}
+		count[prev][s]++;
+	    }
+	    prev = s;
+	}
+    }
+    free(events);
+
+    for (i = 0; i < TRACE_STAGES; ++i) {
+	for (j = 0; j < TRACE_STAGES; ++j) {
+	    if (!count[i][j]) {
+		continue;
+	    }
+	    fprintf(f, "latency \"%s\" -> \"%s\": count=%d avg_us=%llu max_us=%llu\n",
+		TraceStageNames[i], TraceStageNames[j], count[i][j],
+		(unsigned long long)(sum[i][j] / count[i][j] / 1000),
+		(unsigned long long)(max[i][j] / 1000));
+	}
+    }
+}
+
+///
+///	Lock a mutex and count it for the call site.
+///
+///	Use the TraceMutexLock() macro, it has the static call site.
+///
+///	@param site	call site
+///	@param mutex	mutex to lock
+///
+void TraceLock(struct trace_lock_site *site, pthread_mutex_t * mutex)
+{
+    uint64_t start;
+    uint64_t now;
+    int contended;
+
+    contended = 0;
+    if (pthread_mutex_trylock(mutex)) {
+	start = TraceTime();
+	pthread_mutex_lock(mutex);
+	now = TraceTime();
+	contended = 1;
+    } else {
+	start = now = TraceTime();
+    }
+
+    // mutex is held from here on, counters of the site are ours
+    if (site->Generation != TraceLocksGeneration) {
+	site->Generation = TraceLocksGeneration;
+	site->Count = 0;
+	site->Contended = 0;
+	site->WaitNs = 0;
+	site->MaxWaitNs = 0;
+	site->HoldNs = 0;
+	site->MaxHoldNs = 0;
+	if (!site->Registered) {
+	    pthread_mutex_lock(&TraceMutex);
+	    site->Next = TraceLockSites;
+	    TraceLockSites = site;
+	    site->Registered = 1;
+	    pthread_mutex_unlock(&TraceMutex);
+	}
+    }
+    site->Count++;
+    if (contended) {
+	site->Contended++;
+	site->WaitNs += now - start;
+	if (now - start > site->MaxWaitNs) {
+	    site->MaxWaitNs = now - start;
+	}
+    }
+
+    if (TraceHeldGeneration != TraceLocksGeneration) {
+	TraceHeldGeneration = TraceLocksGeneration;
+	TraceHeldCount = 0;
+    }
+    if (TraceHeldCount < TRACE_LOCKS_HELD) {
+	TraceHeld[TraceHeldCount].Mutex = mutex;
+	TraceHeld[TraceHeldCount].Site = site;
+	TraceHeld[TraceHeldCount].Time = now;
+	TraceHeldCount++;
+    }
+}
+
+///
+///	Count the hold time of a mutex.
+///
+///	Must be called while the mutex is still held. Mutexes locked
+///	before the profiling started are ignored.
+///
+///	@param mutex	mutex which is released next
+///
+void TraceUnlock(pthread_mutex_t * mutex)
+{
+    struct trace_lock_site *site;
+    uint64_t hold;
+    int i;
+
+    if (TraceHeldGeneration != TraceLocksGeneration) {
+	return;
+    }
+    for (i = TraceHeldCount - 1; i >= 0; --i) {
+	if (TraceHeld[i].Mutex == mutex) {
+	    break;
+	}
+    }
+    if (i < 0) {
+	return;
+    }
+
+    site = TraceHeld[i].Site;
+    hold = TraceTime() - TraceHeld[i].Time;
+    site->HoldNs += hold;
+    if (hold > site->MaxHoldNs) {
+	site->MaxHoldNs = hold;
+    }
+
+    TraceHeldCount--;
+    for (; i < TraceHeldCount; ++i) {
+	TraceHeld[i] = TraceHeld[i + 1];
+    }
+}
+
+///
+///	Reset the lock statistics and start lock profiling.
+///
+void TraceLocksStart(void)
+{
+    TraceLocksGeneration++;
+    TraceLocksEnabled = 1;
+}
+
+///
+///	Stop lock profiling, the statistics are kept for the report.
+///
+void TraceLocksStop(void)
+{
+    TraceLocksEnabled = 0;
+}
+
+///
+///	Get the lock statistics as text.
+///
+///	One line per call site: acquisitions, contended acquisitions,
+///	total and max wait time, total and max hold time in us. The hold
+///	time of a condition wait ends with the wait.
+///
+///	@returns malloced text, NULL on error
+///
+char *TraceLocksReport(void)
+{
+    struct trace_lock_site *site;
+    FILE *f;
+    char *text;
+    size_t size;
+
+    if (!(f = open_memstream(&text, &size))) {
+	return NULL;
+    }
+    fprintf(f, "%-20s %-28s %9s %9s %10s %9s %10s %9s\n", "mutex", "site",
+	"count", "contended", "wait us", "max us", "hold us", "max us");
+
+    pthread_mutex_lock(&TraceMutex);
+    for (site = TraceLockSites; site; site = site->Next) {
+	const char *file;
+
+	if (site->Generation != TraceLocksGeneration) {
+	    continue;
+	}
+	file = strrchr(site->File, '/') ? strrchr(site->File, '/') + 1 : site->File;
+	fprintf(f, "%-20s %22s:%-5d %9llu %9llu %10llu %9llu %10llu %9llu\n",
+	    site->Name, file, site->Line, (unsigned long long)site->Count,
+	    (unsigned long long)site->Contended,
+	    (unsigned long long)site->WaitNs / 1000,
+	    (unsigned long long)site->MaxWaitNs / 1000,
+	    (unsigned long long)site->HoldNs / 1000,
+	    (unsigned long long)site->MaxHoldNs / 1000);
+    }
+    pthread_mutex_unlock(&TraceMutex);
+
+    if (fclose(f)) {
+	free(text);
+	return NULL;
+    }
+    return text;
+}
+
+///
+///	Count a duration in a histogram.
+///
+///	@param hist	duration histogram
+///	@param ns	duration in ns
+///
+void TraceHistAdd(struct trace_hist *hist, uint64_t ns)
+{
+    uint64_t us;
+    int i;
+
+    us = ns / 1000;
+    for (i = 0; i < TRACE_HIST_BUCKETS - 1; ++i) {
+	if (us < (uint64_t)TRACE_HIST_MIN_US << i) {
+	    break;
+	}
+    }
+    hist->Bucket[i]++;
+}
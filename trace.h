@@ -0,0 +1,142 @@
+///
+///	@file trace.h	@brief Pipeline trace module header file
+///
+///	Copyright (c) 2020 by zille.  All Rights Reserved.
+///
+///	Contributor(s):
+///
+///	License: AGPLv3
+///
+///	This program is free software: you can redistribute it and/or modify
+///	it under the terms of the GNU Affero General Public License as
+///	published by the Free Software Foundation, either version 3 of the
+///	License.
+///
+///	This program is distributed in the hope that it will be useful,
+///	but WITHOUT ANY WARRANTY; without even the implied warranty of
+///	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+///	GNU Affero General Public License for more details.
+///
+///	$Id$
+//////////////////////////////////////////////////////////////////////////////
+
+/// @addtogroup Trace
+/// @{
+
+#ifndef __TRACE_H
+#define __TRACE_H
+
+    /// trace points of the audio and video pipeline
+enum TraceStage
+{
+    TRACE_VIDEO_IN,			///< video packet ingress
+    TRACE_VIDEO_SEND,			///< video packet sent to the decoder
+    TRACE_VIDEO_FRAME,			///< video frame from the decoder
+    TRACE_VIDEO_FILTER,			///< video frame from the deinterlacer
+    TRACE_VIDEO_ENQUEUE,		///< video frame in the display queue
+    TRACE_VIDEO_DISPLAY,		///< video frame taken for display
+    TRACE_VIDEO_FLIP,			///< page flip done
+    TRACE_AUDIO_IN,			///< audio packet ingress
+    TRACE_AUDIO_FRAME,			///< audio frame from the decoder
+    TRACE_AUDIO_WRITE,			///< audio samples written to alsa
+    TRACE_STAGES
+};
+
+    /// tracing is running
+extern volatile int TraceEnabled;
+
+    /// record a trace event
+extern void TraceEvent(int, int64_t);
+
+    /// start capture
+extern void TraceStart(void);
+
+    /// stop capture and write chrome trace json
+extern int TraceStop(const char *);
+
+    /// print the latency between the stages of the last capture
+extern void TraceLatencies(FILE *);
+
+    /// trace point, nearly free while tracing is off
+#define Trace(stage, pts) \
+    do { if (TraceEnabled) TraceEvent(stage, pts); } while (0)
+
+    /// lock statistics of a call site
+struct trace_lock_site
+{
+    const char *Name;			///< name of the mutex
+    const char *File;			///< source file
+    int Line;				///< source line
+    int Registered;			///< site is in the list
+    int Generation;			///< capture the counters belong to
+    struct trace_lock_site *Next;	///< list of all sites
+    uint64_t Count;			///< acquisitions
+    uint64_t Contended;			///< acquisitions which had to wait
+    uint64_t WaitNs;			///< total wait time
+    uint64_t MaxWaitNs;			///< longest wait
+    uint64_t HoldNs;			///< total hold time
+    uint64_t MaxHoldNs;			///< longest hold
+};
+
+    /// lock profiling is running
+extern volatile int TraceLocksEnabled;
+
+    /// lock a mutex and count it for the call site
+extern void TraceLock(struct trace_lock_site *, pthread_mutex_t *);
+
+    /// count the hold time of a mutex, before it is released
+extern void TraceUnlock(pthread_mutex_t *);
+
+    /// reset the lock statistics and start profiling
+extern void TraceLocksStart(void);
+
+    /// stop lock profiling
+extern void TraceLocksStop(void);
+
+    /// lock statistics as text, must be freed
+extern char *TraceLocksReport(void);
+
+    /// initializer of a call site, all members for -Wextra in C and C++
+#define TRACE_LOCK_SITE(name) \
+    { name, __FILE__, __LINE__, 0, 0, 0, 0, 0, 0, 0, 0, 0 }
+
+    /// lock a profiled mutex, plain pthread_mutex_lock while profiling is off
+#define TraceMutexLock(mutex) \
+    do { \
+	static struct trace_lock_site trace_site_ = TRACE_LOCK_SITE(#mutex); \
+	if (TraceLocksEnabled) TraceLock(&trace_site_, &(mutex)); \
+	else pthread_mutex_lock(&(mutex)); \
+    } while (0)
+
+    /// unlock a profiled mutex
+#define TraceMutexUnlock(mutex) \
+    do { \
+	if (TraceLocksEnabled) TraceUnlock(&(mutex)); \
+	pthread_mutex_unlock(&(mutex)); \
+    } while (0)
+
+    /// wait on a condition, the hold time of the mutex ends here
+#define TraceCondWait(cond, mutex) \
+    do { \
+	if (TraceLocksEnabled) TraceUnlock(&(mutex)); \
+	pthread_cond_wait(&(cond), &(mutex)); \
+    } while (0)
+
+#define TRACE_HIST_BUCKETS 12		///< buckets of a duration histogram
+#define TRACE_HIST_MIN_US 128		///< upper bound of the first bucket
+
+    /// duration histogram, bucket i counts below TRACE_HIST_MIN_US << i us
+struct trace_hist
+{
+    uint32_t Bucket[TRACE_HIST_BUCKETS];
+};
+
+    /// monotonic time in ns
+extern uint64_t TraceTime(void);
+
+    /// count a duration in ns
+extern void TraceHistAdd(struct trace_hist *, uint64_t);
+
+#endif
+
+/// @}
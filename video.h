@@ -40,6 +40,7 @@
 
 #include "iatomic.h"
 #include "softhddev.h"
+#include "trace.h"
 
 //----------------------------------------------------------------------------
 //	Defines
@@ -47,6 +48,10 @@
 
 #define VIDEO_SURFACES_MAX	3	///< video output surfaces for queue
 
+#define VIDEO_SYNC_DROP_MS 5		///< drop frames later than this
+#define VIDEO_SYNC_DUP_MS 35		///< dup frames earlier than this
+#define VIDEO_SYNC_JUMP_MS 5000		///< larger offsets are pts jumps
+
 #define VIDEO_PLANE		0
 #define OSD_PLANE		1
 #define MAX_PLANES		2
@@ -71,6 +76,10 @@ struct drm_buf {
 #endif
 };
 
+struct osd_rect {
+	int x1, y1, x2, y2;		///< x2, y2 exclusive, empty if x2 <= x1
+};
+
 struct plane_properties {
 	uint64_t crtc_id;
 	uint64_t fb_id;
@@ -110,6 +119,7 @@ struct _Drm_Render_
 	int TrickSpeed;			///< current trick speed
 //	int TrickCounter;			///< current trick speed counter
 	int VideoPaused;
+	int AudioOnly;			///< no video, video threads idle
 	int Closing;			///< flag about closing current stream
 	int Filter_Bug;
 	int Filter_Frames;
@@ -117,8 +127,16 @@ struct _Drm_Render_
 	int StartCounter;			///< counter for video start
 	int FramesDuped;			///< number of frames duplicated
 	int FramesDropped;			///< number of frames dropped
+	int FramesSkipped;			///< frames dropped before the seek target
+	int FramesFlushed;			///< queued frames dropped on close
+	int AvOffset;			///< video - audio of the last frame in ms
+	struct trace_hist DecodeHist;	///< decoder time per frame
+	struct trace_hist FilterHist;	///< deinterlacer time per frame
+	struct trace_hist DisplayHist;	///< commit to flip event
+	uint64_t CommitTime;		///< time of the last commit
 	AVRational *timebase;		///< pointer to AVCodecContext pkts_timebase
 	int64_t pts;
+	int64_t SkipPts;			///< drop frames before, seek target
 
 	int CodecMode;			/// CODEC_BY_ID, CODEC_NO_MPEG_HW, CODEC_V4L2M2M_H264
 
@@ -141,6 +159,13 @@ struct _Drm_Render_
 	struct drm_buf *act_buf;
 	struct drm_buf bufs[36];
 	struct drm_buf *buf_osd;
+	struct drm_buf *bufs_osd[2];	///< software osd front/back buffer
+	int osd_back;			///< index of the software osd back buffer
+	int OsdFlip;			///< osd back buffer committed, swap after the flip event
+	int OsdDrawing;			///< draws running in the osd back buffer
+	struct osd_rect OsdDamage;	///< drawn into the back buffer since the last flip
+	struct osd_rect OsdSync;	///< damage of the last flip, not copied to the back buffer yet
+	struct osd_rect OsdExtent;	///< area with osd content since the last clear
 	struct drm_buf buf_black;
 	int use_zpos;
 	uint64_t zpos_overlay;
@@ -152,6 +177,14 @@ struct _Drm_Render_
 	int enqueue_buffer;
 	int OsdShown;
 
+	int OsdPlaneAlpha;			///< osd plane has an alpha property
+	// osd fade state, protected by OsdMutex
+	int OsdAlpha;			///< osd plane alpha set with the last commit
+	int OsdAlphaFrom;			///< osd fade start alpha
+	int OsdAlphaTo;			///< osd fade target alpha
+	uint32_t OsdFadeStart;		///< osd fade start time in ms
+	atomic_t OsdFadeDuration;		///< osd fade duration in ms, 0 no fade
+
 #ifdef USE_GLES
 	struct gbm_device *gbm_device;
 	struct gbm_surface *gbm_surface;
@@ -212,6 +245,12 @@ extern void VideoSetClosing(VideoRender *);
     /// Set trick play speed.
 extern void VideoSetTrickSpeed(VideoRender *, int);
 
+    /// Drop decoded frames before pts
+extern void VideoSetSkipPts(VideoRender *, int64_t);
+
+    /// Set audio only mode, video threads idle
+extern void VideoSetAudioOnly(VideoRender *, int);
+
     /// Set video output position and size
 extern void VideoSetOutputPosition(VideoRender *, int, int, int, int);
 
@@ -230,15 +269,60 @@ extern uint8_t *VideoGrabService(int *, int *, int *);
     /// Get decoder statistics.
 extern void VideoGetStats(VideoRender *, int *, int *, int *);
 
+    /// Get runtime metrics.
+extern void VideoGetMetrics(VideoRender *, SoftHDDevice_Metrics_v1_0_t *);
+
+    /// a/v sync decision for a frame
+enum VideoSync
+{
+    VIDEO_SYNC_SHOW,			///< show the frame
+    VIDEO_SYNC_DROP,			///< frame is late, drop it
+    VIDEO_SYNC_DUP,			///< frame is early, show the last again
+};
+
+    /// Decide about a frame by its a/v offset.
+extern int VideoSyncAction(int, int);
+
     /// Get screen size
 extern void VideoGetScreenSize(VideoRender *, int *, int *, double *);
 
+    /// Get osd size
+extern void VideoGetOsdSize(VideoRender *, int *, int *, double *);
+
     /// Get video size
 extern void VideoGetVideoSize(VideoDecoder *, int *, int *, double *);
 
+    /// Draw an 8 bit palette image into the osd
+extern void VideoOsdDrawIndexed(VideoRender *, const uint8_t *, int,
+    const uint32_t *, int, int, int, int, int);
+
+    /// Lock an area of the software osd buffer for direct drawing
+extern uint8_t *VideoOsdLockArea(VideoRender *, int, int, int, int, int *);
+
+    /// Unlock the software osd buffer
+extern void VideoOsdUnlockArea(VideoRender *);
+
+    /// Set osd plane alpha (fade)
+extern int VideoSetOsdAlpha(VideoRender *, int, int);
+
+    /// Get osd plane alpha
+extern int VideoGetOsdAlpha(VideoRender *);
+
+    /// Blend an ARGB row over a premultiplied row
+extern void VideoOsdBlendRow(uint32_t *, const uint32_t *, int, int);
+
+    /// Convert a premultiplied ARGB row back to ARGB
+extern void VideoOsdUnpremultiplyRow(uint32_t *, const uint32_t *, int);
+
     /// Set display resolution
 extern void VideoSetDisplay(const char *);
 
+    /// Use the null display, without a DRM device
+extern void VideoSetNullDisplay(int);
+
+    /// Set osd render resolution
+extern void VideoSetOsdSize(const char *);
+
     /// Get video clock.
 extern int64_t VideoGetClock(const VideoRender *);
 
@@ -246,6 +330,9 @@ extern int64_t VideoGetClock(const VideoRender *);
 extern void VideoThreadWakeup(VideoRender *, int, int);
 extern void VideoThreadExit(void);
 
+    /// Wake up idle video threads.
+extern void VideoIdleWakeup(void);
+
 extern void VideoInit(VideoRender *);	///< Setup video module.
 extern void VideoExit(VideoRender *);		///< Cleanup and exit video module.
 
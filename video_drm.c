@@ -44,10 +44,17 @@
 #include <assert.h>
 #endif
 #include <pthread.h>
+#include <poll.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <string.h>
 #include <sys/mman.h>
+#ifdef __ARM_NEON
+#include <arm_neon.h>
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
 #include <drm_fourcc.h>
 #include <libavcodec/avcodec.h>
 #include <libavutil/hwcontext_drm.h>
@@ -66,6 +73,8 @@
 #include "audio.h"
 #include "codec.h"
 #include "drm.h"
+#include "trace.h"
+#include "bench.h"
 
 //----------------------------------------------------------------------------
 //	Variables
@@ -74,20 +83,33 @@ int VideoAudioDelay;
 static int VideoDisplayWidth = 0;
 static int VideoDisplayHeight = 0;
 static uint32_t VideoDisplayRefresh = 0;
+static int VideoOsdWidth = 0;		///< osd render width, 0 = display width
+static int VideoOsdHeight = 0;		///< osd render height, 0 = display height
+static int VideoNullDisplay;		///< no drm device, simulated display
+static uint32_t NullFbId;		///< last fb id of the null display
 
-static pthread_cond_t PauseCondition;
-static pthread_mutex_t PauseMutex;
+static pthread_cond_t PauseCondition = PTHREAD_COND_INITIALIZER;
+static pthread_mutex_t PauseMutex = PTHREAD_MUTEX_INITIALIZER;
 
 static pthread_cond_t WaitCleanCondition;
 static pthread_mutex_t WaitCleanMutex;
 
 static pthread_t DecodeThread;		///< video decode thread
 
-static pthread_t FilterThread;
+static pthread_t FilterThread;		///< deinterlace filter thread, joinable
+static volatile char FilterThreadAlive;	///< filter thread hasn't exited yet
 
 static pthread_t DisplayThread;
 static pthread_mutex_t DisplayQueue;
 
+static volatile int VideoThreadStop;	///< video threads should exit
+
+static pthread_mutex_t OsdMutex = PTHREAD_MUTEX_INITIALIZER;	///< software osd buffer swap
+static pthread_cond_t OsdCond = PTHREAD_COND_INITIALIZER;	///< software osd flip done
+
+static pthread_mutex_t IdleMutex = PTHREAD_MUTEX_INITIALIZER;	///< audio only idle
+static pthread_cond_t IdleCond = PTHREAD_COND_INITIALIZER;
+
 //----------------------------------------------------------------------------
 //	Helper functions
 //----------------------------------------------------------------------------
@@ -99,11 +121,6 @@ static void ReleaseFrame( __attribute__ ((unused)) void *opaque, uint8_t *data)
 	av_free(primedata);
 }
 
-static void ThreadExitHandler( __attribute__ ((unused)) void * arg)
-{
-	FilterThread = 0;
-}
-
 int GetPropertyValue(int fd_drm, uint32_t objectID,
 		     uint32_t objectType, const char *propName, uint64_t *value)
 {
@@ -148,6 +165,10 @@ static int SetPlanePropertyRequest(drmModeAtomicReqPtr ModeReq, uint32_t objectI
 
 	struct plane *obj = NULL;
 
+	// the null display has no properties and commits nothing
+	if (VideoNullDisplay)
+		return 0;
+
 	if (objectID == render->planes[VIDEO_PLANE]->plane_id)
 		obj = render->planes[VIDEO_PLANE];
 	else if (objectID == render->planes[OSD_PLANE]->plane_id)
@@ -209,6 +230,17 @@ static int SetPropertyRequest(drmModeAtomicReqPtr ModeReq, int fd_drm,
 	return drmModeAtomicAddProperty(ModeReq, objectID, id, value);
 }
 
+static int PlaneHasProperty(struct plane *plane, const char *propName)
+{
+	if (!plane->props)
+		return 0;
+	for (uint32_t i = 0; i < plane->props->count_props; i++) {
+		if (strcmp(plane->props_info[i]->name, propName) == 0)
+			return 1;
+	}
+	return 0;
+}
+
 void SetPlaneZpos(drmModeAtomicReqPtr ModeReq, struct plane *plane)
 {
 	SetPlanePropertyRequest(ModeReq, plane->plane_id, "zpos", plane->properties.zpos);
@@ -448,6 +480,28 @@ void VideoSetDisplay(const char* resolution)
 	sscanf(resolution, "%dx%d@%d", &VideoDisplayWidth, &VideoDisplayHeight, &VideoDisplayRefresh);
 }
 
+///
+///	Use the null display instead of a DRM device.
+///
+///	The frames go through the whole pipeline and the a/v sync, but
+///	nothing is committed. The buffers are plain memory and the page
+///	flip is a simulated vblank, so no device and no privileges are
+///	needed. Call before VideoInit().
+///
+void VideoSetNullDisplay(int on)
+{
+	VideoNullDisplay = on;
+}
+
+void VideoSetOsdSize(const char* resolution)
+{
+	if (sscanf(resolution, "%dx%d", &VideoOsdWidth, &VideoOsdHeight) != 2 ||
+	    VideoOsdWidth <= 0 || VideoOsdHeight <= 0) {
+		Error("VideoSetOsdSize: invalid osd resolution %s", resolution);
+		VideoOsdWidth = VideoOsdHeight = 0;
+	}
+}
+
 static drmModeConnector *find_drm_connector(int fd, drmModeRes *resources)
 {
 	drmModeConnector *connector = NULL;
@@ -490,6 +544,10 @@ static int get_resources(int fd, drmModeRes **resources)
 }
 
 #define MAX_DRM_DEVICES 64
+
+#define VIDEO_THREAD_TIMEOUT_MS 1000	///< max wait for a thread to stop
+#define VIDEO_EVENT_POLL_MS 100		///< stop check while waiting for a flip
+
 static int find_drm_device(drmModeRes **resources)
 {
 	drmDevicePtr devices[MAX_DRM_DEVICES] = { NULL };
@@ -623,6 +681,33 @@ static int init_egl(VideoRender *render)
 }
 #endif
 
+///
+///	Setup the null display.
+///
+///	The mode is the requested display resolution, 1920x1080@50
+///	without one.
+///
+static int FindNullDevice(VideoRender * render)
+{
+	int i;
+
+	render->fd_drm = -1;
+	memset(&render->mode, 0, sizeof(render->mode));
+	render->mode.hdisplay = VideoDisplayWidth ? VideoDisplayWidth : 1920;
+	render->mode.vdisplay = VideoDisplayHeight ? VideoDisplayHeight : 1080;
+	render->mode.vrefresh = VideoDisplayRefresh ? VideoDisplayRefresh : 50;
+	render->use_zpos = 0;
+
+	for (i = 0; i < MAX_PLANES; i++) {
+		render->planes[i] = calloc(1, sizeof(struct plane));
+		render->planes[i]->plane_id = i + 1;
+	}
+
+	Info("FindDevice: null display %dx%d@%d, nothing is shown",
+		render->mode.hdisplay, render->mode.vdisplay, render->mode.vrefresh);
+	return 0;
+}
+
 static int FindDevice(VideoRender * render)
 {
 	drmModeRes *resources;
@@ -634,6 +719,9 @@ static int FindDevice(VideoRender * render)
 	uint32_t k, l;
 	int i, j;
 
+	if (VideoNullDisplay)
+		return FindNullDevice(render);
+
 	// find a drm device
 	render->fd_drm = find_drm_device(&resources);
 	if (render->fd_drm < 0) {
@@ -920,7 +1008,7 @@ static int FindDevice(VideoRender * render)
 	// init gbm
 	int w, h;
 	double pixel_aspect;
-	GetScreenSize(&w, &h, &pixel_aspect);
+	VideoGetOsdSize(render, &w, &h, &pixel_aspect);
 
 	if (init_gbm(render, w, h, DRM_FORMAT_ARGB8888, GBM_BO_USE_SCANOUT | GBM_BO_USE_RENDERING)) {
 		Error("FindDevice: failed to init gbm device and surface!");
@@ -1029,6 +1117,52 @@ struct drm_buf *drm_get_buf_from_bo(VideoRender *render, struct gbm_bo *bo)
 }
 #endif
 
+///
+///	Setup a buffer of the null display.
+///
+///	Decoder frames are only numbered, the other buffers are plain
+///	memory with the layout of the dumb buffers.
+///
+static int SetupNullFB(VideoRender * render, struct drm_buf *buf,
+			AVDRMFrameDescriptor *primedata, int renderbuffer)
+{
+	if (primedata) {
+		buf->pix_fmt = primedata->layers[0].format;
+		buf->fb_id = ++NullFbId;
+		render->buffers += renderbuffer;
+		return 0;
+	}
+
+	if (buf->pix_fmt == DRM_FORMAT_ARGB8888) {
+		buf->pitch[0] = buf->width * 4;
+		buf->size = buf->pitch[0] * buf->height;
+	} else {
+		buf->pitch[0] = buf->width;
+		buf->offset[1] = buf->pitch[0] * buf->height;
+		if (buf->pix_fmt == DRM_FORMAT_YUV420) {
+			buf->pitch[2] = buf->pitch[1] = buf->pitch[0] / 2;
+			buf->offset[2] = buf->offset[1] + buf->pitch[1] * buf->height / 2;
+		} else {
+			buf->pitch[1] = buf->pitch[0];
+		}
+		buf->size = buf->pitch[0] * buf->height * 3 / 2;
+	}
+	if (!(buf->plane[0] = calloc(1, buf->size))) {
+		Error("SetupFB: cannot allocate null buffer of %u bytes", buf->size);
+		buf->size = 0;
+		return -ENOMEM;
+	}
+	MemAccount(MEM_DRM, buf->size);
+	buf->plane[1] = buf->plane[0] + buf->offset[1];
+	buf->plane[2] = buf->plane[0] + buf->offset[2];
+	buf->fb_id = ++NullFbId;
+	// matches the buffer of the frame in Frame2Display
+	buf->fd_prime = -(int)buf->fb_id;
+	render->buffers += renderbuffer;
+
+	return 0;
+}
+
 static int SetupFB(VideoRender * render, struct drm_buf *buf,
 			AVDRMFrameDescriptor *primedata, int renderbuffer)
 {
@@ -1039,6 +1173,9 @@ static int SetupFB(VideoRender * render, struct drm_buf *buf,
 	buf->pitch[0] = buf->pitch[1] = buf->pitch[2] = buf->pitch[3] = 0;
 	buf->offset[0] = buf->offset[1] = buf->offset[2] = buf->offset[3] = 0;
 
+	if (VideoNullDisplay)
+		return SetupNullFB(render, buf, primedata, renderbuffer);
+
 	if (primedata) {
 		// we have no DRM objects yet, so return
 		if (!primedata->nb_objects) {
@@ -1105,6 +1242,7 @@ static int SetupFB(VideoRender * render, struct drm_buf *buf,
 		}
 
 		buf->size = creq.size;
+		MemAccount(MEM_DRM, creq.size);
 
 		if (buf->pix_fmt == DRM_FORMAT_YUV420) {
 			buf->pitch[0] = buf->width;
@@ -1188,6 +1326,11 @@ static void DestroyFB(int fd_drm, struct drm_buf *buf)
 
 //	Debug("DestroyFB: destroy FB %d", buf->fb_id);
 
+	if (VideoNullDisplay) {
+		free(buf->plane[0]);
+		goto done;
+	}
+
 	if (buf->plane[0]) {
 		if (munmap(buf->plane[0], buf->size))
 				Error("DestroyFB: failed unmap FB (%d): %m", errno);
@@ -1215,14 +1358,55 @@ static void DestroyFB(int fd_drm, struct drm_buf *buf)
 			Error("DestroyFB: cannot close GEM (%d): %m", errno);
 	}
 
+done:
 	buf->width = 0;
 	buf->height = 0;
 	buf->fb_id = 0;
 	buf->plane[0] = 0;
+	MemAccount(MEM_DRM, -(long)buf->size);
 	buf->size = 0;
 	buf->fd_prime = 0;
 }
 
+///
+///	Setup the software osd front and back buffer.
+///
+static void SetupOsdFBs(VideoRender * render, int width, int height)
+{
+	for (int i = 0; i < 2; ++i) {
+		if (!render->bufs_osd[i])
+			render->bufs_osd[i] = calloc(1, sizeof(struct drm_buf));
+		render->bufs_osd[i]->pix_fmt = DRM_FORMAT_ARGB8888;
+		render->bufs_osd[i]->width = width;
+		render->bufs_osd[i]->height = height;
+		if (SetupFB(render, render->bufs_osd[i], NULL, 0)){
+			Fatal("VideoOsdInit: SetupFB FB OSD failed!");
+		}
+	}
+	// buffer 0 is on scanout, draw into buffer 1
+	render->osd_back = 1;
+	render->buf_osd = render->bufs_osd[1];
+	render->OsdFlip = 0;
+	memset(&render->OsdDamage, 0, sizeof(render->OsdDamage));
+	memset(&render->OsdSync, 0, sizeof(render->OsdSync));
+	memset(&render->OsdExtent, 0, sizeof(render->OsdExtent));
+}
+
+///
+///	Destroy the software osd front and back buffer.
+///
+static void DestroyOsdFBs(VideoRender * render)
+{
+	for (int i = 0; i < 2; ++i) {
+		if (render->bufs_osd[i]) {
+			DestroyFB(render->fd_drm, render->bufs_osd[i]);
+			free(render->bufs_osd[i]);
+			render->bufs_osd[i] = NULL;
+		}
+	}
+	render->buf_osd = NULL;
+}
+
 ///
 /// Clean DRM
 ///
@@ -1235,14 +1419,17 @@ static void CleanDisplayThread(VideoRender * render)
 		av_frame_free(&render->lastframe);
 	}
 
+	render->FramesFlushed = 0;
 dequeue:
 	if (atomic_read(&render->FramesFilled)) {
 		frame = render->FramesRb[render->FramesRead];
 		render->FramesRead = (render->FramesRead + 1) % VIDEO_SURFACES_MAX;
 		atomic_dec(&render->FramesFilled);
 		av_frame_free(&frame);
+		render->FramesFlushed++;
 		goto dequeue;
 	}
+	VideoIdleWakeup();
 
 	// Destroy FBs
 	if (render->buffers) {
@@ -1260,6 +1447,247 @@ dequeue:
 	Debug("CleanDisplayThread: DRM cleaned.");
 }
 
+///
+///	Add a rectangle to an osd area.
+///
+static void OsdRectAdd(struct osd_rect *r, int x1, int y1, int x2, int y2)
+{
+	if (x1 >= x2 || y1 >= y2)
+		return;
+
+	if (r->x1 >= r->x2) {
+		r->x1 = x1;
+		r->y1 = y1;
+		r->x2 = x2;
+		r->y2 = y2;
+		return;
+	}
+	if (x1 < r->x1)
+		r->x1 = x1;
+	if (y1 < r->y1)
+		r->y1 = y1;
+	if (x2 > r->x2)
+		r->x2 = x2;
+	if (y2 > r->y2)
+		r->y2 = y2;
+}
+
+///
+///	Copy an area between the software osd buffers.
+///
+static void OsdCopyRect(struct drm_buf *dst, const struct drm_buf *src,
+		const struct osd_rect *r)
+{
+	for (int i = r->y1; i < r->y2; ++i) {
+		memcpy(dst->plane[0] + r->x1 * 4 + i * dst->pitch[0],
+			src->plane[0] + r->x1 * 4 + i * src->pitch[0],
+			(size_t)(r->x2 - r->x1) * 4);
+	}
+}
+
+///
+///	Bring the software osd back buffer up to date with the front buffer.
+///
+///	Only the damage of the last flip is copied. Call with OsdMutex held.
+///
+static void OsdSyncBack(VideoRender * render)
+{
+	if (render->OsdSync.x1 >= render->OsdSync.x2)
+		return;
+
+	OsdCopyRect(render->buf_osd, render->bufs_osd[render->osd_back ^ 1],
+		&render->OsdSync);
+	memset(&render->OsdSync, 0, sizeof(render->OsdSync));
+}
+
+///
+///	The osd back buffer is on scanout now, swap the software osd buffers.
+///
+static void OsdFlipDone(VideoRender * render)
+{
+	struct drm_buf *front;
+
+	pthread_mutex_lock(&OsdMutex);
+	front = render->buf_osd;
+	render->osd_back ^= 1;
+	render->buf_osd = render->bufs_osd[render->osd_back];
+
+	// drawn after the commit, but before the flip: commit again
+	render->buf_osd->dirty = front->dirty;
+	front->dirty = 0;
+
+	render->OsdSync = render->OsdDamage;
+	memset(&render->OsdDamage, 0, sizeof(render->OsdDamage));
+	render->OsdFlip = 0;
+	pthread_cond_broadcast(&OsdCond);
+	pthread_mutex_unlock(&OsdMutex);
+}
+
+///
+///	No flip event comes for the committed osd back buffer.
+///
+static void OsdFlipCancel(VideoRender * render)
+{
+	pthread_mutex_lock(&OsdMutex);
+	render->OsdFlip = 0;
+	pthread_cond_broadcast(&OsdCond);
+	pthread_mutex_unlock(&OsdMutex);
+}
+
+///
+///	Wake up idle video threads.
+///
+///	Called after every change a waiting video thread may wait for:
+///	queued packets and frames, freed queue slots, osd changes,
+///	closing and mode changes.
+///
+void VideoIdleWakeup(void)
+{
+	pthread_mutex_lock(&IdleMutex);
+	pthread_cond_broadcast(&IdleCond);
+	pthread_mutex_unlock(&IdleMutex);
+}
+
+///
+///	Unlock a mutex, cleanup handler of a canceled wait.
+///
+///	@param mutex	pthread_mutex_t to unlock
+///
+static void MutexUnlockCleanup(void *mutex)
+{
+	pthread_mutex_unlock((pthread_mutex_t *)mutex);
+}
+
+///
+///	Wait for video work.
+///
+///	The video threads don't poll, they sleep until VideoIdleWakeup()
+///	is called and the condition of the caller is true.
+///
+///	@param render	video render
+///	@param work	returns non-zero if the caller has work
+///
+static void VideoIdle(VideoRender * render, int (*work)(VideoRender *))
+{
+	pthread_mutex_lock(&IdleMutex);
+	// a canceled thread doesn't keep the mutex locked
+	pthread_cleanup_push(MutexUnlockCleanup, &IdleMutex);
+	while (!VideoThreadStop && !work(render)) {
+		pthread_cond_wait(&IdleCond, &IdleMutex);
+		WakeCount();
+	}
+	pthread_cleanup_pop(1);
+}
+
+///
+///	Decode thread has work: packets to decode or a stream to close.
+///
+static int VideoDecodeWork(VideoRender * render)
+{
+	return VideoDecodeReady(render->Stream);
+}
+
+///
+///	Display thread has work: frames, osd changes or closing.
+///
+static int VideoDisplayWork(VideoRender * render)
+{
+	return atomic_read(&render->FramesFilled) || render->Closing ||
+		(render->buf_osd && (render->buf_osd->dirty || atomic_read(&render->OsdFadeDuration))) ||
+		(render->AudioOnly && render->act_buf &&
+		render->act_buf->fb_id != render->buf_black.fb_id);
+}
+
+///
+///	Filter thread has work: frames to deinterlace or closing.
+///
+static int VideoFilterWork(VideoRender * render)
+{
+	return atomic_read(&render->FramesDeintFilled) || render->Closing;
+}
+
+///
+///	Deinterlacer queue has space.
+///
+static int VideoDeintSpace(VideoRender * render)
+{
+	return atomic_read(&render->FramesDeintFilled) < VIDEO_SURFACES_MAX ||
+		render->Closing;
+}
+
+///
+///	Display queue has space.
+///
+static int VideoDisplaySpace(VideoRender * render)
+{
+	return atomic_read(&render->FramesFilled) < VIDEO_SURFACES_MAX ||
+		render->Closing;
+}
+
+///
+///	Display queue has space and the deinterlacer is drained.
+///
+static int VideoPrimeSpace(VideoRender * render)
+{
+	return (atomic_read(&render->FramesFilled) < VIDEO_SURFACES_MAX &&
+		!render->Filter_Frames) || render->Closing;
+}
+
+///
+///	Decide about a frame by its a/v offset.
+///
+///	Kept free of state and clock.
+///
+///	@param diff		video - audio pts in ms
+///	@param trick_speed	trick speed, no sync while it is set
+///
+///	@returns enum VideoSync
+///
+int VideoSyncAction(int diff, int trick_speed)
+{
+    if (trick_speed || abs(diff) > VIDEO_SYNC_JUMP_MS)
+	return VIDEO_SYNC_SHOW;
+    if (diff < -VIDEO_SYNC_DROP_MS)
+	return VIDEO_SYNC_DROP;
+    if (diff > VIDEO_SYNC_DUP_MS)
+	return VIDEO_SYNC_DUP;
+    return VIDEO_SYNC_SHOW;
+}
+
+///
+///	Step the osd fade timeline.
+///
+///	The fade is set from the osd thread, so its state is only touched
+///	under OsdMutex.
+///
+///	@returns new osd plane alpha, -1 if unchanged since the last commit
+///
+static int VideoOsdFadeStep(VideoRender * render)
+{
+	int alpha;
+
+	pthread_mutex_lock(&OsdMutex);
+	alpha = render->OsdAlphaTo;
+	if (atomic_read(&render->OsdFadeDuration)) {
+		int duration = atomic_read(&render->OsdFadeDuration);
+		uint32_t elapsed = GetMsTicks() - render->OsdFadeStart;
+
+		if (elapsed < (uint32_t)duration) {
+			alpha = render->OsdAlphaFrom + (render->OsdAlphaTo - render->OsdAlphaFrom) *
+				(int)elapsed / duration;
+		} else {
+			atomic_set(&render->OsdFadeDuration, 0);
+		}
+	}
+	if (alpha == render->OsdAlpha)
+		alpha = -1;
+	else
+		render->OsdAlpha = alpha;
+	pthread_mutex_unlock(&OsdMutex);
+
+	return alpha;
+}
+
 ///
 ///	Draw a video frame.
 ///
@@ -1270,6 +1698,8 @@ static void Frame2Display(VideoRender * render)
 	AVDRMFrameDescriptor *primedata = NULL;
 	int64_t audio_pts;
 	int64_t video_pts;
+	int action;
+	int osd_commit;
 	int i;
 
 	drmModeAtomicReqPtr ModeReq;
@@ -1289,20 +1719,30 @@ closing:
 
 dequeue:
 	while (!atomic_read(&render->FramesFilled)) {
+		if (VideoThreadStop)
+			goto stop;
 		if (render->Closing)
 			goto closing;
-		// We had draw activity on the osd buffer
-		if (render->buf_osd && render->buf_osd->dirty) {
+		// We had draw activity on the osd buffer or the osd fades
+		if (render->buf_osd && (render->buf_osd->dirty || atomic_read(&render->OsdFadeDuration))) {
 			Debug2(L_DRM, "Frame2Display: no video, set a black FB instead");
 			buf = &render->buf_black;
 			goto page_flip;
 		}
-		usleep(10000);
+		// audio only: no last video frame on screen, then no commits
+		if (render->AudioOnly && render->act_buf
+			&& render->act_buf->fb_id != render->buf_black.fb_id) {
+			buf = &render->buf_black;
+			goto page_flip;
+		}
+		VideoIdle(render, VideoDisplayWork);
 	}
 
 	frame = render->FramesRb[render->FramesRead];
 	render->FramesRead = (render->FramesRead + 1) % VIDEO_SURFACES_MAX;
 	atomic_dec(&render->FramesFilled);
+	VideoIdleWakeup();
+	Trace(TRACE_VIDEO_DISPLAY, frame->pts);
 	primedata = (AVDRMFrameDescriptor *)frame->data[0];
 
 	// search or made fd / FB combination
@@ -1330,7 +1770,9 @@ dequeue:
 		Debug("Frame2Display: start PTS %s", Timestamp2String(video_pts));
 avready:
 		if (AudioVideoReady(video_pts)) {
-			usleep(10000);
+			ClockSleep(10000);
+			if (VideoThreadStop)
+				goto stop;
 			if (render->Closing)
 				goto closing;
 			goto avready;
@@ -1344,13 +1786,18 @@ audioclock:
 		goto closing;
 
 	if (audio_pts == (int64_t)AV_NOPTS_VALUE && !render->TrickSpeed) {
-		usleep(20000);
+		ClockSleep(20000);
+		if (VideoThreadStop)
+			goto stop;
 		goto audioclock;
 	}
 
 	int diff = video_pts - audio_pts - VideoAudioDelay;
+	render->AvOffset = diff;
 
-	if (diff < -5 && !render->TrickSpeed && !(abs(diff) > 5000)) {
+	action = VideoSyncAction(diff, render->TrickSpeed);
+
+	if (action == VIDEO_SYNC_DROP) {
 		render->FramesDropped++;
 		Debug2(L_AV_SYNC, "FrameDropped (drop %d, dup %d) Pkts %d deint %d Frames %d AudioUsedBytes %d audio %s video %s Delay %dms diff %dms",
 			render->FramesDropped, render->FramesDuped,
@@ -1364,18 +1811,18 @@ audioclock:
 		goto dequeue;
 	}
 
-	if (diff > 35 && !render->TrickSpeed && !(abs(diff) > 5000)) {
+	if (action == VIDEO_SYNC_DUP) {
 		render->FramesDuped++;
 		Debug2(L_AV_SYNC, "FrameDuped (drop %d, dup %d) Pkts %d deint %d Frames %d AudioUsedBytes %d audio %s video %s Delay %dms diff %dms",
 			render->FramesDropped, render->FramesDuped,
 			VideoGetPackets(), atomic_read(&render->FramesDeintFilled),
 			atomic_read(&render->FramesFilled), AudioUsedBytes(), Timestamp2String(audio_pts),
 			Timestamp2String(video_pts), VideoAudioDelay, diff);
-		usleep(20000);
+		ClockSleep(20000);
 		goto audioclock;
 	}
 
-	if (abs(diff) > 5000) {	// more than 5s
+	if (abs(diff) > VIDEO_SYNC_JUMP_MS) {
 		Debug2(L_AV_SYNC, "More then 5s Pkts %d deint %d Frames %d AudioUsedBytes %d audio %s video %s Delay %dms diff %dms",
 			VideoGetPackets(), atomic_read(&render->FramesDeintFilled),
 			atomic_read(&render->FramesFilled), AudioUsedBytes(), Timestamp2String(audio_pts),
@@ -1386,7 +1833,7 @@ audioclock:
 		render->StartCounter++;
 
 	if (render->TrickSpeed)
-		usleep(20000 * render->TrickSpeed);
+		ClockSleep(20000 * render->TrickSpeed);
 
 	buf->frame = frame;
 
@@ -1400,10 +1847,15 @@ page_flip:
 	uint64_t DispY = 0;
 
 	if (render->video.is_scaled) {
-		DispWidth = render->video.width;
-		DispHeight = render->video.height;
-		DispX = render->video.x;
-		DispY = render->video.y;
+		int OsdWidth, OsdHeight;
+		double OsdAspect;
+
+		// the video window is given in osd coordinates
+		VideoGetOsdSize(render, &OsdWidth, &OsdHeight, &OsdAspect);
+		DispWidth = render->video.width * render->mode.hdisplay / OsdWidth;
+		DispHeight = render->video.height * render->mode.vdisplay / OsdHeight;
+		DispX = render->video.x * render->mode.hdisplay / OsdWidth;
+		DispY = render->video.y * render->mode.vdisplay / OsdHeight;
 	}
 
 	uint64_t PicWidth = DispWidth;
@@ -1443,8 +1895,34 @@ page_flip:
 	SetPlane(ModeReq, render->planes[VIDEO_PLANE]);
 
 // handle the osd plane
+	// osd fade timeline, step the plane alpha with every commit
+	if (render->OsdPlaneAlpha && render->buf_osd) {
+		int alpha = VideoOsdFadeStep(render);
+
+		if (alpha >= 0) {
+			// plane alpha is 16 bit
+			SetPlanePropertyRequest(ModeReq, render->planes[OSD_PLANE]->plane_id,
+				"alpha", (uint64_t)alpha * 0x101);
+		}
+	}
+
 	// We had draw activity on the osd buffer
-	if (render->buf_osd && render->buf_osd->dirty) {
+	osd_commit = render->buf_osd && render->buf_osd->dirty;
+
+	// software osd: commit the back buffer between draws, swap after
+	// the flip event. A running draw is committed with the next frame.
+	if (osd_commit && render->bufs_osd[0]) {
+		pthread_mutex_lock(&OsdMutex);
+		if (render->OsdDrawing) {
+			osd_commit = 0;
+		} else {
+			OsdSyncBack(render);
+			render->OsdFlip = 1;
+		}
+		pthread_mutex_unlock(&OsdMutex);
+	}
+
+	if (osd_commit) {
 		if (render->use_zpos) {
 			render->planes[VIDEO_PLANE]->properties.zpos = render->OsdShown ? render->zpos_primary : render->zpos_overlay;
 			render->planes[OSD_PLANE]->properties.zpos = render->OsdShown ? render->zpos_overlay : render->zpos_primary;
@@ -1460,8 +1938,9 @@ page_flip:
 		render->planes[OSD_PLANE]->properties.fb_id = render->buf_osd->fb_id;
 		render->planes[OSD_PLANE]->properties.crtc_x = 0;
 		render->planes[OSD_PLANE]->properties.crtc_y = 0;
-		render->planes[OSD_PLANE]->properties.crtc_w = render->OsdShown ? render->buf_osd->width : 0;
-		render->planes[OSD_PLANE]->properties.crtc_h = render->OsdShown ? render->buf_osd->height : 0;
+		// osd may be rendered in a lower resolution, the plane scales it up
+		render->planes[OSD_PLANE]->properties.crtc_w = render->OsdShown ? render->mode.hdisplay : 0;
+		render->planes[OSD_PLANE]->properties.crtc_h = render->OsdShown ? render->mode.vdisplay : 0;
 		render->planes[OSD_PLANE]->properties.src_x = 0;
 		render->planes[OSD_PLANE]->properties.src_y = 0;
 		render->planes[OSD_PLANE]->properties.src_w = render->OsdShown ? render->buf_osd->width : 0;
@@ -1472,13 +1951,17 @@ page_flip:
 		render->buf_osd->dirty = 0;
 	}
 
-	if (drmModeAtomicCommit(render->fd_drm, ModeReq, flags, NULL) != 0) {
+	if (!VideoNullDisplay && drmModeAtomicCommit(render->fd_drm, ModeReq, flags, NULL) != 0) {
 		DumpPlaneProperties(render->planes[OSD_PLANE]);
 		if (render->act_buf)
 			DumpPlaneProperties(render->planes[VIDEO_PLANE]);
 
 		drmModeAtomicFree(ModeReq);
+		if (render->OsdFlip)
+			OsdFlipCancel(render);
 		Error("Frame2Display: page flip failed (%d): %m", errno);
+	} else {
+		render->CommitTime = TraceTime();
 	}
 
 	drmModeAtomicFree(ModeReq);
@@ -1487,38 +1970,110 @@ page_flip:
 		av_frame_free(&render->lastframe);
 	if (render->act_buf && (render->act_buf->fb_id != render->buf_black.fb_id))
 		render->lastframe = render->act_buf->frame;
+	return;
+
+stop:
+	// the thread exits, nothing is committed
+	av_frame_free(&frame);
+	drmModeAtomicFree(ModeReq);
 }
 
 ///
-///	Display a video frame.
+///	Wait for the page flip event.
 ///
-static void *DisplayHandlerThread(void * arg)
+///	The drm fd is polled, a stop request isn't blocked by a flip
+///	which never comes.
+///
+///	@returns 0 on the event, -1 if the thread should stop
+///
+static int VideoWaitFlip(VideoRender * render)
 {
-	VideoRender * render = (VideoRender *)arg;
+	struct pollfd pfd;
+	int ret;
 
-	pthread_setcancelstate (PTHREAD_CANCEL_ENABLE, NULL);
-	pthread_setcanceltype(PTHREAD_CANCEL_DEFERRED, NULL);
+	if (VideoNullDisplay) {
+		// the flip happens at the next simulated vblank
+		uint64_t period = 1000000 / render->mode.vrefresh;
 
-	while (1) {
-		pthread_testcancel();
+		ClockSleep(period - ClockGetTime() % period);
+		return VideoThreadStop ? -1 : 0;
+	}
 
-		if (render->VideoPaused) {
-			pthread_mutex_lock(&PauseMutex);
-			pthread_cond_wait(&PauseCondition, &PauseMutex);
-			pthread_mutex_unlock(&PauseMutex);
+	pfd.fd = render->fd_drm;
+	pfd.events = POLLIN;
+	while (!VideoThreadStop) {
+		ret = poll(&pfd, 1, VIDEO_EVENT_POLL_MS);
+		WakeCount();
+		if (ret < 0 && errno != EINTR) {
+			Error("VideoWaitFlip: poll failed (%d): %m", errno);
+			return -1;
 		}
+		if (ret > 0) {
+			if (drmHandleEvent(render->fd_drm, &render->ev) != 0)
+				Error("DisplayHandlerThread: drmHandleEvent failed!");
+			return 0;
+		}
+	}
+	return -1;
+}
+
+///
+///	Display the next frame and wait for its vblank.
+///
+///	The headless runner drives it directly with stepped time.
+///
+///	@returns 0 ok, -1 if the display thread should stop
+///
+BENCH_STATIC int VideoDisplayVblank(VideoRender * render)
+{
+	Frame2Display(render);
 
-		Frame2Display(render);
+	if (VideoWaitFlip(render))
+		return -1;
+	Trace(TRACE_VIDEO_FLIP, render->pts);
+	if (render->CommitTime) {
+		TraceHistAdd(&render->DisplayHist, TraceTime() - render->CommitTime);
+		render->CommitTime = 0;
+	}
+
+	if (render->OsdFlip)
+		OsdFlipDone(render);
+
+	if (render->Closing &&
+	    (!render->act_buf || (render->act_buf->fb_id == render->buf_black.fb_id))) {
+		CleanDisplayThread(render);
+	}
+	return 0;
+}
 
-		if (drmHandleEvent(render->fd_drm, &render->ev) != 0)
-			Error("DisplayHandlerThread: drmHandleEvent failed!");
+///
+///	Display a video frame.
+///
+static void *DisplayHandlerThread(void * arg)
+{
+	VideoRender * render = (VideoRender *)arg;
 
-		if (render->Closing &&
-		    (!render->act_buf || (render->act_buf->fb_id == render->buf_black.fb_id))) {
-			CleanDisplayThread(render);
+	WakeRegister(WAKE_VIDEO_DISPLAY);
+	while (!VideoThreadStop) {
+		TraceMutexLock(PauseMutex);
+		pthread_cleanup_push(MutexUnlockCleanup, &PauseMutex);
+		while (render->VideoPaused && !VideoThreadStop) {
+			TraceCondWait(PauseCondition, PauseMutex);
+			WakeCount();
 		}
+		pthread_cleanup_pop(0);
+		TraceMutexUnlock(PauseMutex);
+		if (VideoThreadStop)
+			break;
+
+		if (VideoDisplayVblank(render))
+			break;
 	}
-	pthread_exit((void *)pthread_self());
+	// don't keep osd draws waiting for a flip
+	if (render->OsdFlip)
+		OsdFlipCancel(render);
+	Debug("video: display thread stopped");
+	return NULL;
 }
 
 //----------------------------------------------------------------------------
@@ -1526,17 +2081,116 @@ static void *DisplayHandlerThread(void * arg)
 //----------------------------------------------------------------------------
 
 ///
-///	Clear the OSD.
+///	Start a draw into the software osd back buffer.
 ///
+///	Only the bookkeeping runs under OsdMutex, the pixels are drawn
+///	without it. The display thread doesn't commit the back buffer while
+///	a draw runs, a draw waits until a committed back buffer is flipped.
+///	So the display thread never waits for the osd pixels.
 ///
-void VideoOsdClear(VideoRender * render)
+///	Call with OsdMutex held after OsdDrawWait(), it is unlocked.
+///
+static void OsdDrawBegin(VideoRender * render)
 {
-#ifdef USE_GLES
-	if (DisableOglOsd) {
-		memset((void *)render->buf_osd->plane[0], 0,
-			(size_t)(render->buf_osd->pitch[0] * render->buf_osd->height));
-	} else {
-		struct drm_buf *buf;
+	OsdSyncBack(render);
+	render->OsdDrawing++;
+	pthread_mutex_unlock(&OsdMutex);
+}
+
+///
+///	Wait until a committed software osd back buffer is flipped.
+///
+///	The flip moves the damage into the sync set of the other buffer,
+///	so the damage of a draw is recorded only after the wait.
+///
+///	Call with OsdMutex held.
+///
+static void OsdDrawWait(VideoRender * render)
+{
+	while (render->OsdFlip)
+		pthread_cond_wait(&OsdCond, &OsdMutex);
+}
+
+///
+///	Start a draw into an area of the software osd back buffer.
+///
+///	The area is marked as damaged.
+///
+static void OsdDrawArea(VideoRender * render, int x1, int y1, int x2, int y2)
+{
+	pthread_mutex_lock(&OsdMutex);
+	OsdDrawWait(render);
+	OsdRectAdd(&render->OsdDamage, x1, y1, x2, y2);
+	OsdRectAdd(&render->OsdExtent, x1, y1, x2, y2);
+	OsdDrawBegin(render);
+}
+
+///
+///	The draw into the software osd back buffer is done.
+///
+static void OsdDrawEnd(VideoRender * render)
+{
+	pthread_mutex_lock(&OsdMutex);
+	render->OsdDrawing--;
+	render->buf_osd->dirty = 1;
+	pthread_mutex_unlock(&OsdMutex);
+}
+
+///
+///	Clear the software osd.
+///
+///	Only the area drawn since the last clear is touched.
+///
+static void OsdSoftClear(VideoRender * render)
+{
+	struct osd_rect r;
+
+	pthread_mutex_lock(&OsdMutex);
+	OsdDrawWait(render);
+	// not synced parts of the back buffer may hold old osd content too
+	r = render->OsdExtent;
+	OsdRectAdd(&r, render->OsdSync.x1, render->OsdSync.y1,
+		render->OsdSync.x2, render->OsdSync.y2);
+
+	// the front buffer gets cleared with the next flip
+	OsdRectAdd(&render->OsdDamage, r.x1, r.y1, r.x2, r.y2);
+	memset(&render->OsdSync, 0, sizeof(render->OsdSync));
+	memset(&render->OsdExtent, 0, sizeof(render->OsdExtent));
+	OsdDrawBegin(render);
+
+	for (int i = r.y1; i < r.y2; ++i) {
+		memset(render->buf_osd->plane[0] + r.x1 * 4 + i * render->buf_osd->pitch[0],
+			0, (size_t)(r.x2 - r.x1) * 4);
+	}
+	Debug2(L_OSD, "OsdSoftClear: cleared %dx%d%+d%+d", r.x2 - r.x1, r.y2 - r.y1, r.x1, r.y1);
+	OsdDrawEnd(render);
+}
+
+///
+///	Draw an ARGB image into the software osd back buffer.
+///
+static void OsdSoftDraw(VideoRender * render, const uint8_t * argb, int pitch,
+		int height, int x, int y)
+{
+	OsdDrawArea(render, x, y, x + pitch / 4, y + height);
+	for (int i = 0; i < height; ++i) {
+		memcpy(render->buf_osd->plane[0] + x * 4 + (i + y) * render->buf_osd->pitch[0],
+			argb + i * pitch, (size_t)pitch);
+	}
+	OsdDrawEnd(render);
+}
+
+///
+///	Clear the OSD.
+///
+///
+void VideoOsdClear(VideoRender * render)
+{
+#ifdef USE_GLES
+	if (DisableOglOsd) {
+		OsdSoftClear(render);
+	} else {
+		struct drm_buf *buf;
 
 		EGL_CHECK(eglSwapBuffers(render->eglDisplay, render->eglSurface));
 		render->next_bo = gbm_surface_lock_front_buffer(render->gbm_surface);
@@ -1561,12 +2215,75 @@ void VideoOsdClear(VideoRender * render)
 		Debug2(L_OPENGL, "VideoOsdClear(GL): eglSwapBuffers eglDisplay %p eglSurface %p (%i x %i, %i)", render->eglDisplay, render->eglSurface, buf->width, buf->height, buf->pitch[0]);
 	}
 #else
-	memset((void *)render->buf_osd->plane[0], 0,
-		(size_t)(render->buf_osd->pitch[0] * render->buf_osd->height));
+	OsdSoftClear(render);
 #endif
 
 	render->buf_osd->dirty = 1;
 	render->OsdShown = 0;
+	VideoIdleWakeup();
+
+	// next osd starts opaque
+	pthread_mutex_lock(&OsdMutex);
+	atomic_set(&render->OsdFadeDuration, 0);
+	render->OsdAlphaTo = 255;
+	pthread_mutex_unlock(&OsdMutex);
+}
+
+///
+///	Set the osd plane alpha.
+///
+///	The display thread steps the alpha from the current value to
+///	the new one within duration, so a fade costs no osd rendering.
+///
+///	@param alpha	osd alpha (0 transparent - 255 opaque)
+///	@param duration	fade duration in ms, 0 = set immediately
+///
+///	@retval 0	alpha set
+///	@retval -1	osd plane has no alpha property
+///
+int VideoSetOsdAlpha(VideoRender * render, int alpha, int duration)
+{
+	if (!render || !render->OsdPlaneAlpha)
+		return -1;
+
+	pthread_mutex_lock(&OsdMutex);
+	if (alpha == render->OsdAlphaTo && !atomic_read(&render->OsdFadeDuration)) {
+		pthread_mutex_unlock(&OsdMutex);
+		return 0;
+	}
+	Debug2(L_OSD, "VideoSetOsdAlpha: %d -> %d in %d ms", render->OsdAlpha, alpha, duration);
+
+	render->OsdAlphaFrom = render->OsdAlpha;
+	render->OsdAlphaTo = alpha;
+	render->OsdFadeStart = GetMsTicks();
+	atomic_set(&render->OsdFadeDuration, duration > 0 ? duration : 0);
+	pthread_mutex_unlock(&OsdMutex);
+
+	if (render->buf_osd)
+		render->buf_osd->dirty = 1;
+	VideoIdleWakeup();
+
+	return 0;
+}
+
+///
+///	Get the osd plane alpha.
+///
+///	@returns the alpha the osd plane shows or fades to,
+///		-1 if the osd plane has no alpha property
+///
+int VideoGetOsdAlpha(VideoRender * render)
+{
+	int alpha;
+
+	if (!render || !render->OsdPlaneAlpha)
+		return -1;
+
+	pthread_mutex_lock(&OsdMutex);
+	alpha = render->OsdAlphaTo;
+	pthread_mutex_unlock(&OsdMutex);
+
+	return alpha;
 }
 
 ///
@@ -1587,10 +2304,7 @@ void VideoOsdDrawARGB(VideoRender * render, __attribute__ ((unused)) int xi,
 {
 #ifdef USE_GLES
 	if (DisableOglOsd) {
-		for (int i = 0; i < height; ++i) {
-			memcpy(render->buf_osd->plane[0] + x * 4 + (i + y) * render->buf_osd->pitch[0],
-				argb + i * pitch, (size_t)pitch);
-		}
+		OsdSoftDraw(render, argb, pitch, height, x, y);
 	} else {
 		struct drm_buf *buf;
 
@@ -1617,13 +2331,421 @@ void VideoOsdDrawARGB(VideoRender * render, __attribute__ ((unused)) int xi,
 		Debug2(L_OPENGL, "VideoOsdDrawARGB(GL): eglSwapBuffers eglDisplay %p eglSurface %p (%i x %i, %i)", render->eglDisplay, render->eglSurface, buf->width, buf->height, buf->pitch[0]);
 	}
 #else
-	for (int i = 0; i < height; ++i) {
-		memcpy(render->buf_osd->plane[0] + x * 4 + (i + y) * render->buf_osd->pitch[0],
-			argb + i * pitch, (size_t)pitch);
+	OsdSoftDraw(render, argb, pitch, height, x, y);
+#endif
+	render->buf_osd->dirty = 1;
+	render->OsdShown = 1;
+	VideoIdleWakeup();
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+
+///
+///	Convert a row of up to 16 color palette indexes with SSSE3.
+///
+///	pshufb looks up 16 bytes at once in a 16 entry byte plane. SSE2
+///	has no variable byte shuffle, so this is the first x86 level that
+///	pays off. It is picked at runtime, the plugin is built for plain
+///	x86-64.
+///
+__attribute__ ((target("ssse3")))
+static int OsdIndexedRowSsse3(uint32_t * dst, const uint8_t * src,
+		const uint8_t planes[4][256], int width)
+{
+	const __m128i c0 = _mm_loadu_si128((const __m128i *)planes[0]);
+	const __m128i c1 = _mm_loadu_si128((const __m128i *)planes[1]);
+	const __m128i c2 = _mm_loadu_si128((const __m128i *)planes[2]);
+	const __m128i c3 = _mm_loadu_si128((const __m128i *)planes[3]);
+	// indexes >= 16 get bit 7 set, pshufb returns 0 for them
+	const __m128i range = _mm_set1_epi8(0x70);
+	int x;
+
+	for (x = 0; x + 16 <= width; x += 16) {
+		__m128i idx = _mm_adds_epu8(_mm_loadu_si128((const __m128i *)(src + x)), range);
+		__m128i b0 = _mm_shuffle_epi8(c0, idx);
+		__m128i b1 = _mm_shuffle_epi8(c1, idx);
+		__m128i b2 = _mm_shuffle_epi8(c2, idx);
+		__m128i b3 = _mm_shuffle_epi8(c3, idx);
+		__m128i lo01 = _mm_unpacklo_epi8(b0, b1);
+		__m128i hi01 = _mm_unpackhi_epi8(b0, b1);
+		__m128i lo23 = _mm_unpacklo_epi8(b2, b3);
+		__m128i hi23 = _mm_unpackhi_epi8(b2, b3);
+
+		_mm_storeu_si128((__m128i *)(dst + x), _mm_unpacklo_epi16(lo01, lo23));
+		_mm_storeu_si128((__m128i *)(dst + x + 4), _mm_unpackhi_epi16(lo01, lo23));
+		_mm_storeu_si128((__m128i *)(dst + x + 8), _mm_unpacklo_epi16(hi01, hi23));
+		_mm_storeu_si128((__m128i *)(dst + x + 12), _mm_unpackhi_epi16(hi01, hi23));
+	}
+	return x;
+}
+
+#endif
+
+///
+///	Get the palette size the vector table lookup handles.
+///
+///	The byte planes for OsdIndexedRow() are only needed, and only
+///	built, when this is not 0.
+///
+///	@param num_colors	number of palette entries
+///
+///	@returns number of palette entries in the byte planes, 0 none
+///
+BENCH_STATIC int OsdIndexedTable(int num_colors)
+{
+#if defined(__aarch64__)
+	(void)num_colors;
+	return 256;
+#elif defined(__ARM_NEON)
+	// vtbl4 covers 32 entries, more would need a chain of 8 per plane
+	return num_colors <= 32 ? 32 : 0;
+#elif defined(__x86_64__) || defined(__i386__)
+	// 1, 2 and 4 bit osd bitmaps, bigger palettes use the plain lookup
+	// or the AVX2 gather
+#ifdef __SSSE3__
+	return num_colors <= 16 ? 16 : 0;
+#else
+	return num_colors <= 16 && __builtin_cpu_supports("ssse3") ? 16 : 0;
+#endif
+#else
+	(void)num_colors;
+	return 0;
+#endif
+}
+
+///
+///	Convert a row of 8 bit palette indexes to ARGB.
+///
+///	@param dst	ARGB destination
+///	@param src	palette indexes
+///	@param palette	256 entry ARGB palette
+///	@param planes	palette split into its 4 byte planes, NULL when
+///			OsdIndexedTable() returned 0
+///	@param width	number of pixels
+///
+BENCH_STATIC void OsdIndexedRow(uint32_t * dst, const uint8_t * src,
+		const uint32_t * palette, const uint8_t planes[4][256], int width)
+{
+	int x = 0;
+
+	if (planes) {
+#if defined(__aarch64__)
+		// 256 entry byte lookup = 4 x 64 byte tbl/tbx per channel,
+		// vst4 interleaves the channels back to ARGB
+		uint8x16x4_t tbl[4][4];
+		const uint8x16_t step = vdupq_n_u8(64);
+
+		for (int c = 0; c < 4; ++c) {
+			for (int q = 0; q < 4; ++q) {
+				tbl[c][q] = vld1q_u8_x4(planes[c] + q * 64);
+			}
+		}
+		for (; x + 16 <= width; x += 16) {
+			uint8x16_t idx0 = vld1q_u8(src + x);
+			uint8x16_t idx1 = vsubq_u8(idx0, step);
+			uint8x16_t idx2 = vsubq_u8(idx1, step);
+			uint8x16_t idx3 = vsubq_u8(idx2, step);
+			uint8x16x4_t out;
+
+			for (int c = 0; c < 4; ++c) {
+				uint8x16_t v = vqtbl4q_u8(tbl[c][0], idx0);
+
+				v = vqtbx4q_u8(v, tbl[c][1], idx1);
+				v = vqtbx4q_u8(v, tbl[c][2], idx2);
+				out.val[c] = vqtbx4q_u8(v, tbl[c][3], idx3);
+			}
+			vst4q_u8((uint8_t *)(dst + x), out);
+		}
+#elif defined(__ARM_NEON)
+		// 32 entry byte lookup per channel, vtbl4 returns 0 above
+		uint8x8x4_t tbl[4];
+
+		for (int c = 0; c < 4; ++c) {
+			for (int q = 0; q < 4; ++q) {
+				tbl[c].val[q] = vld1_u8(planes[c] + q * 8);
+			}
+		}
+		for (; x + 8 <= width; x += 8) {
+			uint8x8_t idx = vld1_u8(src + x);
+			uint8x8x4_t out;
+
+			for (int c = 0; c < 4; ++c) {
+				out.val[c] = vtbl4_u8(tbl[c], idx);
+			}
+			vst4_u8((uint8_t *)(dst + x), out);
+		}
+#elif defined(__x86_64__) || defined(__i386__)
+		x = OsdIndexedRowSsse3(dst, src, planes, width);
+#endif
+	}
+#if defined(__AVX2__)
+	for (; x + 8 <= width; x += 8) {
+		__m256i idx = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(src + x)));
+
+		_mm256_storeu_si256((__m256i *)(dst + x),
+			_mm256_i32gather_epi32((const int *)palette, idx, 4));
+	}
+#endif
+	for (; x + 4 <= width; x += 4) {
+		dst[x] = palette[src[x]];
+		dst[x + 1] = palette[src[x + 1]];
+		dst[x + 2] = palette[src[x + 2]];
+		dst[x + 3] = palette[src[x + 3]];
+	}
+	for (; x < width; ++x) {
+		dst[x] = palette[src[x]];
+	}
+}
+
+///
+///	Divide by 255 with rounding.
+///
+static inline int Div255(int x)
+{
+	x += 128;
+	return (x + (x >> 8)) >> 8;
+}
+
+#if !defined(__ARM_NEON) && defined(__SSE2__)
+///
+///	Divide 16 bit lanes by 255 with rounding.
+///
+static inline __m128i Div255Epi16(__m128i x)
+{
+	x = _mm_add_epi16(x, _mm_set1_epi16(128));
+	return _mm_srli_epi16(_mm_add_epi16(x, _mm_srli_epi16(x, 8)), 8);
+}
+#endif
+
+///
+///	Blend a row of ARGB pixels over a premultiplied ARGB row.
+///
+///	dst = src * a + dst * (1 - a), with a = source alpha * pixmap alpha.
+///	The source alpha byte counts as 255, so the alpha channel gets
+///	a + dst alpha * (1 - a) with the same operation.
+///
+///	@param dst	premultiplied ARGB row
+///	@param src	ARGB row of a pixmap
+///	@param n	number of pixels
+///	@param alpha	pixmap alpha
+///
+void VideoOsdBlendRow(uint32_t * dst, const uint32_t * src, int n, int alpha)
+{
+	int i;
+
+	i = 0;
+#if defined(__ARM_NEON)
+	const uint8x8_t pixmap_alpha = vdup_n_u8(alpha);
+
+	for (; i + 8 <= n; i += 8) {
+		uint8x8x4_t s = vld4_u8((const uint8_t *)(src + i));
+		uint8x8x4_t d = vld4_u8((const uint8_t *)(dst + i));
+		uint8x8_t a = s.val[3];
+		uint8x8_t ia;
+		uint16x8_t t;
+
+		if (alpha != 255) {
+			t = vmull_u8(a, pixmap_alpha);
+			a = vraddhn_u16(t, vrshrq_n_u16(t, 8));
+		}
+		ia = vmvn_u8(a);
+		for (int c = 0; c < 3; ++c) {
+			t = vmlal_u8(vmull_u8(s.val[c], a), d.val[c], ia);
+			d.val[c] = vraddhn_u16(t, vrshrq_n_u16(t, 8));
+		}
+		t = vmull_u8(d.val[3], ia);
+		d.val[3] = vadd_u8(a, vraddhn_u16(t, vrshrq_n_u16(t, 8)));
+		vst4_u8((uint8_t *)(dst + i), d);
+	}
+#elif defined(__SSE2__)
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i opaque = _mm_set1_epi32(0xFF000000);
+	const __m128i c255 = _mm_set1_epi16(255);
+	const __m128i pixmap_alpha = _mm_set1_epi32(alpha);
+
+	for (; i + 4 <= n; i += 4) {
+		__m128i s = _mm_loadu_si128((const __m128i *)(src + i));
+		__m128i d = _mm_loadu_si128((const __m128i *)(dst + i));
+		__m128i a = _mm_srli_epi32(s, 24);
+		__m128i alo;
+		__m128i ahi;
+		__m128i lo;
+		__m128i hi;
+
+		if (alpha != 255) {
+			a = Div255Epi16(_mm_mullo_epi16(a, pixmap_alpha));
+		}
+		// alpha of each pixel into its four 16 bit lanes
+		a = _mm_or_si128(a, _mm_slli_epi32(a, 16));
+		alo = _mm_unpacklo_epi32(a, a);
+		ahi = _mm_unpackhi_epi32(a, a);
+		s = _mm_or_si128(s, opaque);
+
+		lo = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(s, zero), alo),
+			_mm_mullo_epi16(_mm_unpacklo_epi8(d, zero), _mm_sub_epi16(c255, alo)));
+		hi = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(s, zero), ahi),
+			_mm_mullo_epi16(_mm_unpackhi_epi8(d, zero), _mm_sub_epi16(c255, ahi)));
+		_mm_storeu_si128((__m128i *)(dst + i),
+			_mm_packus_epi16(Div255Epi16(lo), Div255Epi16(hi)));
 	}
 #endif
+	for (; i < n; ++i) {
+		uint32_t s;
+		uint32_t d;
+		int a;
+
+		s = src[i];
+		a = s >> 24;
+		if (alpha != 255) {
+			a = Div255(a * alpha);
+		}
+		if (!a) {
+			continue;
+		}
+		if (a == 255) {
+			dst[i] = s;
+			continue;
+		}
+		d = dst[i];
+		dst[i] = (Div255(255 * a + (d >> 24) * (255 - a)) << 24)
+			| (Div255(((s >> 16) & 0xFF) * a + ((d >> 16) & 0xFF) * (255 - a)) << 16)
+			| (Div255(((s >> 8) & 0xFF) * a + ((d >> 8) & 0xFF) * (255 - a)) << 8)
+			| Div255((s & 0xFF) * a + (d & 0xFF) * (255 - a));
+	}
+}
+
+static uint32_t OsdReciprocal[256];	///< 255 / a in 16.16
+static pthread_once_t OsdReciprocalOnce = PTHREAD_ONCE_INIT;
+
+///
+///	Fill the reciprocal table for unpremultiplying.
+///
+static void OsdReciprocalInit(void)
+{
+	for (int a = 1; a < 256; ++a) {
+		OsdReciprocal[a] = ((255 << 16) + a / 2) / a;
+	}
+}
+
+///
+///	Convert a premultiplied ARGB row back to ARGB.
+///
+///	@param dst	ARGB row in the osd buffer
+///	@param src	premultiplied ARGB row
+///	@param n	number of pixels
+///
+void VideoOsdUnpremultiplyRow(uint32_t * dst, const uint32_t * src, int n)
+{
+	pthread_once(&OsdReciprocalOnce, OsdReciprocalInit);
+
+	for (int i = 0; i < n; ++i) {
+		uint32_t s;
+		uint32_t a;
+		uint32_t r;
+		uint32_t g;
+		uint32_t b;
+
+		s = src[i];
+		a = s >> 24;
+		if (a == 255 || !a) {
+			dst[i] = a ? s : 0;
+			continue;
+		}
+		r = (((s >> 16) & 0xFF) * OsdReciprocal[a] + 0x8000) >> 16;
+		g = (((s >> 8) & 0xFF) * OsdReciprocal[a] + 0x8000) >> 16;
+		b = ((s & 0xFF) * OsdReciprocal[a] + 0x8000) >> 16;
+		dst[i] = (a << 24) | ((r > 255 ? 255 : r) << 16)
+			| ((g > 255 ? 255 : g) << 8) | (b > 255 ? 255 : b);
+	}
+}
+
+///
+///	Draw an OSD 8 bit palette image.
+///
+///	The indexes are converted straight into the osd buffer, there is
+///	no intermediate ARGB image.
+///
+///	@param index	palette indexes of the first pixel
+///	@param pitch	pitch of the index image
+///	@param colors	ARGB palette
+///	@param num_colors	number of palette entries
+///	@param width	width in pixel
+///	@param height	height in pixel
+///	@param x	x-coordinate on screen
+///	@param y	y-coordinate on screen
+///
+void VideoOsdDrawIndexed(VideoRender * render, const uint8_t * index, int pitch,
+		const uint32_t * colors, int num_colors, int width, int height,
+		int x, int y)
+{
+	uint32_t palette[256];
+	uint8_t planes[4][256];
+	int table;
+	int i;
+
+	if (!render->buf_osd || !render->buf_osd->plane[0])
+		return;
+
+	if (num_colors > 256)
+		num_colors = 256;
+	memcpy(palette, colors, num_colors * sizeof(*palette));
+	memset(palette + num_colors, 0, (256 - num_colors) * sizeof(*palette));
+	table = OsdIndexedTable(num_colors);
+	for (i = 0; i < table; ++i) {
+		planes[0][i] = palette[i];
+		planes[1][i] = palette[i] >> 8;
+		planes[2][i] = palette[i] >> 16;
+		planes[3][i] = palette[i] >> 24;
+	}
+
+	if (render->bufs_osd[0])
+		OsdDrawArea(render, x, y, x + width, y + height);
+	for (i = 0; i < height; ++i) {
+		OsdIndexedRow((uint32_t *)(render->buf_osd->plane[0] + x * 4 +
+			(i + y) * render->buf_osd->pitch[0]), index + i * pitch,
+			palette, table ? (const uint8_t (*)[256])planes : NULL, width);
+	}
+	if (render->bufs_osd[0])
+		OsdDrawEnd(render);
 	render->buf_osd->dirty = 1;
 	render->OsdShown = 1;
+	VideoIdleWakeup();
+}
+
+///
+///	Lock an area of the osd buffer for direct drawing.
+///
+///	Only available for the software osd. The area is marked as damaged,
+///	VideoOsdUnlockArea() must be called when done.
+///
+///	@param x	x-coordinate on screen
+///	@param y	y-coordinate on screen
+///	@param width	width in pixel
+///	@param height	height in pixel
+///	@param[out] pitch	pitch of the osd buffer
+///
+///	@returns pointer to the pixel at x, y or NULL
+///
+uint8_t *VideoOsdLockArea(VideoRender * render, int x, int y, int width,
+		int height, int *pitch)
+{
+	if (!render->bufs_osd[0])
+		return NULL;
+
+	OsdDrawArea(render, x, y, x + width, y + height);
+	*pitch = render->buf_osd->pitch[0];
+
+	return render->buf_osd->plane[0] + x * 4 + y * render->buf_osd->pitch[0];
+}
+
+///
+///	Unlock the osd buffer area locked with VideoOsdLockArea().
+///
+void VideoOsdUnlockArea(VideoRender * render)
+{
+	OsdDrawEnd(render);
+	render->OsdShown = 1;
+	VideoIdleWakeup();
 }
 
 //----------------------------------------------------------------------------
@@ -1637,52 +2759,54 @@ static void *DecodeHandlerThread(void *arg)
 {
 	VideoRender * render = (VideoRender *)arg;
 
-	Debug("video: display thread started");
-
-	pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
-	pthread_setcanceltype(PTHREAD_CANCEL_DEFERRED, NULL);
-
-	for (;;) {
-		pthread_testcancel();
+	Debug("video: decode thread started");
 
+	WakeRegister(WAKE_VIDEO_DECODE);
+	while (!VideoThreadStop) {
 		// manage fill frame output ring buffer
 		if (VideoDecodeInput(render->Stream)) {
-			usleep(10000);
+			VideoIdle(render, VideoDecodeWork);
 		}
 	}
-	pthread_exit((void *)pthread_self());
+	Debug("video: decode thread stopped");
+	return NULL;
 }
 
 ///
 ///	Exit and cleanup video threads.
 ///
+///	The threads check the stop flag at every wait, the waits are woken
+///	up here. A thread which doesn't stop in time is canceled, the
+///	waits unlock their mutex in a cleanup handler.
+///
 void VideoThreadExit(void)
 {
-	void *retval;
+	if (!DecodeThread && !DisplayThread && !FilterThread)
+		return;
+	Debug("VideoThreadExit: stop video threads");
 
-	Debug("video: video thread canceled");
+	VideoThreadStop = 1;
+	VideoIdleWakeup();
+	TraceMutexLock(PauseMutex);
+	pthread_cond_broadcast(&PauseCondition);
+	TraceMutexUnlock(PauseMutex);
 
 	if (DecodeThread) {
-		Debug("VideoThreadExit: cancel decode thread");
-		// FIXME: can't cancel locked
-		if (pthread_cancel(DecodeThread))
-			Error("VideoThreadExit: can't queue cancel video display thread");
-		if (pthread_join(DecodeThread, &retval) || retval != PTHREAD_CANCELED)
-			Error("VideoThreadExit: can't cancel video display thread");
+		ThreadJoin(DecodeThread, "video decode", VIDEO_THREAD_TIMEOUT_MS);
 		DecodeThread = 0;
-
-		pthread_cond_destroy(&PauseCondition);
-		pthread_mutex_destroy(&PauseMutex);
 	}
-
 	if (DisplayThread) {
-		Debug("VideoThreadExit: cancel display thread");
-		if (pthread_cancel(DisplayThread))
-			Error("VideoThreadExit: can't cancel DisplayHandlerThread thread");
-		if (pthread_join(DisplayThread, &retval) || retval != PTHREAD_CANCELED)
-			Error("VideoThreadExit: can't cancel video display thread");
+		ThreadJoin(DisplayThread, "video display", VIDEO_THREAD_TIMEOUT_MS);
 		DisplayThread = 0;
 	}
+	// joined also after it exited on closing, the render is freed next
+	if (FilterThread) {
+		ThreadJoin(FilterThread, "video filter", VIDEO_THREAD_TIMEOUT_MS);
+		FilterThread = 0;
+		FilterThreadAlive = 0;
+	}
+
+	VideoThreadStop = 0;
 }
 
 ///
@@ -1696,9 +2820,6 @@ void VideoThreadWakeup(VideoRender * render, int decoder, int display)
 
 	if (decoder && !DecodeThread) {
 		Debug("DisplayThreadWakeup: VideoThreadWakeup");
-		pthread_cond_init(&PauseCondition,NULL);
-		pthread_mutex_init(&PauseMutex, NULL);
-
 		pthread_cond_init(&WaitCleanCondition,NULL);
 		pthread_mutex_init(&WaitCleanMutex, NULL);
 
@@ -1737,6 +2858,8 @@ VideoRender *VideoNewRender(VideoStream * stream)
 	render->Closing = 0;
 	render->enqueue_buffer = 0;
 	render->VideoPaused = 0;
+	render->SkipPts = AV_NOPTS_VALUE;
+	render->AudioOnly = 0;
 
 	return render;
 }
@@ -1790,12 +2913,31 @@ enum AVPixelFormat Video_get_format(__attribute__ ((unused))VideoRender * render
 	return avcodec_default_get_format(video_ctx, fmt);
 }
 
+///
+///	Copy a NV12 frame into a dumb buffer.
+///
+///	@param buf	dumb buffer of the frame size
+///	@param frame	NV12 frame, the lines may be padded
+///
+BENCH_STATIC void VideoCopyNV12(struct drm_buf *buf, const AVFrame *frame)
+{
+	int i;
+
+	for (i = 0; i < frame->height; ++i) {
+		memcpy(buf->plane[0] + i * frame->width,
+			frame->data[0] + i * frame->linesize[0], frame->width);
+	}
+	for (i = 0; i < frame->height / 2; ++i) {
+		memcpy(buf->plane[1] + i * frame->width,
+			frame->data[1] + i * frame->linesize[1], frame->width);
+	}
+}
+
 void EnqueueFB(VideoRender * render, AVFrame *inframe)
 {
 	struct drm_buf *buf = 0;
 	AVDRMFrameDescriptor * primedata;
 	AVFrame *frame;
-	int i;
 
 	if (!render->buffers) {
 		for (int i = 0; i < VIDEO_SURFACES_MAX + 2; i++) {
@@ -1809,7 +2951,7 @@ void EnqueueFB(VideoRender * render, AVFrame *inframe)
 					buf->width, buf->height);
 			}
 
-			if (drmPrimeHandleToFD(render->fd_drm, buf->handle[0],
+			if (!VideoNullDisplay && drmPrimeHandleToFD(render->fd_drm, buf->handle[0],
 				DRM_CLOEXEC | DRM_RDWR, &buf->fd_prime))
 				Error("EnqueueFB: Failed to retrieve the Prime FD (%d): %m",
 					errno);
@@ -1817,15 +2959,7 @@ void EnqueueFB(VideoRender * render, AVFrame *inframe)
 	}
 
 	buf = &render->bufs[render->enqueue_buffer];
-
-	for (i = 0; i < inframe->height; ++i) {
-		memcpy(buf->plane[0] + i * inframe->width,
-			inframe->data[0] + i * inframe->linesize[0], inframe->width);
-	}
-	for (i = 0; i < inframe->height / 2; ++i) {
-		memcpy(buf->plane[1] + i * inframe->width,
-			inframe->data[1] + i * inframe->linesize[1], inframe->width);
-	}
+	VideoCopyNV12(buf, inframe);
 
 	frame = av_frame_alloc();
 	frame->pts = inframe->pts;
@@ -1844,20 +2978,22 @@ void EnqueueFB(VideoRender * render, AVFrame *inframe)
 	av_frame_free(&inframe);
 
 fillframe:
-	if (render->Closing) {
+	if (render->Closing || VideoThreadStop) {
 		av_frame_free(&frame);
 		return;
 	}
 
-	pthread_mutex_lock(&DisplayQueue);
+	TraceMutexLock(DisplayQueue);
 	if (atomic_read(&render->FramesFilled) < VIDEO_SURFACES_MAX) {
 		render->FramesRb[render->FramesWrite] = frame;
 		render->FramesWrite = (render->FramesWrite + 1) % VIDEO_SURFACES_MAX;
 		atomic_inc(&render->FramesFilled);
-		pthread_mutex_unlock(&DisplayQueue);
+		TraceMutexUnlock(DisplayQueue);
+		Trace(TRACE_VIDEO_ENQUEUE, frame->pts);
+		VideoIdleWakeup();
 	} else {
-		pthread_mutex_unlock(&DisplayQueue);
-		usleep(10000);
+		TraceMutexUnlock(DisplayQueue);
+		VideoIdle(render, VideoDisplaySpace);
 		goto fillframe;
 	}
 
@@ -1873,17 +3009,19 @@ static void *FilterHandlerThread(void * arg)
 {
 	VideoRender * render = (VideoRender *)arg;
 	AVFrame *frame = 0;
+	uint64_t start;
+	uint64_t spent = 0;			// in the filter since the last frame
 	int ret = 0;
 
-	while (1) {
-		while (!atomic_read(&render->FramesDeintFilled) && !render->Closing) {
-			usleep(10000);
-		}
+	WakeRegister(WAKE_VIDEO_FILTER);
+	while (!VideoThreadStop) {
+		VideoIdle(render, VideoFilterWork);
 getinframe:
 		if (atomic_read(&render->FramesDeintFilled)) {
 			frame = render->FramesDeintRb[render->FramesDeintRead];
 			render->FramesDeintRead = (render->FramesDeintRead + 1) % VIDEO_SURFACES_MAX;
 			atomic_dec(&render->FramesDeintFilled);
+			VideoIdleWakeup();
 			if (frame->interlaced_frame) {
 				render->Filter_Frames += 2;
 			} else {
@@ -1900,16 +3038,20 @@ getinframe:
 			frame = NULL;
 		}
 
+		start = TraceTime();
 		if (av_buffersrc_add_frame_flags(render->buffersrc_ctx,
 			frame, AV_BUFFERSRC_FLAG_KEEP_REF) < 0) {
 			Warning("FilterHandlerThread: can't add_frame.");
 		} else {
 			av_frame_free(&frame);
 		}
+		spent += TraceTime() - start;
 
 		while (1) {
 			AVFrame *filt_frame = av_frame_alloc();
+			start = TraceTime();
 			ret = av_buffersink_get_frame(render->buffersink_ctx, filt_frame);
+			spent += TraceTime() - start;
 
 			if (ret == AVERROR(EAGAIN)) {
 				av_frame_free(&filt_frame);
@@ -1925,8 +3067,11 @@ getinframe:
 				av_frame_free(&filt_frame);
 				break;
 			}
+			Trace(TRACE_VIDEO_FILTER, filt_frame->pts);
+			TraceHistAdd(&render->FilterHist, spent);
+			spent = 0;
 fillframe:
-			if (render->Closing) {
+			if (render->Closing || VideoThreadStop) {
 				av_frame_free(&filt_frame);
 				break;
 			}
@@ -1936,16 +3081,18 @@ fillframe:
 				render->Filter_Frames--;
 				EnqueueFB(render, filt_frame);
 			} else {
-				pthread_mutex_lock(&DisplayQueue);
+				TraceMutexLock(DisplayQueue);
 				if (atomic_read(&render->FramesFilled) < VIDEO_SURFACES_MAX) {
 					render->FramesRb[render->FramesWrite] = filt_frame;
 					render->FramesWrite = (render->FramesWrite + 1) % VIDEO_SURFACES_MAX;
 					atomic_inc(&render->FramesFilled);
-					pthread_mutex_unlock(&DisplayQueue);
+					TraceMutexUnlock(DisplayQueue);
+					Trace(TRACE_VIDEO_ENQUEUE, filt_frame->pts);
 					render->Filter_Frames--;
+					VideoIdleWakeup();
 				} else {
-					pthread_mutex_unlock(&DisplayQueue);
-					usleep(10000);
+					TraceMutexUnlock(DisplayQueue);
+					VideoIdle(render, VideoDisplaySpace);
 					goto fillframe;
 				}
 			}
@@ -1956,9 +3103,9 @@ closing:
 	avfilter_graph_free(&render->filter_graph);
 	render->Filter_Frames = 0;
 	Debug("FilterHandlerThread: Thread Exit.");
-	pthread_cleanup_push(ThreadExitHandler, render);
-	pthread_cleanup_pop(1);
-	pthread_exit((void *)pthread_self());
+	FilterThreadAlive = 0;
+	VideoIdleWakeup();
+	return NULL;
 }
 
 ///
@@ -2091,6 +3238,8 @@ int VideoFilterInit(VideoRender * render, const AVCodecContext * video_ctx,
 void VideoRenderFrame(VideoRender * render,
     AVCodecContext * video_ctx, AVFrame * frame)
 {
+	int64_t skip_pts;
+
 	if (!render->StartCounter) {
 		render->timebase = &video_ctx->pkt_timebase;
 	}
@@ -2098,8 +3247,24 @@ void VideoRenderFrame(VideoRender * render,
 	if (frame->decode_error_flags || frame->flags & AV_FRAME_FLAG_CORRUPT) {
 		Warning("VideoRenderFrame: error_flag or FRAME_FLAG_CORRUPT");
 	}
+
+	// decoded forward from a keyframe to the seek target, set by the
+	// player thread: 64 bit, atomic for 32 bit arm
+	skip_pts = __atomic_load_n(&render->SkipPts, __ATOMIC_ACQUIRE);
+	if (skip_pts != AV_NOPTS_VALUE) {
+		if (frame->pts != AV_NOPTS_VALUE && frame->pts < skip_pts) {
+			av_frame_free(&frame);
+			render->FramesSkipped++;
+			return;
+		}
+		Debug2(L_CODEC, "VideoRenderFrame: seek target %s reached",
+			Timestamp2String(skip_pts));
+		// keep a new target set meanwhile
+		__atomic_compare_exchange_n(&render->SkipPts, &skip_pts,
+			AV_NOPTS_VALUE, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+	}
 fillframe:
-	if (render->Closing) {
+	if (render->Closing || VideoThreadStop) {
 		av_frame_free(&frame);
 		return;
 	}
@@ -2107,15 +3272,30 @@ fillframe:
 	if (frame->format == AV_PIX_FMT_YUV420P || (frame->interlaced_frame &&
 		frame->format == AV_PIX_FMT_DRM_PRIME && !render->NoHwDeint)) {
 
-		if (!FilterThread) {
+		if (!FilterThreadAlive) {
+			pthread_t thread;
+
+			// the last filter thread exited on closing
+			if (FilterThread) {
+				pthread_join(FilterThread, NULL);
+				FilterThread = 0;
+			}
 			Debug2(L_CODEC, "VideoRenderFrame: try to create FilterThread");
 			if (VideoFilterInit(render, video_ctx, frame)) {
 				av_frame_free(&frame);
 				return;
 			} else {
 				Debug2(L_CODEC, "VideoRenderFrame: FilterThread created");
-				pthread_create(&FilterThread, NULL, FilterHandlerThread, render);
-				pthread_setname_np(FilterThread, "softhddev deint");
+				// the thread may exit before pthread_create() returns
+				FilterThreadAlive = 1;
+				if (pthread_create(&thread, NULL, FilterHandlerThread, render)) {
+					Error("VideoRenderFrame: can't create the filter thread");
+					FilterThreadAlive = 0;
+					av_frame_free(&frame);
+					return;
+				}
+				pthread_setname_np(thread, "softhddev deint");
+				FilterThread = thread;
 			}
 		}
 
@@ -2123,21 +3303,24 @@ fillframe:
 			render->FramesDeintRb[render->FramesDeintWrite] = frame;
 			render->FramesDeintWrite = (render->FramesDeintWrite + 1) % VIDEO_SURFACES_MAX;
 			atomic_inc(&render->FramesDeintFilled);
+			VideoIdleWakeup();
 		} else {
-			usleep(10000);
+			VideoIdle(render, VideoDeintSpace);
 			goto fillframe;
 		}
 	} else {
 		if (frame->format == AV_PIX_FMT_DRM_PRIME) {
-			pthread_mutex_lock(&DisplayQueue);
+			TraceMutexLock(DisplayQueue);
 			if (atomic_read(&render->FramesFilled) < VIDEO_SURFACES_MAX && !render->Filter_Frames) {
 				render->FramesRb[render->FramesWrite] = frame;
 				render->FramesWrite = (render->FramesWrite + 1) % VIDEO_SURFACES_MAX;
 				atomic_inc(&render->FramesFilled);
-				pthread_mutex_unlock(&DisplayQueue);
+				TraceMutexUnlock(DisplayQueue);
+				Trace(TRACE_VIDEO_ENQUEUE, frame->pts);
+				VideoIdleWakeup();
 			} else {
-				pthread_mutex_unlock(&DisplayQueue);
-				usleep(10000);
+				TraceMutexUnlock(DisplayQueue);
+				VideoIdle(render, VideoPrimeSpace);
 				goto fillframe;
 			}
 
@@ -2169,11 +3352,13 @@ int64_t VideoGetClock(const VideoRender * render)
 ///
 void StartVideo(VideoRender * render)
 {
+	TraceMutexLock(PauseMutex);
 	render->VideoPaused = 0;
 	render->StartCounter = 0;
 	Debug("StartVideo: reset PauseCondition StartCounter %d Closing %d TrickSpeed %d",
 		render->StartCounter, render->Closing, render->TrickSpeed);
 	pthread_cond_signal(&PauseCondition);
+	TraceMutexUnlock(PauseMutex);
 }
 
 ///
@@ -2186,8 +3371,11 @@ void VideoSetClosing(VideoRender * render)
 	Debug("VideoSetClosing: buffers %d StartCounter %d",
 		render->buffers, render->StartCounter);
 
+	__atomic_store_n(&render->SkipPts, AV_NOPTS_VALUE, __ATOMIC_RELEASE);
+
 	if (render->buffers){
 		render->Closing = 1;
+		VideoIdleWakeup();
 
 		if (render->VideoPaused) {
 			StartVideo(render);
@@ -2203,6 +3391,7 @@ void VideoSetClosing(VideoRender * render)
 	render->StartCounter = 0;
 	render->FramesDuped = 0;
 	render->FramesDropped = 0;
+	render->FramesSkipped = 0;
 	render->TrickSpeed = 0;
 }
 
@@ -2234,6 +3423,36 @@ void VideoSetTrickSpeed(VideoRender * render, int speed)
 	}
 }
 
+///
+///	Set audio only mode.
+///
+///	Without video the decode and display threads don't poll, the
+///	display only commits osd changes.
+///
+///	@param render	video render
+///	@param on	audio only on/off
+///
+void VideoSetAudioOnly(VideoRender * render, int on)
+{
+	if (render->AudioOnly == on)
+		return;
+	Debug2(L_DRM, "VideoSetAudioOnly: %s", on ? "on" : "off");
+	render->AudioOnly = on;
+	VideoIdleWakeup();
+}
+
+///
+///	Drop decoded frames before a seek target.
+///
+///	@param render	video render
+///	@param pts	seek target in stream time base, AV_NOPTS_VALUE off
+///
+void VideoSetSkipPts(VideoRender * render, int64_t pts)
+{
+	Debug2(L_CODEC, "VideoSetSkipPts: skip to %s", Timestamp2String(pts));
+	__atomic_store_n(&render->SkipPts, pts, __ATOMIC_RELEASE);
+}
+
 ///
 //	Play video.
 //
@@ -2299,6 +3518,36 @@ void VideoGetStats(VideoRender * render, int *duped,
     *counter = render->StartCounter;
 }
 
+///
+///	Get video runtime metrics.
+///
+///	The counters are written by the video threads without locking,
+///	the values may be a frame behind.
+///
+///	@param render	video render
+///	@param[out] metrics	metrics to fill in
+///
+void VideoGetMetrics(VideoRender * render, SoftHDDevice_Metrics_v1_0_t * metrics)
+{
+    int i;
+
+    metrics->deintFrames = atomic_read(&render->FramesDeintFilled);
+    metrics->displayFrames = atomic_read(&render->FramesFilled);
+
+    for (i = 0; i < METRICS_HIST_BUCKETS && i < TRACE_HIST_BUCKETS; ++i) {
+	metrics->decodeHist[i] = render->DecodeHist.Bucket[i];
+	metrics->filterHist[i] = render->FilterHist.Bucket[i];
+	metrics->displayHist[i] = render->DisplayHist.Bucket[i];
+    }
+
+    metrics->avOffsetMs = render->AvOffset;
+    metrics->framesShown = render->StartCounter;
+    metrics->framesDroppedLate = render->FramesDropped;
+    metrics->framesDroppedSeek = render->FramesSkipped;
+    metrics->framesDroppedFlush = render->FramesFlushed;
+    metrics->framesDupedEarly = render->FramesDuped;
+}
+
 //----------------------------------------------------------------------------
 //	Setup
 //----------------------------------------------------------------------------
@@ -2319,6 +3568,28 @@ void VideoGetScreenSize(VideoRender * render, int *width, int *height,
 	*pixel_aspect = (double)16 / (double)9;
 }
 
+///
+///	Get osd size.
+///
+///	The osd can be rendered in a lower resolution than the display,
+///	the osd plane scales it up to the screen size.
+///
+///	@param[out] width	osd width
+///	@param[out] height	osd height
+///	@param[out] pixel_aspect	osd pixel aspect
+///
+void VideoGetOsdSize(VideoRender * render, int *width, int *height,
+		double *pixel_aspect)
+{
+	VideoGetScreenSize(render, width, height, pixel_aspect);
+
+	if (VideoOsdWidth && VideoOsdHeight &&
+	    VideoOsdWidth <= *width && VideoOsdHeight <= *height) {
+		*width = VideoOsdWidth;
+		*height = VideoOsdHeight;
+	}
+}
+
 ///
 ///	Get video size.
 ///
@@ -2358,17 +3629,26 @@ void VideoSetAudioDelay(int ms)
 }
 
 ///
-///	Initialize video output module.
+///	Set up the display, without the display thread.
 ///
-void VideoInit(VideoRender * render)
+BENCH_STATIC void VideoSetupDisplay(VideoRender * render)
 {
 	unsigned int i;
+	int osd_width, osd_height;
+	double osd_aspect;
 
 	if (FindDevice(render)){
 		Error("VideoInit: FindDevice() failed");
 	}
 
 	ReadHWPlatform(render);
+	VideoGetOsdSize(render, &osd_width, &osd_height, &osd_aspect);
+
+	// osd fades through the plane alpha property
+	render->OsdPlaneAlpha = PlaneHasProperty(render->planes[OSD_PLANE], "alpha");
+	render->OsdAlpha = render->OsdAlphaTo = 255;
+	atomic_set(&render->OsdFadeDuration, 0);
+	Debug2(L_DRM, "VideoInit: osd plane alpha %ssupported", render->OsdPlaneAlpha ? "" : "not ");
 
 	render->bufs[0].width = render->bufs[1].width = 0;
 	render->bufs[0].height = render->bufs[1].height = 0;
@@ -2376,25 +3656,10 @@ void VideoInit(VideoRender * render)
 
 	// osd FB
 #ifndef USE_GLES
-	if (!render->buf_osd)
-		render->buf_osd = calloc(1, sizeof(struct drm_buf));
-	render->buf_osd->pix_fmt = DRM_FORMAT_ARGB8888;
-	render->buf_osd->width = render->mode.hdisplay;
-	render->buf_osd->height = render->mode.vdisplay;
-	if (SetupFB(render, render->buf_osd, NULL, 0)){
-		Fatal("VideoOsdInit: SetupFB FB OSD failed!");
-	}
+	SetupOsdFBs(render, osd_width, osd_height);
 #else
-	if (DisableOglOsd) {
-		if (!render->buf_osd)
-			render->buf_osd = calloc(1, sizeof(struct drm_buf));
-		render->buf_osd->pix_fmt = DRM_FORMAT_ARGB8888;
-		render->buf_osd->width = render->mode.hdisplay;
-		render->buf_osd->height = render->mode.vdisplay;
-		if (SetupFB(render, render->buf_osd, NULL, 0)){
-			Fatal("VideoOsdInit: SetupFB FB OSD failed!");
-		}
-	}
+	if (DisableOglOsd)
+		SetupOsdFBs(render, osd_width, osd_height);
 #endif
 
 	// black fb
@@ -2412,6 +3677,17 @@ void VideoInit(VideoRender * render)
 		render->buf_black.plane[1][i] = 0x80;
 	}
 
+	render->OsdShown = 0;
+
+	// init variables page flip
+	memset(&render->ev, 0, sizeof(render->ev));
+	render->ev.version = 2;
+
+	if (VideoNullDisplay) {
+		// no mode to set
+		return;
+	}
+
 	// save actual modesetting
 	render->saved_crtc = drmModeGetCrtc(render->fd_drm, render->crtc_id);
 
@@ -2436,7 +3712,7 @@ void VideoInit(VideoRender * render)
 	// but initially move the OSD behind the VIDEO
 #ifndef USE_GLES
 	render->planes[OSD_PLANE]->properties.crtc_id = render->crtc_id;
-	render->planes[OSD_PLANE]->properties.fb_id = render->buf_osd->fb_id;
+	render->planes[OSD_PLANE]->properties.fb_id = render->bufs_osd[0]->fb_id;
 	render->planes[OSD_PLANE]->properties.crtc_x = 0;
 	render->planes[OSD_PLANE]->properties.crtc_y = 0;
 	render->planes[OSD_PLANE]->properties.crtc_w = render->mode.hdisplay;
@@ -2450,7 +3726,7 @@ void VideoInit(VideoRender * render)
 #else
 	if (DisableOglOsd) {
 		render->planes[OSD_PLANE]->properties.crtc_id = render->crtc_id;
-		render->planes[OSD_PLANE]->properties.fb_id = render->buf_osd->fb_id;
+		render->planes[OSD_PLANE]->properties.fb_id = render->bufs_osd[0]->fb_id;
 		render->planes[OSD_PLANE]->properties.crtc_x = 0;
 		render->planes[OSD_PLANE]->properties.crtc_y = 0;
 		render->planes[OSD_PLANE]->properties.crtc_w = render->mode.hdisplay;
@@ -2497,12 +3773,14 @@ void VideoInit(VideoRender * render)
 	}
 
 	drmModeAtomicFree(ModeReq);
+}
 
-	render->OsdShown = 0;
-
-	// init variables page flip
-	memset(&render->ev, 0, sizeof(render->ev));
-	render->ev.version = 2;
+///
+///	Initialize video output module.
+///
+void VideoInit(VideoRender * render)
+{
+	VideoSetupDisplay(render);
 
 	// Wakeup DisplayHandlerThread
 	VideoThreadWakeup(render, 0, 1);
@@ -2533,10 +3811,7 @@ void VideoExit(VideoRender * render)
 		DestroyFB(render->fd_drm, &render->buf_black);
 #ifdef USE_GLES
 		if (DisableOglOsd) {
-			if (render->buf_osd) {
-				DestroyFB(render->fd_drm, render->buf_osd);
-				free(render->buf_osd);
-			}
+			DestroyOsdFBs(render);
 		} else {
 			if (render->next_bo)
 				gbm_bo_destroy(render->next_bo);
@@ -2544,13 +3819,11 @@ void VideoExit(VideoRender * render)
 				gbm_bo_destroy(render->old_bo);
 		}
 #else
-		if (render->buf_osd) {
-			DestroyFB(render->fd_drm, render->buf_osd);
-			free(render->buf_osd);
-		}
+		DestroyOsdFBs(render);
 #endif
 
-		close(render->fd_drm);
+		if (render->fd_drm >= 0)
+			close(render->fd_drm);
 	}
 }
 